@@ -131,6 +131,7 @@ typedef struct SDL_Surface {
 #define SDL_SWSURFACE	0x00000000	/**< Surface is in system memory */
 #define SDL_HWSURFACE	0x00000001	/**< Surface is in video memory */
 #define SDL_ASYNCBLIT	0x00000004	/**< Use asynchronous blits if possible */
+#define SDL_CACHEALIGN	0x00000040	/**< Align pixels and rows to cache lines */
 /*@}*/
 
 /** Available for SDL_SetVideoMode() */
@@ -153,6 +154,8 @@ typedef struct SDL_Surface {
 #define SDL_RLEACCELOK	0x00002000	/**< Private flag */
 #define SDL_RLEACCEL	0x00004000	/**< Surface is RLE encoded */
 #define SDL_SRCALPHA	0x00010000	/**< Blit uses source alpha blending */
+#define SDL_SRCALPHA_PREMUL 0x00020000	/**< Source pixels are premultiplied by their alpha */
+#define SDL_SRCCOLORMOD	0x00040000	/**< Blit modulates source colors */
 #define SDL_PREALLOC	0x01000000	/**< Surface uses preallocated memory */
 /*@}*/
 
@@ -203,6 +206,8 @@ typedef struct SDL_VideoInfo {
 #define SDL_YUY2_OVERLAY  0x32595559	/**< Packed mode: Y0+U0+Y1+V0 (1 plane) */
 #define SDL_UYVY_OVERLAY  0x59565955	/**< Packed mode: U0+Y0+V0+Y1 (1 plane) */
 #define SDL_YVYU_OVERLAY  0x55595659	/**< Packed mode: Y0+V0+Y1+U0 (1 plane) */
+#define SDL_NV12_OVERLAY  0x3231564E	/**< Semi-planar mode: Y + U/V interleaved (2 planes) */
+#define SDL_NV21_OVERLAY  0x3132564E	/**< Semi-planar mode: Y + V/U interleaved (2 planes) */
 /*@}*/
 
 /** The YUV hardware video overlay */
@@ -628,11 +633,49 @@ extern DECLSPEC int SDLCALL SDL_SetColorKey
  * If 'flag' is SDL_SRCALPHA, alpha blending is enabled for the surface.
  * OR:ing the flag with SDL_RLEACCEL requests RLE acceleration for the
  * surface; if SDL_RLEACCEL is not specified, the RLE accel will be removed.
+ * OR:ing it with SDL_SRCALPHA_PREMUL says that the color channels of the
+ * surface are already multiplied by its alpha channel, so blits compute
+ * src + dst * (1 - alpha) for every channel, destination alpha included.
+ * The flag describes the pixel data, so later calls don't clear it; it
+ * stays set until the pixels are converted to a format without alpha.
+ * Premultiplied surfaces are never RLE accelerated.
  *
  * The 'alpha' parameter is ignored for surfaces that have an alpha channel.
  */
 extern DECLSPEC int SDLCALL SDL_SetAlpha(SDL_Surface *surface, Uint32 flag, Uint8 alpha);
 
+/**
+ * Sets the color modulation of a surface.
+ *
+ * If 'flag' is SDL_SRCCOLORMOD, blits of the surface multiply its red,
+ * green and blue channels by 'r', 'g' and 'b' divided by 255, in the same
+ * pass as the copy or blend.  While color modulation is enabled the
+ * per-surface alpha set with SDL_SetAlpha() also scales the alpha channel
+ * of surfaces that have one, so sprites can be tinted and faded without
+ * converting them.
+ * If 'flag' is 0, color modulation is disabled.
+ *
+ * Modulated surfaces are never RLE or hardware accelerated.  Color
+ * modulation needs a surface of 16 bits per pixel or more.
+ * This function returns 0, or -1 if there was an error.
+ */
+extern DECLSPEC int SDLCALL SDL_SetColorMod(SDL_Surface *surface, Uint32 flag, Uint8 r, Uint8 g, Uint8 b);
+
+/**
+ * Gets the color modulation of a surface, as set with SDL_SetColorMod().
+ */
+extern DECLSPEC void SDLCALL SDL_GetColorMod(SDL_Surface *surface, Uint8 *r, Uint8 *g, Uint8 *b);
+
+/**
+ * Surfaces with SDL_RLEACCEL set are normally RLE encoded by their first
+ * blit.  This function does the encoding right away for blits to the
+ * display surface, so that it can happen while loading instead of in the
+ * middle of a frame.  Surfaces that can't be RLE accelerated are left as
+ * they are.
+ * This function returns 0, or -1 if there was an error.
+ */
+extern DECLSPEC int SDLCALL SDL_PrepareRLE(SDL_Surface *surface);
+
 /**
  * Sets the clipping rectangle for the destination surface in a blit.
  *
@@ -663,6 +706,9 @@ extern DECLSPEC void SDLCALL SDL_GetClipRect(SDL_Surface *surface, SDL_Rect *rec
  * semantics.  You can also pass SDL_RLEACCEL in the flags parameter and
  * SDL will try to RLE accelerate colorkey and alpha blits in the resulting
  * surface.
+ * If the format has an alpha channel, passing SDL_SRCALPHA_PREMUL
+ * multiplies the color channels of the result by its alpha and sets up
+ * premultiplied alpha blits for it.
  *
  * This function is used internally by SDL_DisplayFormat().
  */
@@ -756,6 +802,25 @@ extern DECLSPEC int SDLCALL SDL_LowerBlit
 			(SDL_Surface *src, SDL_Rect *srcrect,
 			 SDL_Surface *dst, SDL_Rect *dstrect);
 
+/**
+ * This function performs a batch of blits from the same source surface
+ * to the same destination surface, such as tiles or font glyphs taken
+ * from one atlas image.  It is equivalent to calling SDL_BlitSurface()
+ * for each pair of rectangles, but the blit mapping is validated and
+ * the surfaces are locked only once for the whole batch.
+ *
+ * 'srcrects' and 'dstrects' are arrays of 'n' rectangles.  If 'srcrects'
+ * is NULL, the entire source surface is used for every blit.  Only the
+ * position of each destination rectangle is used, and the final blit
+ * rectangle is saved in it, as with SDL_BlitSurface().
+ *
+ * This function returns 0 on success, -1 on error, or -2 if one of the
+ * blits lost video memory, as described for SDL_BlitSurface().
+ */
+extern DECLSPEC int SDLCALL SDL_BlitSurfaceBatch
+			(SDL_Surface *src, const SDL_Rect *srcrects,
+			 SDL_Surface *dst, SDL_Rect *dstrects, int n);
+
 /**
  * This function performs a fast fill of the given rectangle with 'color'
  * The given rectangle is clipped to the destination surface clip area
@@ -768,6 +833,16 @@ extern DECLSPEC int SDLCALL SDL_LowerBlit
 extern DECLSPEC int SDLCALL SDL_FillRect
 		(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color);
 
+/**
+ * This function fills 'n' rectangles of the destination surface with
+ * 'color', locking the surface only once.  Each rectangle is clipped to
+ * the destination surface clip area as with SDL_FillRect(), but the
+ * rectangles passed in are not modified.
+ * This function returns 0 on success, or -1 on error.
+ */
+extern DECLSPEC int SDLCALL SDL_FillRects
+		(SDL_Surface *dst, const SDL_Rect *rects, int n, Uint32 color);
+
 /**
  * This function takes a surface and copies it to a new surface of the
  * pixel format and colors of the video framebuffer, suitable for fast
@@ -787,6 +862,11 @@ extern DECLSPEC SDL_Surface * SDLCALL SDL_DisplayFormat(SDL_Surface *surface);
  * suitable for fast alpha blitting onto the display surface.
  * The new surface will always have an alpha channel.
  *
+ * Surfaces with SDL_SRCALPHA_PREMUL set stay premultiplied.  If the
+ * SDL_PREMULTIPLIED_ALPHA environment variable is set to 1, other surfaces
+ * are premultiplied as well, as if SDL_SRCALPHA_PREMUL had been passed to
+ * SDL_ConvertSurface().
+ *
  * If you want to take advantage of hardware colorkey or alpha blit
  * acceleration, you should set the colorkey and alpha value before
  * calling this function.
@@ -942,6 +1022,11 @@ extern DECLSPEC SDL_GrabMode SDLCALL SDL_WM_GrabInput(SDL_GrabMode mode);
 /** @internal Not in public API at the moment - do not use! */
 extern DECLSPEC int SDLCALL SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
                                     SDL_Surface *dst, SDL_Rect *dstrect);
+/** @internal Not in public API at the moment - do not use!
+ *  Bilinear filtered stretch, for 16 bpp 565/555 and 32 bpp surfaces.
+ */
+extern DECLSPEC int SDLCALL SDL_SoftStretchLinear(SDL_Surface *src, SDL_Rect *srcrect,
+                                    SDL_Surface *dst, SDL_Rect *dstrect);
 
 #define SDL_REFRESH_DEFAULT 0
 
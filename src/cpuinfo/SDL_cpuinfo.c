@@ -79,6 +79,8 @@
 #define CPU_HAS_ALTIVEC	0x00000100
 #define CPU_HAS_ARM_SIMD 0x00000200
 #define CPU_HAS_NEON     0x00000400
+#define CPU_HAS_SSSE3    0x00000800
+#define CPU_HAS_AVX2     0x00001000
 
 #if SDL_ALTIVEC_BLITTERS && HAVE_SETJMP && !__MACOSX__ && !__OpenBSD__
 /* This is the brute force way of detecting instruction sets...
@@ -339,6 +341,117 @@ done:
 	return features;
 }
 
+static __inline__ int CPU_getCPUIDFeaturesECX(void)
+{
+	int features = 0;
+#if defined(__GNUC__) && defined(__i386__)
+	__asm__ (
+"        xorl    %%eax,%%eax         # Set up for CPUID instruction    \n"
+"        pushl   %%ebx                                                 \n"
+"        cpuid                       # Get and save vendor ID          \n"
+"        popl    %%ebx                                                 \n"
+"        cmpl    $1,%%eax            # Make sure 1 is valid input for CPUID\n"
+"        jl      1f                  # We dont have the CPUID instruction\n"
+"        xorl    %%eax,%%eax                                           \n"
+"        incl    %%eax                                                 \n"
+"        pushl   %%ebx                                                 \n"
+"        cpuid                       # Get family/model/stepping/features\n"
+"        popl    %%ebx                                                 \n"
+"        movl    %%ecx,%0                                              \n"
+"1:                                                                    \n"
+	: "=m" (features)
+	:
+	: "%eax", "%ecx", "%edx"
+	);
+#elif defined(__GNUC__) && defined(__x86_64__)
+	__asm__ (
+"        xorl    %%eax,%%eax         # Set up for CPUID instruction    \n"
+"        pushq   %%rbx                                                 \n"
+"        cpuid                       # Get and save vendor ID          \n"
+"        popq    %%rbx                                                 \n"
+"        cmpl    $1,%%eax            # Make sure 1 is valid input for CPUID\n"
+"        jl      1f                  # We dont have the CPUID instruction\n"
+"        xorl    %%eax,%%eax                                           \n"
+"        incl    %%eax                                                 \n"
+"        pushq   %%rbx                                                 \n"
+"        cpuid                       # Get family/model/stepping/features\n"
+"        popq    %%rbx                                                 \n"
+"        movl    %%ecx,%0                                              \n"
+"1:                                                                    \n"
+	: "=m" (features)
+	:
+	: "%rax", "%rcx", "%rdx"
+	);
+#endif
+	return features;
+}
+
+static __inline__ int CPU_getCPUIDFeatures7(void)
+{
+	int features = 0;
+#if defined(__GNUC__) && defined(__i386__)
+	__asm__ (
+"        xorl    %%eax,%%eax         # Set up for CPUID instruction    \n"
+"        pushl   %%ebx                                                 \n"
+"        cpuid                       # Get and save vendor ID          \n"
+"        popl    %%ebx                                                 \n"
+"        cmpl    $7,%%eax            # Make sure 7 is valid input for CPUID\n"
+"        jl      1f                  # Nope, no structured extended features\n"
+"        movl    $7,%%eax                                              \n"
+"        xorl    %%ecx,%%ecx                                           \n"
+"        pushl   %%ebx                                                 \n"
+"        cpuid                       # Get structured extended features\n"
+"        movl    %%ebx,%%eax                                           \n"
+"        popl    %%ebx                                                 \n"
+"        movl    %%eax,%0                                              \n"
+"1:                                                                    \n"
+	: "=m" (features)
+	:
+	: "%eax", "%ecx", "%edx"
+	);
+#elif defined(__GNUC__) && defined(__x86_64__)
+	__asm__ (
+"        xorl    %%eax,%%eax         # Set up for CPUID instruction    \n"
+"        pushq   %%rbx                                                 \n"
+"        cpuid                       # Get and save vendor ID          \n"
+"        popq    %%rbx                                                 \n"
+"        cmpl    $7,%%eax            # Make sure 7 is valid input for CPUID\n"
+"        jl      1f                  # Nope, no structured extended features\n"
+"        movl    $7,%%eax                                              \n"
+"        xorl    %%ecx,%%ecx                                           \n"
+"        pushq   %%rbx                                                 \n"
+"        cpuid                       # Get structured extended features\n"
+"        movl    %%ebx,%%eax                                           \n"
+"        popq    %%rbx                                                 \n"
+"        movl    %%eax,%0                                              \n"
+"1:                                                                    \n"
+	: "=m" (features)
+	:
+	: "%rax", "%rcx", "%rdx"
+	);
+#endif
+	return features;
+}
+
+/* AVX state has to be saved by the OS on context switch, or we can't use it */
+static __inline__ int CPU_OSSavesYMM(void)
+{
+	int xcr0 = 0;
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	if ( CPU_getCPUIDFeaturesECX() & 0x08000000 ) {
+		__asm__ (
+"        xorl    %%ecx,%%ecx                                           \n"
+"        .byte   0x0f,0x01,0xd0      # xgetbv                          \n"
+"        movl    %%eax,%0                                              \n"
+		: "=m" (xcr0)
+		:
+		: "%eax", "%ecx", "%edx"
+		);
+	}
+#endif
+	return ((xcr0 & 6) == 6);
+}
+
 static __inline__ int CPU_haveRDTSC(void)
 {
 	if ( CPU_haveCPUID() ) {
@@ -395,6 +508,22 @@ static __inline__ int CPU_haveSSE2(void)
 	return 0;
 }
 
+static __inline__ int CPU_haveSSSE3(void)
+{
+	if ( CPU_haveCPUID() ) {
+		return (CPU_getCPUIDFeaturesECX() & 0x00000200);
+	}
+	return 0;
+}
+
+static __inline__ int CPU_haveAVX2(void)
+{
+	if ( CPU_haveCPUID() && CPU_OSSavesYMM() ) {
+		return (CPU_getCPUIDFeatures7() & 0x00000020);
+	}
+	return 0;
+}
+
 static __inline__ int CPU_haveAltiVec(void)
 {
 	volatile int altivec = 0;
@@ -597,6 +726,12 @@ static Uint32 SDL_GetCPUFeatures(void)
 		if ( CPU_haveSSE2() ) {
 			SDL_CPUFeatures |= CPU_HAS_SSE2;
 		}
+		if ( CPU_haveSSSE3() ) {
+			SDL_CPUFeatures |= CPU_HAS_SSSE3;
+		}
+		if ( CPU_haveAVX2() ) {
+			SDL_CPUFeatures |= CPU_HAS_AVX2;
+		}
 		if ( CPU_haveAltiVec() ) {
 			SDL_CPUFeatures |= CPU_HAS_ALTIVEC;
 		}
@@ -666,6 +801,22 @@ SDL_bool SDL_HasSSE2(void)
 	return SDL_FALSE;
 }
 
+SDL_bool SDL_HasSSSE3(void)
+{
+	if ( SDL_GetCPUFeatures() & CPU_HAS_SSSE3 ) {
+		return SDL_TRUE;
+	}
+	return SDL_FALSE;
+}
+
+SDL_bool SDL_HasAVX2(void)
+{
+	if ( SDL_GetCPUFeatures() & CPU_HAS_AVX2 ) {
+		return SDL_TRUE;
+	}
+	return SDL_FALSE;
+}
+
 SDL_bool SDL_HasAltiVec(void)
 {
 	if ( SDL_GetCPUFeatures() & CPU_HAS_ALTIVEC ) {
@@ -703,6 +854,8 @@ int main()
 	printf("3DNowExt: %d\n", SDL_Has3DNowExt());
 	printf("SSE: %d\n", SDL_HasSSE());
 	printf("SSE2: %d\n", SDL_HasSSE2());
+	printf("SSSE3: %d\n", SDL_HasSSSE3());
+	printf("AVX2: %d\n", SDL_HasAVX2());
 	printf("AltiVec: %d\n", SDL_HasAltiVec());
 	printf("ARM SIMD: %d\n", SDL_HasARMSIMD());
 	printf("NEON: %d\n", SDL_HasNEON());
@@ -59,10 +59,15 @@
  *   The end of the sequence is marked by a zero <skip>,<run> pair at the *
  *   beginning of a line.
  *
+ *   The sequence is preceded by a line index: the offset of each scan line
+ *   from the start of the sequence, as 32 bit integers. Lines after the
+ *   last non-blank one all point at the end marker.
+ *
  * Encoding of surfaces with per-pixel alpha:
  *
  *   The sequence begins with a struct RLEDestFormat describing the target
- *   pixel format, to provide reliable un-encoding.
+ *   pixel format, to provide reliable un-encoding, followed by the line
+ *   index as above.
  *
  *   Each scan line is encoded twice: First all completely opaque pixels,
  *   encoded in the target format as described above, and then all
@@ -89,7 +94,13 @@
 #include "SDL_video.h"
 #include "SDL_sysvideo.h"
 #include "SDL_blit.h"
+#include "SDL_pixels_c.h"
 #include "SDL_RLEaccel_c.h"
+#include "SDL_cpuinfo.h"
+
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
 
 /* Force MMX to 0; this blows up on almost every major compiler now. --ryan. */
 #if 0 && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && SDL_ASSEMBLY_ROUTINES
@@ -98,7 +109,6 @@
 
 #ifdef MMX_ASMBLIT
 #include "mmx.h"
-#include "SDL_cpuinfo.h"
 #endif
 
 #ifndef MAX
@@ -858,42 +868,10 @@ int SDL_RLEBlit(SDL_Surface *src, SDL_Rect *srcrect,
 	y = dstrect->y;
 	dstbuf = (Uint8 *)dst->pixels
 	         + y * dst->pitch + x * src->format->BytesPerPixel;
-	srcbuf = (Uint8 *)src->map->sw_data->aux_data;
-
 	{
-	    /* skip lines at the top if neccessary */
-	    int vskip = srcrect->y;
-	    int ofs = 0;
-	    if(vskip) {
-
-#define RLESKIP(bpp, Type)			\
-		for(;;) {			\
-		    int run;			\
-		    ofs += *(Type *)srcbuf;	\
-		    run = ((Type *)srcbuf)[1];	\
-		    srcbuf += sizeof(Type) * 2;	\
-		    if(run) {			\
-			srcbuf += run * bpp;	\
-			ofs += run;		\
-		    } else if(!ofs)		\
-			goto done;		\
-		    if(ofs == w) {		\
-			ofs = 0;		\
-			if(!--vskip)		\
-			    break;		\
-		    }				\
-		}
-
-		switch(src->format->BytesPerPixel) {
-		case 1: RLESKIP(1, Uint8); break;
-		case 2: RLESKIP(2, Uint8); break;
-		case 3: RLESKIP(3, Uint8); break;
-		case 4: RLESKIP(4, Uint16); break;
-		}
-
-#undef RLESKIP
-
-	    }
+	    /* start at the first visible line */
+	    Uint32 *index = (Uint32 *)src->map->sw_data->aux_data;
+	    srcbuf = (Uint8 *)(index + src->h) + index[srcrect->y];
 	}
 
 	alpha = (src->flags & SDL_SRCALPHA) == SDL_SRCALPHA
@@ -933,7 +911,6 @@ int SDL_RLEBlit(SDL_Surface *src, SDL_Rect *srcrect,
 #undef RLEBLIT
 	}
 
-done:
 	/* Unlock the destination if necessary */
 	if ( SDL_MUSTLOCK(dst) ) {
 		SDL_UnlockSurface(dst);
@@ -1011,17 +988,151 @@ typedef struct {
 	Uint32 Amask;
 } RLEDestFormat;
 
+/*
+ * Blend a run of translucent pixels.  The SSE2 versions compute the same
+ * packed arithmetic as the macros above in each 32-bit lane, so they give
+ * exactly the same results.
+ */
+typedef void (*RLEBlendFunc)(void *dst, Uint32 *src, int n);
+
+static void BlendTransl888(void *dst, Uint32 *src, int n)
+{
+    Uint32 *dp = (Uint32 *)dst;
+    int i;
+    for(i = 0; i < n; i++)
+	BLIT_TRANSL_888(src[i], dp[i]);
+}
+
+static void BlendTransl565(void *dst, Uint32 *src, int n)
+{
+    Uint16 *dp = (Uint16 *)dst;
+    int i;
+    for(i = 0; i < n; i++)
+	BLIT_TRANSL_565(src[i], dp[i]);
+}
+
+static void BlendTransl555(void *dst, Uint32 *src, int n)
+{
+    Uint16 *dp = (Uint16 *)dst;
+    int i;
+    for(i = 0; i < n; i++)
+	BLIT_TRANSL_555(src[i], dp[i]);
+}
+
+#if SDL_SSE2_INTRINSICS
+/* multiply 32-bit lanes by factors below 65536, given in both 16-bit
+   halves of each lane (SSE2 has no 32-bit multiply) */
+SDL_TARGETING("sse2")
+static __inline__ __m128i MulLanesSSE2(__m128i x, __m128i f)
+{
+    return _mm_add_epi32(_mm_mullo_epi16(x, f),
+			 _mm_slli_epi32(_mm_mulhi_epu16(x, f), 16));
+}
+
+SDL_TARGETING("sse2")
+static void BlendTransl888SSE2(void *dstp, Uint32 *src, int n)
+{
+    Uint32 *dst = (Uint32 *)dstp;
+    __m128i rbmask = _mm_set1_epi32(0xff00ff);
+    __m128i gmask = _mm_set1_epi32(0xff00);
+
+    while(n >= 4) {
+	__m128i s = _mm_loadu_si128((__m128i *)src);
+	__m128i d = _mm_loadu_si128((__m128i *)dst);
+	__m128i alpha = _mm_srli_epi32(s, 24);
+	__m128i s1, d1;
+	alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+	s1 = _mm_and_si128(s, rbmask);
+	d1 = _mm_and_si128(d, rbmask);
+	d1 = _mm_add_epi32(d1, _mm_srli_epi32(
+			       MulLanesSSE2(_mm_sub_epi32(s1, d1), alpha), 8));
+	d1 = _mm_and_si128(d1, rbmask);
+	s = _mm_and_si128(s, gmask);
+	d = _mm_and_si128(d, gmask);
+	d = _mm_add_epi32(d, _mm_srli_epi32(
+			      MulLanesSSE2(_mm_sub_epi32(s, d), alpha), 8));
+	d = _mm_and_si128(d, gmask);
+	_mm_storeu_si128((__m128i *)dst, _mm_or_si128(d1, d));
+	src += 4;
+	dst += 4;
+	n -= 4;
+    }
+    BlendTransl888(dst, src, n);
+}
+
+/* mask is 0x07e0f81f for 565 and 0x03e07c1f for 555 */
+SDL_TARGETING("sse2")
+static __inline__ void BlendTransl16SSE2(Uint16 *dst, Uint32 *src, int n,
+					 Uint32 mask)
+{
+    __m128i vmask = _mm_set1_epi32((int)mask);
+    __m128i amask = _mm_set1_epi32(0x3e0);
+
+    while(n >= 4) {
+	__m128i s = _mm_loadu_si128((__m128i *)src);
+	__m128i d = _mm_loadl_epi64((__m128i *)dst);
+	__m128i alpha = _mm_srli_epi32(_mm_and_si128(s, amask), 5);
+	alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+	s = _mm_and_si128(s, vmask);
+	d = _mm_and_si128(_mm_unpacklo_epi16(d, d), vmask);
+	d = _mm_add_epi32(d, _mm_srli_epi32(
+			      MulLanesSSE2(_mm_sub_epi32(s, d), alpha), 5));
+	d = _mm_and_si128(d, vmask);
+	d = _mm_or_si128(d, _mm_srli_epi32(d, 16));
+	/* sign extend the low halves so that the pack doesn't saturate */
+	d = _mm_srai_epi32(_mm_slli_epi32(d, 16), 16);
+	_mm_storel_epi64((__m128i *)dst, _mm_packs_epi32(d, d));
+	src += 4;
+	dst += 4;
+	n -= 4;
+    }
+    if(mask == 0x07e0f81f)
+	BlendTransl565(dst, src, n);
+    else
+	BlendTransl555(dst, src, n);
+}
+
+SDL_TARGETING("sse2")
+static void BlendTransl565SSE2(void *dst, Uint32 *src, int n)
+{
+    BlendTransl16SSE2((Uint16 *)dst, src, n, 0x07e0f81f);
+}
+
+SDL_TARGETING("sse2")
+static void BlendTransl555SSE2(void *dst, Uint32 *src, int n)
+{
+    BlendTransl16SSE2((Uint16 *)dst, src, n, 0x03e07c1f);
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+static RLEBlendFunc ChooseBlendTransl(SDL_PixelFormat *df)
+{
+    int is565 = (df->Gmask == 0x07e0 || df->Rmask == 0x07e0
+		 || df->Bmask == 0x07e0);
+
+#if SDL_SSE2_INTRINSICS
+    if(SDL_HasSSE2()) {
+	if(df->BytesPerPixel == 4)
+	    return BlendTransl888SSE2;
+	return is565 ? BlendTransl565SSE2 : BlendTransl555SSE2;
+    }
+#endif
+    if(df->BytesPerPixel == 4)
+	return BlendTransl888;
+    return is565 ? BlendTransl565 : BlendTransl555;
+}
+
 /* blit a pixel-alpha RLE surface clipped at the right and/or left edges */
 static void RLEAlphaClipBlit(int w, Uint8 *srcbuf, SDL_Surface *dst,
-			     Uint8 *dstbuf, SDL_Rect *srcrect)
+			     Uint8 *dstbuf, SDL_Rect *srcrect,
+			     RLEBlendFunc blend)
 {
     SDL_PixelFormat *df = dst->format;
     /*
      * clipped blitter: Ptype is the destination pixel type,
-     * Ctype the translucent count type, and do_blend the macro
-     * to blend one pixel.
+     * and Ctype the translucent count type.
      */
-#define RLEALPHACLIPBLIT(Ptype, Ctype, do_blend)			  \
+#define RLEALPHACLIPBLIT(Ptype, Ctype)					  \
     do {								  \
 	int linecount = srcrect->h;					  \
 	int left = srcrect->x;						  \
@@ -1074,13 +1185,9 @@ static void RLEAlphaClipBlit(int w, Uint8 *srcbuf, SDL_Surface *dst,
 		    }							  \
 		    if(crun > right - cofs)				  \
 			crun = right - cofs;				  \
-		    if(crun > 0) {					  \
-			Ptype *dst = (Ptype *)dstbuf + cofs;		  \
-			Uint32 *src = (Uint32 *)srcbuf + (cofs - ofs);	  \
-			int i;						  \
-			for(i = 0; i < crun; i++)			  \
-			    do_blend(src[i], dst[i]);			  \
-		    }							  \
+		    if(crun > 0)					  \
+			blend((Ptype *)dstbuf + cofs,			  \
+			      (Uint32 *)srcbuf + (cofs - ofs), crun);	  \
 		    srcbuf += run * 4;					  \
 		    ofs += run;						  \
 		}							  \
@@ -1091,14 +1198,10 @@ static void RLEAlphaClipBlit(int w, Uint8 *srcbuf, SDL_Surface *dst,
 
     switch(df->BytesPerPixel) {
     case 2:
-	if(df->Gmask == 0x07e0 || df->Rmask == 0x07e0
-	   || df->Bmask == 0x07e0)
-	    RLEALPHACLIPBLIT(Uint16, Uint8, BLIT_TRANSL_565);
-	else
-	    RLEALPHACLIPBLIT(Uint16, Uint8, BLIT_TRANSL_555);
+	RLEALPHACLIPBLIT(Uint16, Uint8);
 	break;
     case 4:
-	RLEALPHACLIPBLIT(Uint32, Uint16, BLIT_TRANSL_888);
+	RLEALPHACLIPBLIT(Uint32, Uint16);
 	break;
     }
 }
@@ -1111,6 +1214,7 @@ int SDL_RLEAlphaBlit(SDL_Surface *src, SDL_Rect *srcrect,
     int w = src->w;
     Uint8 *srcbuf, *dstbuf;
     SDL_PixelFormat *df = dst->format;
+    RLEBlendFunc blend = ChooseBlendTransl(df);
 
     /* Lock the destination if necessary */
     if ( SDL_MUSTLOCK(dst) ) {
@@ -1123,75 +1227,23 @@ int SDL_RLEAlphaBlit(SDL_Surface *src, SDL_Rect *srcrect,
     y = dstrect->y;
     dstbuf = (Uint8 *)dst->pixels
 	     + y * dst->pitch + x * df->BytesPerPixel;
-    srcbuf = (Uint8 *)src->map->sw_data->aux_data + sizeof(RLEDestFormat);
-
     {
-	/* skip lines at the top if necessary */
-	int vskip = srcrect->y;
-	if(vskip) {
-	    int ofs;
-	    if(df->BytesPerPixel == 2) {
-		/* the 16/32 interleaved format */
-		do {
-		    /* skip opaque line */
-		    ofs = 0;
-		    do {
-			int run;
-			ofs += srcbuf[0];
-			run = srcbuf[1];
-			srcbuf += 2;
-			if(run) {
-			    srcbuf += 2 * run;
-			    ofs += run;
-			} else if(!ofs)
-			    goto done;
-		    } while(ofs < w);
-
-		    /* skip padding */
-		    srcbuf += (uintptr_t)srcbuf & 2;
-
-		    /* skip translucent line */
-		    ofs = 0;
-		    do {
-			int run;
-			ofs += ((Uint16 *)srcbuf)[0];
-			run = ((Uint16 *)srcbuf)[1];
-			srcbuf += 4 * (run + 1);
-			ofs += run;
-		    } while(ofs < w);
-		} while(--vskip);
-	    } else {
-		/* the 32/32 interleaved format */
-		vskip <<= 1;	/* opaque and translucent have same format */
-		do {
-		    ofs = 0;
-		    do {
-			int run;
-			ofs += ((Uint16 *)srcbuf)[0];
-			run = ((Uint16 *)srcbuf)[1];
-			srcbuf += 4;
-			if(run) {
-			    srcbuf += 4 * run;
-			    ofs += run;
-			} else if(!ofs)
-			    goto done;
-		    } while(ofs < w);
-		} while(--vskip);
-	    }
-	}
+	/* start at the first visible line */
+	Uint32 *index = (Uint32 *)((RLEDestFormat *)
+				   src->map->sw_data->aux_data + 1);
+	srcbuf = (Uint8 *)(index + src->h) + index[srcrect->y];
     }
 
     /* if left or right edge clipping needed, call clip blit */
     if(srcrect->x || srcrect->w != src->w) {
-	RLEAlphaClipBlit(w, srcbuf, dst, dstbuf, srcrect);
+	RLEAlphaClipBlit(w, srcbuf, dst, dstbuf, srcrect, blend);
     } else {
 
 	/*
 	 * non-clipped blitter. Ptype is the destination pixel type,
-	 * Ctype the translucent count type, and do_blend the
-	 * macro to blend one pixel.
+	 * and Ctype the translucent count type.
 	 */
-#define RLEALPHABLIT(Ptype, Ctype, do_blend)				 \
+#define RLEALPHABLIT(Ptype, Ctype)					 \
 	do {								 \
 	    int linecount = srcrect->h;					 \
 	    do {							 \
@@ -1221,14 +1273,9 @@ int SDL_RLEAlphaBlit(SDL_Surface *src, SDL_Rect *srcrect,
 		    run = ((Uint16 *)srcbuf)[1];			 \
 		    srcbuf += 4;					 \
 		    if(run) {						 \
-			Ptype *dst = (Ptype *)dstbuf + ofs;		 \
-			unsigned i;					 \
-			for(i = 0; i < run; i++) {			 \
-			    Uint32 src = *(Uint32 *)srcbuf;		 \
-			    do_blend(src, *dst);			 \
-			    srcbuf += 4;				 \
-			    dst++;					 \
-			}						 \
+			blend((Ptype *)dstbuf + ofs, (Uint32 *)srcbuf,	 \
+			      run);					 \
+			srcbuf += run * 4;				 \
 			ofs += run;					 \
 		    }							 \
 		} while(ofs < w);					 \
@@ -1238,14 +1285,10 @@ int SDL_RLEAlphaBlit(SDL_Surface *src, SDL_Rect *srcrect,
 
 	switch(df->BytesPerPixel) {
 	case 2:
-	    if(df->Gmask == 0x07e0 || df->Rmask == 0x07e0
-	       || df->Bmask == 0x07e0)
-		RLEALPHABLIT(Uint16, Uint8, BLIT_TRANSL_565);
-	    else
-		RLEALPHABLIT(Uint16, Uint8, BLIT_TRANSL_555);
+	    RLEALPHABLIT(Uint16, Uint8);
 	    break;
 	case 4:
-	    RLEALPHABLIT(Uint32, Uint16, BLIT_TRANSL_888);
+	    RLEALPHABLIT(Uint32, Uint16);
 	    break;
 	}
     }
@@ -1396,20 +1439,378 @@ static int uncopy_32(Uint32 *dst, void *src, int n,
 #define ISTRANSL(pixel, fmt)	\
     ((unsigned)((((pixel) & fmt->Amask) >> fmt->Ashift) - 1U) < 254U)
 
+static Uint32 getpix_8(Uint8 *srcbuf)
+{
+    return *srcbuf;
+}
+
+static Uint32 getpix_16(Uint8 *srcbuf)
+{
+    return *(Uint16 *)srcbuf;
+}
+
+static Uint32 getpix_24(Uint8 *srcbuf)
+{
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    return srcbuf[0] + (srcbuf[1] << 8) + (srcbuf[2] << 16);
+#else
+    return (srcbuf[0] << 16) + (srcbuf[1] << 8) + srcbuf[2];
+#endif
+}
+
+static Uint32 getpix_32(Uint8 *srcbuf)
+{
+    return *(Uint32 *)srcbuf;
+}
+
+typedef Uint32 (*getpix_func)(Uint8 *);
+
+static getpix_func getpixes[4] = {
+    getpix_8, getpix_16, getpix_24, getpix_32
+};
+
+/*
+ * Run detection for the encoders.  Each scan returns the end of the run
+ * of pixels of one kind starting at x.  The SIMD versions test a whole
+ * vector of pixels at a time, and stop at the vector that holds the end
+ * of the run for the scalar loop to finish.
+ */
+typedef struct {
+    SDL_PixelFormat *sf;
+    int bpp;
+    Uint32 mask;		/* bits compared against the key */
+    Uint32 key;
+    int simd;			/* use the SIMD scans */
+} RLEScan;
+
+#if SDL_SSE2_INTRINSICS
+SDL_TARGETING("sse2")
+static int ScanKeySSE2(Uint8 *row, int x, int w, int bpp,
+		       Uint32 mask, Uint32 key, int keyed)
+{
+    int n = 16 / bpp;
+    int want = keyed ? 0xffff : 0;
+    __m128i vmask, vkey;
+
+    switch(bpp) {
+    case 1:
+	vmask = _mm_set1_epi8((char)mask);
+	vkey = _mm_set1_epi8((char)key);
+	break;
+    case 2:
+	vmask = _mm_set1_epi16((short)mask);
+	vkey = _mm_set1_epi16((short)key);
+	break;
+    default:
+	vmask = _mm_set1_epi32((int)mask);
+	vkey = _mm_set1_epi32((int)key);
+	break;
+    }
+    while(x + n <= w) {
+	__m128i p = _mm_and_si128(_mm_loadu_si128((__m128i *)(row + x * bpp)),
+				  vmask);
+	__m128i eq;
+	if(bpp == 1)
+	    eq = _mm_cmpeq_epi8(p, vkey);
+	else if(bpp == 2)
+	    eq = _mm_cmpeq_epi16(p, vkey);
+	else
+	    eq = _mm_cmpeq_epi32(p, vkey);
+	if(_mm_movemask_epi8(eq) != want)
+	    break;
+	x += n;
+    }
+    return x;
+}
+
+/* only used for 8-bit alpha channels, where opaque means all mask bits */
+SDL_TARGETING("sse2")
+static int ScanAlphaSSE2(Uint32 *row, int x, int w, Uint32 amask,
+			 int transl, int match)
+{
+    __m128i vmask = _mm_set1_epi32((int)amask);
+    __m128i zero = _mm_setzero_si128();
+    int want = match ? 0xffff : 0;
+
+    while(x + 4 <= w) {
+	__m128i a = _mm_and_si128(_mm_loadu_si128((__m128i *)(row + x)),
+				  vmask);
+	__m128i opaque = _mm_cmpeq_epi32(a, vmask);
+	int bits;
+	if(transl)
+	    bits = _mm_movemask_epi8(_mm_or_si128(opaque,
+					_mm_cmpeq_epi32(a, zero))) ^ 0xffff;
+	else
+	    bits = _mm_movemask_epi8(opaque);
+	if(bits != want)
+	    break;
+	x += 4;
+    }
+    return x;
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+/* Most runs in sprites are short, so the first few pixels of a run are
+   checked one at a time before going through the SIMD scans */
+#define RLE_SHORT_RUN	8
+
+/* end of the run of pixels that are (keyed != 0) or are not the colorkey */
+static __inline__ int ScanKeyRun(RLEScan *scan, Uint8 *row, int x, int w, int keyed)
+{
+    getpix_func getpix = getpixes[scan->bpp - 1];
+    int bpp = scan->bpp;
+    Uint32 mask = scan->mask;
+    Uint32 key = scan->key;
+    int end = MIN(x + RLE_SHORT_RUN, w);
+
+    while(x < end && ((getpix(row + x * bpp) & mask) == key) == keyed)
+	x++;
+    if(x < end)
+	return x;
+#if SDL_SSE2_INTRINSICS
+    if(scan->simd)
+	x = ScanKeySSE2(row, x, w, bpp, mask, key, keyed);
+#endif
+    while(x < w && ((getpix(row + x * bpp) & mask) == key) == keyed)
+	x++;
+    return x;
+}
+
+/* end of the run of pixels that are (match != 0) or are not opaque */
+static __inline__ int ScanOpaqueRun(RLEScan *scan, Uint32 *row, int x, int w, int match)
+{
+    SDL_PixelFormat *sf = scan->sf;
+    int end = MIN(x + RLE_SHORT_RUN, w);
+
+    while(x < end && ISOPAQUE(row[x], sf) == match)
+	x++;
+    if(x < end)
+	return x;
+#if SDL_SSE2_INTRINSICS
+    if(scan->simd)
+	x = ScanAlphaSSE2(row, x, w, sf->Amask, 0, match);
+#endif
+    while(x < w && ISOPAQUE(row[x], sf) == match)
+	x++;
+    return x;
+}
+
+/* end of the run of pixels that are (match != 0) or are not translucent */
+static __inline__ int ScanTranslRun(RLEScan *scan, Uint32 *row, int x, int w, int match)
+{
+    SDL_PixelFormat *sf = scan->sf;
+    int end = MIN(x + RLE_SHORT_RUN, w);
+
+    while(x < end && ISTRANSL(row[x], sf) == match)
+	x++;
+    if(x < end)
+	return x;
+#if SDL_SSE2_INTRINSICS
+    if(scan->simd)
+	x = ScanAlphaSSE2(row, x, w, sf->Amask, 1, match);
+#endif
+    while(x < w && ISTRANSL(row[x], sf) == match)
+	x++;
+    return x;
+}
+
+/*
+ * Large surfaces are encoded in bands of lines in parallel.  Every line
+ * gets a slot of the worst case encoded size in the output buffer, so
+ * each band is encoded in place at the slot of its first line, and the
+ * bands are then packed together in order.
+ */
+typedef struct {
+    int y0, y1;			/* lines of the band */
+    Uint8 *start;		/* where the band was encoded */
+    Uint8 *end;			/* end of its encoded lines */
+    Uint8 *lastline;		/* end of its last non-blank line, or NULL */
+} RLEBand;
+
+typedef struct {
+    SDL_Surface *surface;
+    RLEScan scan;
+    Uint8 *buf;			/* start of the encoded lines */
+    Uint32 *index;		/* line index, in front of buf */
+    int linesize;		/* worst case encoded size of one line */
+    RLEBand *bands;
+
+    /* surfaces with per-pixel alpha only */
+    SDL_PixelFormat *df;
+    int max_opaque_run;
+    int (*copy_opaque)(void *, Uint32 *, int,
+		       SDL_PixelFormat *, SDL_PixelFormat *);
+    int (*copy_transl)(void *, Uint32 *, int,
+		       SDL_PixelFormat *, SDL_PixelFormat *);
+} RLEEncodeData;
+
+/* Line slots are rounded up so that every band starts 32-bit aligned */
+#define RLE_LINESIZE(size)	(((size) + 3) & ~3)
+
+/* Encode all lines with encode_band() and return the end of the last
+   non-blank line, where the end marker goes */
+static Uint8 *RLEEncodeLines(RLEEncodeData *data, SDL_BandFunc encode_band)
+{
+    SDL_Surface *surface = data->surface;
+    RLEBand single;
+    Uint8 *dst, *lastline;
+    int nbands, i;
+
+    nbands = SDL_GetBlitBands(surface->w, surface->h);
+    data->bands = NULL;
+    if(nbands > 1)
+	data->bands = (RLEBand *)SDL_malloc(nbands * sizeof(RLEBand));
+    if(!data->bands) {
+	data->bands = &single;
+	nbands = 1;
+    }
+    SDL_RunBlitBands(encode_band, data, nbands);
+
+    dst = lastline = data->buf;
+    for(i = 0; i < nbands; i++) {
+	RLEBand *band = &data->bands[i];
+	size_t len = band->end - band->start;
+	Uint32 ofs = (Uint32)(dst - data->buf);
+	int y;
+	if(band->start != dst)
+	    SDL_memmove(dst, band->start, len);
+	if(band->lastline)
+	    lastline = dst + (band->lastline - band->start);
+	for(y = band->y0; y < band->y1; y++)
+	    data->index[y] += ofs;
+	dst += len;
+    }
+    if(data->bands != &single)
+	SDL_free(data->bands);
+
+    /* trailing blank lines are left out, so they start at the end marker */
+    for(i = 0; i < surface->h; i++) {
+	if(data->index[i] > (Uint32)(lastline - data->buf))
+	    data->index[i] = (Uint32)(lastline - data->buf);
+    }
+    return lastline;
+}
+
+/* opaque counts are 8 or 16 bits, depending on target depth */
+#define ADD_OPAQUE_COUNTS(n, m)			\
+	if(df->BytesPerPixel == 4) {		\
+	    ((Uint16 *)dst)[0] = n;		\
+	    ((Uint16 *)dst)[1] = m;		\
+	    dst += 4;				\
+	} else {				\
+	    dst[0] = n;				\
+	    dst[1] = m;				\
+	    dst += 2;				\
+	}
+
+/* translucent counts are always 16 bit */
+#define ADD_TRANSL_COUNTS(n, m)		\
+	(((Uint16 *)dst)[0] = n, ((Uint16 *)dst)[1] = m, dst += 4)
+
+static void RLEAlphaBand(void *arg, int band, int nbands)
+{
+    RLEEncodeData *data = (RLEEncodeData *)arg;
+    RLEBand *b = &data->bands[band];
+    SDL_Surface *surface = data->surface;
+    SDL_PixelFormat *df = data->df;
+    int max_opaque_run = data->max_opaque_run;
+    int max_transl_run = 65535;
+    int x, y;
+    int y0 = surface->h * band / nbands;
+    int y1 = surface->h * (band + 1) / nbands;
+    int w = surface->w;
+    SDL_PixelFormat *sf = surface->format;
+    Uint32 *src = (Uint32 *)((Uint8 *)surface->pixels + y0 * surface->pitch);
+    Uint8 *dst = data->buf + y0 * data->linesize;
+    Uint8 *lastline = NULL;	/* end of last non-blank line */
+
+    b->y0 = y0;
+    b->y1 = y1;
+    b->start = dst;
+    for(y = y0; y < y1; y++) {
+	int runstart, skipstart;
+	int blankline = 0;
+	data->index[y] = (Uint32)(dst - b->start);
+	/* First encode all opaque pixels of a scan line */
+	x = 0;
+	do {
+	    int run, skip, len;
+	    skipstart = x;
+	    x = ScanOpaqueRun(&data->scan, src, x, w, 0);
+	    runstart = x;
+	    x = ScanOpaqueRun(&data->scan, src, x, w, 1);
+	    skip = runstart - skipstart;
+	    if(skip == w)
+		blankline = 1;
+	    run = x - runstart;
+	    while(skip > max_opaque_run) {
+		ADD_OPAQUE_COUNTS(max_opaque_run, 0);
+		skip -= max_opaque_run;
+	    }
+	    len = MIN(run, max_opaque_run);
+	    ADD_OPAQUE_COUNTS(skip, len);
+	    dst += data->copy_opaque(dst, src + runstart, len, sf, df);
+	    runstart += len;
+	    run -= len;
+	    while(run) {
+		len = MIN(run, max_opaque_run);
+		ADD_OPAQUE_COUNTS(0, len);
+		dst += data->copy_opaque(dst, src + runstart, len, sf, df);
+		runstart += len;
+		run -= len;
+	    }
+	} while(x < w);
+
+	/* Make sure the next output address is 32-bit aligned */
+	dst += (uintptr_t)dst & 2;
+
+	/* Next, encode all translucent pixels of the same scan line */
+	x = 0;
+	do {
+	    int run, skip, len;
+	    skipstart = x;
+	    x = ScanTranslRun(&data->scan, src, x, w, 0);
+	    runstart = x;
+	    x = ScanTranslRun(&data->scan, src, x, w, 1);
+	    skip = runstart - skipstart;
+	    blankline &= (skip == w);
+	    run = x - runstart;
+	    while(skip > max_transl_run) {
+		ADD_TRANSL_COUNTS(max_transl_run, 0);
+		skip -= max_transl_run;
+	    }
+	    len = MIN(run, max_transl_run);
+	    ADD_TRANSL_COUNTS(skip, len);
+	    dst += data->copy_transl(dst, src + runstart, len, sf, df);
+	    runstart += len;
+	    run -= len;
+	    while(run) {
+		len = MIN(run, max_transl_run);
+		ADD_TRANSL_COUNTS(0, len);
+		dst += data->copy_transl(dst, src + runstart, len, sf, df);
+		runstart += len;
+		run -= len;
+	    }
+	    if(!blankline)
+		lastline = dst;
+	} while(x < w);
+
+	src += surface->pitch >> 2;
+    }
+    b->end = dst;
+    b->lastline = lastline;
+}
+
 /* convert surface to be quickly alpha-blittable onto dest, if possible */
 static int RLEAlphaSurface(SDL_Surface *surface)
 {
     SDL_Surface *dest;
     SDL_PixelFormat *df;
     int maxsize = 0;
-    int max_opaque_run;
-    int max_transl_run = 65535;
+    int linesize;
     unsigned masksum;
     Uint8 *rlebuf, *dst;
-    int (*copy_opaque)(void *, Uint32 *, int,
-		       SDL_PixelFormat *, SDL_PixelFormat *);
-    int (*copy_transl)(void *, Uint32 *, int,
-		       SDL_PixelFormat *, SDL_PixelFormat *);
+    RLEEncodeData data;
 
     dest = surface->map->dst;
     if(!dest)
@@ -1428,43 +1829,45 @@ static int RLEAlphaSurface(SDL_Surface *surface)
 	case 0xffff:
 	    if(df->Gmask == 0x07e0
 	       || df->Rmask == 0x07e0 || df->Bmask == 0x07e0) {
-		copy_opaque = copy_opaque_16;
-		copy_transl = copy_transl_565;
+		data.copy_opaque = copy_opaque_16;
+		data.copy_transl = copy_transl_565;
 	    } else
 		return -1;
 	    break;
 	case 0x7fff:
 	    if(df->Gmask == 0x03e0
 	       || df->Rmask == 0x03e0 || df->Bmask == 0x03e0) {
-		copy_opaque = copy_opaque_16;
-		copy_transl = copy_transl_555;
+		data.copy_opaque = copy_opaque_16;
+		data.copy_transl = copy_transl_555;
 	    } else
 		return -1;
 	    break;
 	default:
 	    return -1;
 	}
-	max_opaque_run = 255;	/* runs stored as bytes */
+	data.max_opaque_run = 255;	/* runs stored as bytes */
 
 	/* worst case is alternating opaque and translucent pixels,
 	   with room for alignment padding between lines */
-	maxsize = surface->h * (2 + (4 + 2) * (surface->w + 1)) + 2;
+	linesize = RLE_LINESIZE(2 + (4 + 2) * (surface->w + 1));
+	maxsize = surface->h * linesize + 2;
 	break;
     case 4:
 	if(masksum != 0x00ffffff)
 	    return -1;		/* requires unused high byte */
-	copy_opaque = copy_32;
-	copy_transl = copy_32;
-	max_opaque_run = 255;	/* runs stored as short ints */
+	data.copy_opaque = copy_32;
+	data.copy_transl = copy_32;
+	data.max_opaque_run = 255;	/* runs stored as short ints */
 
 	/* worst case is alternating opaque and translucent pixels */
-	maxsize = surface->h * 2 * 4 * (surface->w + 1) + 4;
+	linesize = RLE_LINESIZE(2 * 4 * (surface->w + 1));
+	maxsize = surface->h * linesize + 4;
 	break;
     default:
 	return -1;		/* anything else unsupported right now */
     }
 
-    maxsize += sizeof(RLEDestFormat);
+    maxsize += sizeof(RLEDestFormat) + surface->h * sizeof(Uint32);
     rlebuf = (Uint8 *)SDL_malloc(maxsize);
     if(!rlebuf) {
 	SDL_OutOfMemory();
@@ -1486,117 +1889,27 @@ static int RLEAlphaSurface(SDL_Surface *surface)
 	r->Bmask = df->Bmask;
 	r->Amask = df->Amask;
     }
-    dst = rlebuf + sizeof(RLEDestFormat);
 
     /* Do the actual encoding */
-    {
-	int x, y;
-	int h = surface->h, w = surface->w;
-	SDL_PixelFormat *sf = surface->format;
-	Uint32 *src = (Uint32 *)surface->pixels;
-	Uint8 *lastline = dst;	/* end of last non-blank line */
-
-	/* opaque counts are 8 or 16 bits, depending on target depth */
-#define ADD_OPAQUE_COUNTS(n, m)			\
-	if(df->BytesPerPixel == 4) {		\
-	    ((Uint16 *)dst)[0] = n;		\
-	    ((Uint16 *)dst)[1] = m;		\
-	    dst += 4;				\
-	} else {				\
-	    dst[0] = n;				\
-	    dst[1] = m;				\
-	    dst += 2;				\
-	}
-
-	/* translucent counts are always 16 bit */
-#define ADD_TRANSL_COUNTS(n, m)		\
-	(((Uint16 *)dst)[0] = n, ((Uint16 *)dst)[1] = m, dst += 4)
-
-	for(y = 0; y < h; y++) {
-	    int runstart, skipstart;
-	    int blankline = 0;
-	    /* First encode all opaque pixels of a scan line */
-	    x = 0;
-	    do {
-		int run, skip, len;
-		skipstart = x;
-		while(x < w && !ISOPAQUE(src[x], sf))
-		    x++;
-		runstart = x;
-		while(x < w && ISOPAQUE(src[x], sf))
-		    x++;
-		skip = runstart - skipstart;
-		if(skip == w)
-		    blankline = 1;
-		run = x - runstart;
-		while(skip > max_opaque_run) {
-		    ADD_OPAQUE_COUNTS(max_opaque_run, 0);
-		    skip -= max_opaque_run;
-		}
-		len = MIN(run, max_opaque_run);
-		ADD_OPAQUE_COUNTS(skip, len);
-		dst += copy_opaque(dst, src + runstart, len, sf, df);
-		runstart += len;
-		run -= len;
-		while(run) {
-		    len = MIN(run, max_opaque_run);
-		    ADD_OPAQUE_COUNTS(0, len);
-		    dst += copy_opaque(dst, src + runstart, len, sf, df);
-		    runstart += len;
-		    run -= len;
-		}
-	    } while(x < w);
-
-	    /* Make sure the next output address is 32-bit aligned */
-	    dst += (uintptr_t)dst & 2;
-
-	    /* Next, encode all translucent pixels of the same scan line */
-	    x = 0;
-	    do {
-		int run, skip, len;
-		skipstart = x;
-		while(x < w && !ISTRANSL(src[x], sf))
-		    x++;
-		runstart = x;
-		while(x < w && ISTRANSL(src[x], sf))
-		    x++;
-		skip = runstart - skipstart;
-		blankline &= (skip == w);
-		run = x - runstart;
-		while(skip > max_transl_run) {
-		    ADD_TRANSL_COUNTS(max_transl_run, 0);
-		    skip -= max_transl_run;
-		}
-		len = MIN(run, max_transl_run);
-		ADD_TRANSL_COUNTS(skip, len);
-		dst += copy_transl(dst, src + runstart, len, sf, df);
-		runstart += len;
-		run -= len;
-		while(run) {
-		    len = MIN(run, max_transl_run);
-		    ADD_TRANSL_COUNTS(0, len);
-		    dst += copy_transl(dst, src + runstart, len, sf, df);
-		    runstart += len;
-		    run -= len;
-		}
-		if(!blankline)
-		    lastline = dst;
-	    } while(x < w);
-
-	    src += surface->pitch >> 2;
-	}
-	dst = lastline;		/* back up past trailing blank lines */
-	ADD_OPAQUE_COUNTS(0, 0);
-    }
-
-#undef ADD_OPAQUE_COUNTS
-#undef ADD_TRANSL_COUNTS
+    data.surface = surface;
+    data.df = df;
+    data.index = (Uint32 *)(rlebuf + sizeof(RLEDestFormat));
+    data.buf = (Uint8 *)(data.index + surface->h);
+    data.linesize = linesize;
+    data.scan.sf = surface->format;
+    data.scan.bpp = 4;
+    data.scan.mask = surface->format->Amask;
+    data.scan.key = surface->format->Amask;
+    data.scan.simd = SDL_HasSSE2()
+	&& (surface->format->Amask >> surface->format->Ashift) == 0xff;
+    /* Encode, leaving out any trailing blank lines */
+    dst = RLEEncodeLines(&data, RLEAlphaBand);
+    ADD_OPAQUE_COUNTS(0, 0);
 
     /* Now that we have it encoded, release the original pixels */
     if((surface->flags & SDL_PREALLOC) != SDL_PREALLOC
        && (surface->flags & SDL_HWSURFACE) != SDL_HWSURFACE) {
-	SDL_free( surface->pixels );
-	surface->pixels = NULL;
+	SDL_FreePixels(surface);
     }
 
     /* realloc the buffer to release unused memory */
@@ -1610,84 +1923,8 @@ static int RLEAlphaSurface(SDL_Surface *surface)
     return 0;
 }
 
-static Uint32 getpix_8(Uint8 *srcbuf)
-{
-    return *srcbuf;
-}
-
-static Uint32 getpix_16(Uint8 *srcbuf)
-{
-    return *(Uint16 *)srcbuf;
-}
-
-static Uint32 getpix_24(Uint8 *srcbuf)
-{
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-    return srcbuf[0] + (srcbuf[1] << 8) + (srcbuf[2] << 16);
-#else
-    return (srcbuf[0] << 16) + (srcbuf[1] << 8) + srcbuf[2];
-#endif
-}
-
-static Uint32 getpix_32(Uint8 *srcbuf)
-{
-    return *(Uint32 *)srcbuf;
-}
-
-typedef Uint32 (*getpix_func)(Uint8 *);
-
-static getpix_func getpixes[4] = {
-    getpix_8, getpix_16, getpix_24, getpix_32
-};
-
-static int RLEColorkeySurface(SDL_Surface *surface)
-{
-        Uint8 *rlebuf, *dst;
-	int maxn;
-	int y;
-	Uint8 *srcbuf, *lastline;
-	int maxsize = 0;
-	int bpp = surface->format->BytesPerPixel;
-	getpix_func getpix;
-	Uint32 ckey, rgbmask;
-	int w, h;
-
-	/* calculate the worst case size for the compressed surface */
-	switch(bpp) {
-	case 1:
-	    /* worst case is alternating opaque and transparent pixels,
-	       starting with an opaque pixel */
-	    maxsize = surface->h * 3 * (surface->w / 2 + 1) + 2;
-	    break;
-	case 2:
-	case 3:
-	    /* worst case is solid runs, at most 255 pixels wide */
-	    maxsize = surface->h * (2 * (surface->w / 255 + 1)
-				    + surface->w * bpp) + 2;
-	    break;
-	case 4:
-	    /* worst case is solid runs, at most 65535 pixels wide */
-	    maxsize = surface->h * (4 * (surface->w / 65535 + 1)
-				    + surface->w * 4) + 4;
-	    break;
-	}
-
-	rlebuf = (Uint8 *)SDL_malloc(maxsize);
-	if ( rlebuf == NULL ) {
-		SDL_OutOfMemory();
-		return(-1);
-	}
-
-	/* Set up the conversion */
-	srcbuf = (Uint8 *)surface->pixels;
-	maxn = bpp == 4 ? 65535 : 255;
-	dst = rlebuf;
-	rgbmask = ~surface->format->Amask;
-	ckey = surface->format->colorkey & rgbmask;
-	lastline = dst;
-	getpix = getpixes[bpp - 1];
-	w = surface->w;
-	h = surface->h;
+#undef ADD_OPAQUE_COUNTS
+#undef ADD_TRANSL_COUNTS
 
 #define ADD_COUNTS(n, m)			\
 	if(bpp == 4) {				\
@@ -1700,20 +1937,37 @@ static int RLEColorkeySurface(SDL_Surface *surface)
 	    dst += 2;				\
 	}
 
-	for(y = 0; y < h; y++) {
+static void RLEColorkeyBand(void *arg, int band, int nbands)
+{
+	RLEEncodeData *data = (RLEEncodeData *)arg;
+	RLEBand *b = &data->bands[band];
+	SDL_Surface *surface = data->surface;
+	int bpp = surface->format->BytesPerPixel;
+	int maxn = bpp == 4 ? 65535 : 255;
+	int w = surface->w;
+	int y;
+	int y0 = surface->h * band / nbands;
+	int y1 = surface->h * (band + 1) / nbands;
+	Uint8 *srcbuf = (Uint8 *)surface->pixels + y0 * surface->pitch;
+	Uint8 *dst = data->buf + y0 * data->linesize;
+	Uint8 *lastline = NULL;
+
+	b->y0 = y0;
+	b->y1 = y1;
+	b->start = dst;
+	for(y = y0; y < y1; y++) {
 	    int x = 0;
 	    int blankline = 0;
+	    data->index[y] = (Uint32)(dst - b->start);
 	    do {
 		int run, skip, len;
 		int runstart;
 		int skipstart = x;
 
 		/* find run of transparent, then opaque pixels */
-		while(x < w && (getpix(srcbuf + x * bpp) & rgbmask) == ckey)
-		    x++;
+		x = ScanKeyRun(&data->scan, srcbuf, x, w, 1);
 		runstart = x;
-		while(x < w && (getpix(srcbuf + x * bpp) & rgbmask) != ckey)
-		    x++;
+		x = ScanKeyRun(&data->scan, srcbuf, x, w, 0);
 		skip = runstart - skipstart;
 		if(skip == w)
 		    blankline = 1;
@@ -1744,16 +1998,72 @@ static int RLEColorkeySurface(SDL_Surface *surface)
 
 	    srcbuf += surface->pitch;
 	}
-	dst = lastline;		/* back up bast trailing blank lines */
-	ADD_COUNTS(0, 0);
+	b->end = dst;
+	b->lastline = lastline;
+}
 
-#undef ADD_COUNTS
+static int RLEColorkeySurface(SDL_Surface *surface)
+{
+        Uint8 *rlebuf, *dst;
+	int maxsize = 0;
+	int linesize = 0;
+	int bpp = surface->format->BytesPerPixel;
+	Uint32 rgbmask, ckey;
+	RLEEncodeData data;
+
+	/* calculate the worst case size for the compressed surface */
+	switch(bpp) {
+	case 1:
+	    /* worst case is alternating opaque and transparent pixels,
+	       starting with an opaque pixel */
+	    linesize = RLE_LINESIZE(3 * (surface->w / 2 + 1));
+	    maxsize = surface->h * linesize + 2;
+	    break;
+	case 2:
+	case 3:
+	    /* worst case is solid runs, at most 255 pixels wide */
+	    linesize = RLE_LINESIZE(2 * (surface->w / 255 + 1)
+				    + surface->w * bpp);
+	    maxsize = surface->h * linesize + 2;
+	    break;
+	case 4:
+	    /* worst case is solid runs, at most 65535 pixels wide */
+	    linesize = RLE_LINESIZE(4 * (surface->w / 65535 + 1)
+				    + surface->w * 4);
+	    maxsize = surface->h * linesize + 4;
+	    break;
+	}
+
+	maxsize += surface->h * sizeof(Uint32);
+	rlebuf = (Uint8 *)SDL_malloc(maxsize);
+	if ( rlebuf == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+
+	/* Set up the conversion */
+	rgbmask = ~surface->format->Amask;
+	ckey = surface->format->colorkey & rgbmask;
+	data.surface = surface;
+	data.index = (Uint32 *)rlebuf;
+	data.buf = (Uint8 *)(data.index + surface->h);
+	data.linesize = linesize;
+	data.scan.sf = surface->format;
+	data.scan.bpp = bpp;
+	data.scan.mask = rgbmask;
+	data.scan.key = ckey;
+	/* keys wider than the pixels never match, leave those to getpix */
+	data.scan.simd = SDL_HasSSE2() && bpp != 3
+	    && (bpp == 4 || (ckey >> (bpp * 8)) == 0);
+
+	/* Encode, leaving out any trailing blank lines */
+	dst = RLEEncodeLines(&data, RLEColorkeyBand);
+	ADD_COUNTS(0, 0);
 
 	/* Now that we have it encoded, release the original pixels */
 	if((surface->flags & SDL_PREALLOC) != SDL_PREALLOC
 	   && (surface->flags & SDL_HWSURFACE) != SDL_HWSURFACE) {
-	    SDL_free( surface->pixels );
-	    surface->pixels = NULL;
+	    SDL_FreePixels(surface);
 	}
 
 	/* realloc the buffer to release unused memory */
@@ -1768,6 +2078,8 @@ static int RLEColorkeySurface(SDL_Surface *surface)
 	return(0);
 }
 
+#undef ADD_COUNTS
+
 int SDL_RLESurface(SDL_Surface *surface)
 {
 	int retcode;
@@ -1840,7 +2152,7 @@ static SDL_bool UnRLEAlpha(SDL_Surface *surface)
 	uncopy_opaque = uncopy_transl = uncopy_32;
     }
 
-    surface->pixels = SDL_malloc(surface->h * surface->pitch);
+    surface->pixels = SDL_AllocPixels(surface);
     if ( !surface->pixels ) {
         return(SDL_FALSE);
     }
@@ -1848,7 +2160,7 @@ static SDL_bool UnRLEAlpha(SDL_Surface *surface)
     SDL_memset(surface->pixels, 0, surface->h * surface->pitch);
 
     dst = surface->pixels;
-    srcbuf = (Uint8 *)(df + 1);
+    srcbuf = (Uint8 *)(df + 1) + surface->h * sizeof(Uint32);
     for(;;) {
 	/* copy opaque pixels */
 	int ofs = 0;
@@ -1904,7 +2216,7 @@ void SDL_UnRLESurface(SDL_Surface *surface, int recode)
 		unsigned alpha_flag;
 
 		/* re-create the original surface */
-		surface->pixels = SDL_malloc(surface->h * surface->pitch);
+		surface->pixels = SDL_AllocPixels(surface);
 		if ( !surface->pixels ) {
 			/* Oh crap... */
 			surface->flags |= SDL_RLEACCEL;
@@ -39,8 +39,270 @@
 #include "mmx.h"
 #endif
 
+#if !SDL_THREADS_DISABLED
+#include "SDL_thread.h"
+#endif
+
+/* Large software blits and fills can be split into horizontal bands
+   and shared with a pool of worker threads.  This is off by default
+   and enabled by setting SDL_BLIT_THREADS to the number of threads to
+   use, including the calling thread.
+ */
+#define BLIT_MAX_THREADS	16
+#define BLIT_BAND_MIN_ROWS	32
+#define BLIT_BAND_MIN_PIXELS	(64*1024)
+
+#if !SDL_THREADS_DISABLED
+static struct {
+	int nthreads;
+	SDL_Thread *threads[BLIT_MAX_THREADS];
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	SDL_cond *done;
+	SDL_BandFunc func;
+	void *data;
+	int nbands;
+	int next_band;
+	int bands_left;
+	int busy;
+	int quit;
+} blit_pool;
+
+static int SDLCALL SDL_BlitWorker(void *unused)
+{
+	SDL_BandFunc func;
+	void *data;
+	int band, nbands;
+
+	SDL_mutexP(blit_pool.lock);
+	for ( ; ; ) {
+		while ( !blit_pool.quit &&
+		        blit_pool.next_band >= blit_pool.nbands ) {
+			SDL_CondWait(blit_pool.wake, blit_pool.lock);
+		}
+		if ( blit_pool.quit ) {
+			break;
+		}
+		func = blit_pool.func;
+		data = blit_pool.data;
+		nbands = blit_pool.nbands;
+		band = blit_pool.next_band++;
+		SDL_mutexV(blit_pool.lock);
+
+		func(data, band, nbands);
+
+		SDL_mutexP(blit_pool.lock);
+		if ( --blit_pool.bands_left == 0 ) {
+			SDL_CondSignal(blit_pool.done);
+		}
+	}
+	SDL_mutexV(blit_pool.lock);
+	return(0);
+}
+#endif /* !SDL_THREADS_DISABLED */
+
+int SDL_InitBlitThreads(void)
+{
+#if !SDL_THREADS_DISABLED
+	const char *env;
+	int i, n;
+
+	if ( blit_pool.lock ) {
+		return(0);
+	}
+	env = SDL_getenv("SDL_BLIT_THREADS");
+	n = env ? SDL_atoi(env) : 0;
+	if ( n <= 1 ) {
+		return(0);
+	}
+	if ( n > BLIT_MAX_THREADS + 1 ) {
+		n = BLIT_MAX_THREADS + 1;
+	}
+
+	blit_pool.lock = SDL_CreateMutex();
+	blit_pool.wake = SDL_CreateCond();
+	blit_pool.done = SDL_CreateCond();
+	if ( !blit_pool.lock || !blit_pool.wake || !blit_pool.done ) {
+		SDL_QuitBlitThreads();
+		return(-1);
+	}
+	for ( i = 0; i < n - 1; ++i ) {
+		blit_pool.threads[i] = SDL_CreateThread(SDL_BlitWorker, NULL);
+		if ( blit_pool.threads[i] == NULL ) {
+			break;
+		}
+		++blit_pool.nthreads;
+	}
+	if ( blit_pool.nthreads == 0 ) {
+		SDL_QuitBlitThreads();
+		return(-1);
+	}
+#endif
+	return(0);
+}
+
+void SDL_QuitBlitThreads(void)
+{
+#if !SDL_THREADS_DISABLED
+	int i;
+
+	if ( blit_pool.lock ) {
+		SDL_mutexP(blit_pool.lock);
+		blit_pool.quit = 1;
+		SDL_CondBroadcast(blit_pool.wake);
+		SDL_mutexV(blit_pool.lock);
+	}
+	for ( i = 0; i < blit_pool.nthreads; ++i ) {
+		SDL_WaitThread(blit_pool.threads[i], NULL);
+	}
+	if ( blit_pool.done ) {
+		SDL_DestroyCond(blit_pool.done);
+	}
+	if ( blit_pool.wake ) {
+		SDL_DestroyCond(blit_pool.wake);
+	}
+	if ( blit_pool.lock ) {
+		SDL_DestroyMutex(blit_pool.lock);
+	}
+	SDL_memset(&blit_pool, 0, sizeof(blit_pool));
+#endif
+}
+
+/* Return how many bands a w x h operation should be split into */
+int SDL_GetBlitBands(int w, int h)
+{
+#if !SDL_THREADS_DISABLED
+	int bands;
+
+	if ( blit_pool.nthreads == 0 || w <= 0 || h <= 0 ) {
+		return(1);
+	}
+	bands = blit_pool.nthreads + 1;
+	if ( bands > h / BLIT_BAND_MIN_ROWS ) {
+		bands = h / BLIT_BAND_MIN_ROWS;
+	}
+	if ( (Uint32)bands > ((Uint32)w * h) / BLIT_BAND_MIN_PIXELS ) {
+		bands = ((Uint32)w * h) / BLIT_BAND_MIN_PIXELS;
+	}
+	if ( bands > 1 ) {
+		return(bands);
+	}
+#endif
+	return(1);
+}
+
+/* Run func() once for every band, sharing the work with the pool.
+   The calling thread takes bands too, and only returns once all of
+   them are done.  If the pool is already in use, the bands are run
+   here in sequence.
+ */
+void SDL_RunBlitBands(SDL_BandFunc func, void *data, int nbands)
+{
+	int band;
+
+#if !SDL_THREADS_DISABLED
+	if ( nbands > 1 && blit_pool.nthreads > 0 ) {
+		SDL_mutexP(blit_pool.lock);
+		if ( !blit_pool.busy ) {
+			blit_pool.busy = 1;
+			blit_pool.func = func;
+			blit_pool.data = data;
+			blit_pool.nbands = nbands;
+			blit_pool.next_band = 0;
+			blit_pool.bands_left = nbands;
+			SDL_CondBroadcast(blit_pool.wake);
+			while ( blit_pool.next_band < blit_pool.nbands ) {
+				band = blit_pool.next_band++;
+				SDL_mutexV(blit_pool.lock);
+				func(data, band, nbands);
+				SDL_mutexP(blit_pool.lock);
+				--blit_pool.bands_left;
+			}
+			while ( blit_pool.bands_left > 0 ) {
+				SDL_CondWait(blit_pool.done, blit_pool.lock);
+			}
+			blit_pool.nbands = 0;
+			blit_pool.next_band = 0;
+			blit_pool.busy = 0;
+			SDL_mutexV(blit_pool.lock);
+			return;
+		}
+		SDL_mutexV(blit_pool.lock);
+	}
+#endif
+	for ( band = 0; band < nbands; ++band ) {
+		func(data, band, nbands);
+	}
+}
+
+/* One horizontal band of a software blit */
+typedef struct {
+	SDL_BlitInfo info;
+	SDL_loblit blit;
+	int s_pitch;
+	int d_pitch;
+} SDL_BlitBandData;
+
+static void SDL_BlitBand(void *data, int band, int nbands)
+{
+	SDL_BlitBandData *bands = (SDL_BlitBandData *)data;
+	SDL_BlitInfo info = bands->info;
+	int y, h;
+
+	y = (info.d_height * band) / nbands;
+	h = (info.d_height * (band + 1)) / nbands - y;
+	info.s_pixels += y * bands->s_pitch;
+	info.d_pixels += y * bands->d_pitch;
+	info.s_height = h;
+	info.d_height = h;
+	bands->blit(&info);
+}
+
+/* Software blit of one clipped rectangle, the surfaces are locked */
+void SDL_SoftBlitRect(SDL_Surface *src, SDL_Rect *srcrect,
+                      SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	SDL_BlitInfo info;
+	SDL_loblit RunBlit;
+	int bands;
+
+	/* Set up the blit information */
+	info.s_pixels = (Uint8 *)src->pixels +
+			(Uint16)srcrect->y*src->pitch +
+			(Uint16)srcrect->x*src->format->BytesPerPixel;
+	info.s_width = srcrect->w;
+	info.s_height = srcrect->h;
+	info.s_skip=src->pitch-info.s_width*src->format->BytesPerPixel;
+	info.d_pixels = (Uint8 *)dst->pixels +
+			(Uint16)dstrect->y*dst->pitch +
+			(Uint16)dstrect->x*dst->format->BytesPerPixel;
+	info.d_width = dstrect->w;
+	info.d_height = dstrect->h;
+	info.d_skip=dst->pitch-info.d_width*dst->format->BytesPerPixel;
+	info.aux_data = src->map->sw_data->aux_data;
+	info.src = src->format;
+	info.table = src->map->table;
+	info.dst = dst->format;
+	info.colormod = &src->map->colormod;
+	RunBlit = src->map->sw_data->blit;
+
+	/* Run the actual software blit */
+	bands = (src != dst) ? SDL_GetBlitBands(info.d_width, info.d_height) : 1;
+	if ( bands > 1 ) {
+		SDL_BlitBandData data;
+
+		data.info = info;
+		data.blit = RunBlit;
+		data.s_pitch = src->pitch;
+		data.d_pitch = dst->pitch;
+		SDL_RunBlitBands(SDL_BlitBand, &data, bands);
+	} else {
+		RunBlit(&info);
+	}
+}
+
 /* The general purpose software blit routine */
-static int SDL_SoftBlit(SDL_Surface *src, SDL_Rect *srcrect,
+int SDL_SoftBlit(SDL_Surface *src, SDL_Rect *srcrect,
 			SDL_Surface *dst, SDL_Rect *dstrect)
 {
 	int okay;
@@ -71,30 +333,7 @@ static int SDL_SoftBlit(SDL_Surface *src, SDL_Rect *srcrect,
 
 	/* Set up source and destination buffer pointers, and BLIT! */
 	if ( okay  && srcrect->w && srcrect->h ) {
-		SDL_BlitInfo info;
-		SDL_loblit RunBlit;
-
-		/* Set up the blit information */
-		info.s_pixels = (Uint8 *)src->pixels +
-				(Uint16)srcrect->y*src->pitch +
-				(Uint16)srcrect->x*src->format->BytesPerPixel;
-		info.s_width = srcrect->w;
-		info.s_height = srcrect->h;
-		info.s_skip=src->pitch-info.s_width*src->format->BytesPerPixel;
-		info.d_pixels = (Uint8 *)dst->pixels +
-				(Uint16)dstrect->y*dst->pitch +
-				(Uint16)dstrect->x*dst->format->BytesPerPixel;
-		info.d_width = dstrect->w;
-		info.d_height = dstrect->h;
-		info.d_skip=dst->pitch-info.d_width*dst->format->BytesPerPixel;
-		info.aux_data = src->map->sw_data->aux_data;
-		info.src = src->format;
-		info.table = src->map->table;
-		info.dst = dst->format;
-		RunBlit = src->map->sw_data->blit;
-
-		/* Run the actual software blit */
-		RunBlit(&info);
+		SDL_SoftBlitRect(src, srcrect, dst, dstrect);
 	}
 
 	/* We need to unlock the surfaces if they're locked */
@@ -236,6 +475,30 @@ static void SDL_BlitCopyOverlap(SDL_BlitInfo *info)
 	}
 }
 
+/* Let a (slower) blitter finish the columns a vectorized blitter left
+   over on the right hand side of every row.
+ */
+void SDL_BlitTrailingColumns(SDL_BlitInfo *info, int columns_done,
+                             SDL_loblit blit)
+{
+	SDL_BlitInfo rest;
+	int srcbytes, dstbytes;
+
+	if ( columns_done >= info->d_width || info->d_height <= 0 ) {
+		return;
+	}
+	srcbytes = columns_done * info->src->BytesPerPixel;
+	dstbytes = columns_done * info->dst->BytesPerPixel;
+	rest = *info;
+	rest.s_pixels += srcbytes;
+	rest.s_width -= columns_done;
+	rest.s_skip += srcbytes;
+	rest.d_pixels += dstbytes;
+	rest.d_width -= columns_done;
+	rest.d_skip += dstbytes;
+	blit(&rest);
+}
+
 /* Figure out which of many blit routines to set up on a surface */
 int SDL_CalculateBlit(SDL_Surface *surface)
 {
@@ -249,7 +512,8 @@ int SDL_CalculateBlit(SDL_Surface *surface)
 
 	/* Figure out if an accelerated hardware blit is possible */
 	surface->flags &= ~SDL_HWACCEL;
-	if ( surface->map->identity ) {
+	if ( surface->map->identity &&
+	     !(surface->flags & SDL_SRCCOLORMOD) ) {
 		int hw_blit_ok;
 
 		if ( (surface->flags & SDL_HWSURFACE) == SDL_HWSURFACE ) {
@@ -279,6 +543,11 @@ int SDL_CalculateBlit(SDL_Surface *surface)
 				hw_blit_ok = current_video->info.blit_sw_A;
 			}
 		}
+		/* Hardware alpha blits expect straight alpha */
+		if ( (surface->flags & (SDL_SRCALPHA|SDL_SRCALPHA_PREMUL)) ==
+		     (SDL_SRCALPHA|SDL_SRCALPHA_PREMUL) ) {
+			hw_blit_ok = 0;
+		}
 		if ( hw_blit_ok ) {
 			SDL_VideoDevice *video = current_video;
 			SDL_VideoDevice *this  = current_video;
@@ -287,7 +556,8 @@ int SDL_CalculateBlit(SDL_Surface *surface)
 	}
 	
 	/* if an alpha pixel format is specified, we can accelerate alpha blits */
-	if (((surface->flags & SDL_HWSURFACE) == SDL_HWSURFACE )&&(current_video->displayformatalphapixel)) 
+	if (((surface->flags & SDL_HWSURFACE) == SDL_HWSURFACE )&&(current_video->displayformatalphapixel)
+	    && !(surface->flags & (SDL_SRCCOLORMOD|SDL_SRCALPHA_PREMUL)))
 	{
 		if ( (surface->flags & SDL_SRCALPHA) ) 
 			if ( current_video->info.blit_hw_A ) {
@@ -308,7 +578,8 @@ int SDL_CalculateBlit(SDL_Surface *surface)
 	}
 
 	/* Check for special "identity" case -- copy blit */
-	if ( surface->map->identity && blit_index == 0 ) {
+	if ( surface->map->identity && blit_index == 0 &&
+	     !(surface->flags & SDL_SRCCOLORMOD) ) {
 	        surface->map->sw_data->blit = SDL_BlitCopy;
 
 		/* Handle overlapping blits on the same surface */
@@ -346,14 +617,16 @@ int SDL_CalculateBlit(SDL_Surface *surface)
 
 	/* Choose software blitting function */
 	if(surface->flags & SDL_RLEACCELOK
-	   && (surface->flags & SDL_HWACCEL) != SDL_HWACCEL) {
+	   && (surface->flags & SDL_HWACCEL) != SDL_HWACCEL
+	   && !(surface->flags & SDL_SRCCOLORMOD)) {
 
 	        if(surface->map->identity
 		   && (blit_index == 1
 		       || (blit_index == 3 && !surface->format->Amask))) {
 		        if ( SDL_RLESurface(surface) == 0 )
 			        surface->map->sw_blit = SDL_RLEBlit;
-		} else if(blit_index == 2 && surface->format->Amask) {
+		} else if(blit_index == 2 && surface->format->Amask
+			  && !(surface->flags & SDL_SRCALPHA_PREMUL)) {
 		        if ( SDL_RLESurface(surface) == 0 )
 			        surface->map->sw_blit = SDL_RLEAlphaBlit;
 		}
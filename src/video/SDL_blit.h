@@ -28,6 +28,19 @@
 
 extern SDL_bool SDL_HasARMSIMD(void);		/* whether CPU has ARM SIMD (ARMv6) features */
 extern SDL_bool SDL_HasNEON (void);		/* whether CPU has ARM NEON features.        */
+extern SDL_bool SDL_HasSSSE3(void);		/* whether CPU has SSSE3 (pshufb) features   */
+extern SDL_bool SDL_HasAVX2(void);		/* whether CPU and OS support AVX2 features  */
+
+/* x86 SIMD blitters written with compiler intrinsics.  Each routine is
+   compiled for its instruction set through a target attribute, so the
+   rest of the library keeps the baseline CPU, and is only chosen when
+   the CPU reports the feature at runtime.
+ */
+#if SDL_ASSEMBLY_ROUTINES && (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SDL_SSE2_INTRINSICS	1
+#define SDL_TARGETING(x)	__attribute__((target(x)))
+#endif
 
 /* The structure passed to the low level blit functions */
 typedef struct {
@@ -43,6 +56,7 @@ typedef struct {
 	SDL_PixelFormat *src;
 	Uint8 *table;
 	SDL_PixelFormat *dst;
+	const SDL_Color *colormod;	/* for surfaces with SDL_SRCCOLORMOD */
 } SDL_BlitInfo;
 
 /* The type definition for the low level blit functions */
@@ -54,11 +68,26 @@ struct private_swaccel {
 	void *aux_data;
 };
 
+/* A software mapping to a recently used destination, which is kept
+   so that blitting to that destination again is just a lookup */
+#define SDL_BLITMAP_CACHE_SIZE	4
+
+typedef struct SDL_BlitMapEntry {
+	SDL_Surface *dst;
+	unsigned int format_version;
+	int identity;
+	Uint8 *table;
+	SDL_PixelFormat table_format;	/* copy of the dst format, no palette */
+	SDL_loblit blit;
+	void *aux_data;
+} SDL_BlitMapEntry;
+
 /* Blit mapping definition */
 typedef struct SDL_BlitMap {
 	SDL_Surface *dst;
 	int identity;
 	Uint8 *table;
+	SDL_PixelFormat table_format;	/* copy of the dst format, no palette */
 	SDL_blit hw_blit;
 	SDL_blit sw_blit;
 	struct private_hwaccel *hw_data;
@@ -67,11 +96,30 @@ typedef struct SDL_BlitMap {
 	/* the version count matches the destination; mismatch indicates
 	   an invalid mapping */
         unsigned int format_version;
+
+	/* color modulation, see SDL_SetColorMod() */
+	SDL_Color colormod;
+
+	/* previous destinations, most recently used first */
+	SDL_BlitMapEntry cache[SDL_BLITMAP_CACHE_SIZE];
 } SDL_BlitMap;
 
 
 /* Functions found in SDL_blit.c */
 extern int SDL_CalculateBlit(SDL_Surface *surface);
+extern int SDL_SoftBlit(SDL_Surface *src, SDL_Rect *srcrect,
+                        SDL_Surface *dst, SDL_Rect *dstrect);
+extern void SDL_SoftBlitRect(SDL_Surface *src, SDL_Rect *srcrect,
+                             SDL_Surface *dst, SDL_Rect *dstrect);
+extern void SDL_BlitTrailingColumns(SDL_BlitInfo *info, int columns_done,
+                                    SDL_loblit blit);
+
+/* Banded (multithreaded) execution of large software blits and fills */
+typedef void (*SDL_BandFunc)(void *data, int band, int nbands);
+extern int SDL_InitBlitThreads(void);
+extern void SDL_QuitBlitThreads(void);
+extern int SDL_GetBlitBands(int w, int h);
+extern void SDL_RunBlitBands(SDL_BandFunc func, void *data, int nbands);
 
 /* Functions found in SDL_blit_{0,1,N,A}.c */
 extern SDL_loblit SDL_CalculateBlit0(SDL_Surface *surface, int complex);
@@ -87,6 +135,11 @@ extern SDL_loblit SDL_CalculateAlphaBlit(SDL_Surface *surface, int complex);
     ((A)->BitsPerPixel == (B)->BitsPerPixel				\
      && ((A)->Rmask == (B)->Rmask) && ((A)->Amask == (B)->Amask))
 
+/* Index of an 8-bit R-G-B value in the 5-5-5 inverse colormap used as the
+   table of blits to palettized surfaces */
+#define INVMAP_INDEX(r, g, b)						\
+	((((r) & 0xF8) << 7) | (((g) & 0xF8) << 2) | ((b) >> 3))
+
 /* Load pixel of the specified format from a buffer and get its R-G-B values */
 /* FIXME: rescale values to 0..255 here? */
 #define RGB_FROM_PIXEL(Pixel, fmt, r, g, b)				\
@@ -392,6 +445,22 @@ do {						\
 	dB = (((sB-dB)*(A)+255)>>8)+dB;		\
 } while(0)
 
+/* x * y / 255 for 8-bit values, correctly rounded */
+#define MULDIV255(x, y)	((((x)*(y)+128) + (((x)*(y)+128)>>8)) >> 8)
+
+/* Blend a premultiplied source over a pixel: d = s + d * (1 - sA) */
+#define PREMUL_ALPHA_BLEND(sR, sG, sB, sA, dR, dG, dB, dA)	\
+do {								\
+	dR = sR + MULDIV255(dR, 255-(sA));			\
+	dG = sG + MULDIV255(dG, 255-(sA));			\
+	dB = sB + MULDIV255(dB, 255-(sA));			\
+	dA = sA + MULDIV255(dA, 255-(sA));			\
+	if(dR > 255) dR = 255;					\
+	if(dG > 255) dG = 255;					\
+	if(dB > 255) dB = 255;					\
+	if(dA > 255) dA = 255;					\
+} while(0)
+
 
 /* This is a very useful loop for optimizing blitters */
 #if defined(_MSC_VER) && (_MSC_VER == 1300)
@@ -25,6 +25,11 @@
 #include "SDL_blit.h"
 #include "SDL_sysvideo.h"
 #include "SDL_endian.h"
+#include "SDL_cpuinfo.h"
+
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
 
 /* Functions to blit from 8-bit surfaces to other surfaces */
 
@@ -483,6 +488,296 @@ static void Blit1toNAlphaKey(SDL_BlitInfo *info)
 	}
 }
 
+#if SDL_SSE2_INTRINSICS
+/* AVX2 expansion: eight indices are widened to 32 bits and the colors
+   are fetched from the map with a single gather.  The map always has a
+   spare entry at the end, so the 16-bit map can be read a dword at a
+   time.  Keyed blits skip groups of eight which are entirely
+   transparent and only read the destination for mixed groups.
+ */
+SDL_TARGETING("avx2")
+static __inline__ __m256i Lookup8(const Uint8 *src, const void *map, int scale_4)
+{
+	__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+	if ( scale_4 ) {
+		return _mm256_i32gather_epi32((const int *)map, idx, 4);
+	}
+	return _mm256_i32gather_epi32((const int *)map, idx, 2);
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to2AVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint16 *dst = (Uint16 *)info->d_pixels;
+	int dstskip = info->d_skip / 2;
+	Uint16 *map = (Uint16 *)info->table;
+	__m256i low = _mm256_set1_epi32(0xFFFF);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 16 ) {
+			__m256i c0 = _mm256_and_si256(Lookup8(src, map, 0), low);
+			__m256i c1 = _mm256_and_si256(Lookup8(src + 8, map, 0), low);
+			c0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(c0, c1), 0xD8);
+			_mm256_storeu_si256((__m256i *)dst, c0);
+			src += 16;
+			dst += 16;
+			n -= 16;
+		}
+		while ( n-- ) {
+			*dst++ = map[*src++];
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+/* Store eight packed 24-bit pixels, twelve bytes from each lane */
+SDL_TARGETING("avx2")
+static __inline__ void Store24(Uint8 *dst, __m256i c)
+{
+	__m128i hi = _mm256_extracti128_si256(c, 1);
+	_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(c));
+	_mm_storel_epi64((__m128i *)(dst + 12), hi);
+	*(Uint32 *)(dst + 20) = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to3AVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 *map = info->table;
+	/* Pack the first three bytes of each dword in both lanes */
+	__m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 8 ) {
+			__m256i c = _mm256_shuffle_epi8(Lookup8(src, map, 1), pack);
+			Store24(dst, c);
+			src += 8;
+			dst += 24;
+			n -= 8;
+		}
+		while ( n-- ) {
+			int o = *src++ * 4;
+			dst[0] = map[o];
+			dst[1] = map[o+1];
+			dst[2] = map[o+2];
+			dst += 3;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to4AVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint32 *dst = (Uint32 *)info->d_pixels;
+	int dstskip = info->d_skip / 4;
+	Uint32 *map = (Uint32 *)info->table;
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 16 ) {
+			__m256i c0 = Lookup8(src, map, 1);
+			__m256i c1 = Lookup8(src + 8, map, 1);
+			_mm256_storeu_si256((__m256i *)dst, c0);
+			_mm256_storeu_si256((__m256i *)(dst + 8), c1);
+			src += 16;
+			dst += 16;
+			n -= 16;
+		}
+		while ( n-- ) {
+			*dst++ = map[*src++];
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+/* Returns a mask of the keyed pixels among the next eight */
+SDL_TARGETING("avx2")
+static __inline__ __m256i Keyed8(const Uint8 *src, __m256i ckey, int *bits)
+{
+	__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+	__m256i keyed = _mm256_cmpeq_epi32(idx, ckey);
+	*bits = _mm256_movemask_ps(_mm256_castsi256_ps(keyed));
+	return keyed;
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to2KeyAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint16 *dst = (Uint16 *)info->d_pixels;
+	int dstskip = info->d_skip / 2;
+	Uint16 *map = (Uint16 *)info->table;
+	Uint32 ckey = info->src->colorkey;
+	__m256i ckeyv = _mm256_set1_epi32(ckey);
+	__m256i low = _mm256_set1_epi32(0xFFFF);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 16 ) {
+			int bits0, bits1;
+			__m256i k0 = Keyed8(src, ckeyv, &bits0);
+			__m256i k1 = Keyed8(src + 8, ckeyv, &bits1);
+			if ( (bits0 & bits1) != 0xFF ) {
+				__m256i c0 = _mm256_and_si256(Lookup8(src, map, 0), low);
+				__m256i c1 = _mm256_and_si256(Lookup8(src + 8, map, 0), low);
+				c0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(c0, c1), 0xD8);
+				if ( bits0 | bits1 ) {
+					__m256i k = _mm256_permute4x64_epi64(_mm256_packs_epi32(k0, k1), 0xD8);
+					__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+					c0 = _mm256_blendv_epi8(c0, d, k);
+				}
+				_mm256_storeu_si256((__m256i *)dst, c0);
+			}
+			src += 16;
+			dst += 16;
+			n -= 16;
+		}
+		while ( n-- ) {
+			if ( *src != ckey ) {
+				*dst = map[*src];
+			}
+			src++;
+			dst++;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to3KeyAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 *map = info->table;
+	Uint32 ckey = info->src->colorkey;
+	__m256i ckeyv = _mm256_set1_epi32(ckey);
+	__m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	while ( height-- ) {
+		int n = width;
+		/* Mixed groups read four bytes past their pixels */
+		while ( n >= 10 ) {
+			int bits;
+			__m256i keyed = Keyed8(src, ckeyv, &bits);
+			if ( bits != 0xFF ) {
+				__m256i c = _mm256_shuffle_epi8(Lookup8(src, map, 1), pack);
+				if ( bits ) {
+					__m256i d = _mm256_inserti128_si256(
+						_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)dst)),
+						_mm_loadu_si128((const __m128i *)(dst + 12)), 1);
+					keyed = _mm256_shuffle_epi8(keyed, pack);
+					c = _mm256_blendv_epi8(c, d, keyed);
+				}
+				Store24(dst, c);
+			}
+			src += 8;
+			dst += 24;
+			n -= 8;
+		}
+		while ( n-- ) {
+			if ( *src != ckey ) {
+				int o = *src * 4;
+				dst[0] = map[o];
+				dst[1] = map[o+1];
+				dst[2] = map[o+2];
+			}
+			src++;
+			dst += 3;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+SDL_TARGETING("avx2")
+static void Blit1to4KeyAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint32 *dst = (Uint32 *)info->d_pixels;
+	int dstskip = info->d_skip / 4;
+	Uint32 *map = (Uint32 *)info->table;
+	Uint32 ckey = info->src->colorkey;
+	__m256i ckeyv = _mm256_set1_epi32(ckey);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 8 ) {
+			int bits;
+			__m256i keyed = Keyed8(src, ckeyv, &bits);
+			if ( bits != 0xFF ) {
+				__m256i c = Lookup8(src, map, 1);
+				if ( bits ) {
+					__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+					c = _mm256_blendv_epi8(c, d, keyed);
+				}
+				_mm256_storeu_si256((__m256i *)dst, c);
+			}
+			src += 8;
+			dst += 8;
+			n -= 8;
+		}
+		while ( n-- ) {
+			if ( *src != ckey ) {
+				*dst = map[*src];
+			}
+			src++;
+			dst++;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+static SDL_loblit one_blit_avx2[] = {
+	NULL, NULL, Blit1to2AVX2, Blit1to3AVX2, Blit1to4AVX2
+};
+
+static SDL_loblit one_blitkey_avx2[] = {
+	NULL, NULL, Blit1to2KeyAVX2, Blit1to3KeyAVX2, Blit1to4KeyAVX2
+};
+#endif /* SDL_SSE2_INTRINSICS */
+
 static SDL_loblit one_blit[] = {
 	NULL, Blit1to1, Blit1to2, Blit1to3, Blit1to4
 };
@@ -502,6 +797,16 @@ SDL_loblit SDL_CalculateBlit1(SDL_Surface *surface, int blit_index)
 	} else {
 		which = dstfmt->BytesPerPixel;
 	}
+#if SDL_SSE2_INTRINSICS
+	if ( SDL_HasAVX2() ) {
+		if ( blit_index == 0 && one_blit_avx2[which] ) {
+			return one_blit_avx2[which];
+		}
+		if ( blit_index == 1 && one_blitkey_avx2[which] ) {
+			return one_blitkey_avx2[which];
+		}
+	}
+#endif
 	switch(blit_index) {
 	case 0:			/* copy */
 	    return one_blit[which];
@@ -59,6 +59,9 @@
 #include <mmintrin.h>
 #include <mm3dnow.h>
 #endif
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
 
 /* Functions to perform alpha blended blitting */
 
@@ -102,9 +105,7 @@ static void BlitNto1SurfaceAlpha(SDL_BlitInfo *info)
 			  ((dG>>5)<<(2))|
 			  ((dB>>6)<<(0));
 		} else {
-		    *dst = palmap[((dR>>5)<<(3+2))|
-				  ((dG>>5)<<(2))  |
-				  ((dB>>6)<<(0))];
+		    *dst = palmap[INVMAP_INDEX(dR, dG, dB)];
 		}
 		dst++;
 		src += srcbpp;
@@ -155,9 +156,55 @@ static void BlitNto1PixelAlpha(SDL_BlitInfo *info)
 			  ((dG>>5)<<(2))|
 			  ((dB>>6)<<(0));
 		} else {
-		    *dst = palmap[((dR>>5)<<(3+2))|
-				  ((dG>>5)<<(2))  |
-				  ((dB>>6)<<(0))  ];
+		    *dst = palmap[INVMAP_INDEX(dR, dG, dB)];
+		}
+		dst++;
+		src += srcbpp;
+	    },
+	    width);
+	    src += srcskip;
+	    dst += dstskip;
+	}
+}
+
+/* N->1 blending with premultiplied pixel alpha */
+static void BlitNto1PixelAlphaPremul(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 *palmap = info->table;
+	SDL_PixelFormat *srcfmt = info->src;
+	SDL_PixelFormat *dstfmt = info->dst;
+	int srcbpp = srcfmt->BytesPerPixel;
+
+	while ( height-- ) {
+	    DUFFS_LOOP4(
+	    {
+		Uint32 Pixel;
+		unsigned sR;
+		unsigned sG;
+		unsigned sB;
+		unsigned sA;
+		unsigned dR;
+		unsigned dG;
+		unsigned dB;
+		unsigned dA = 0;
+		DISEMBLE_RGBA(src,srcbpp,srcfmt,Pixel,sR,sG,sB,sA);
+		dR = dstfmt->palette->colors[*dst].r;
+		dG = dstfmt->palette->colors[*dst].g;
+		dB = dstfmt->palette->colors[*dst].b;
+		PREMUL_ALPHA_BLEND(sR, sG, sB, sA, dR, dG, dB, dA);
+		/* Pack RGB into 8bit pixel */
+		if ( palmap == NULL ) {
+		    *dst =((dR>>5)<<(3+2))|
+			  ((dG>>5)<<(2))|
+			  ((dB>>6)<<(0));
+		} else {
+		    *dst = palmap[INVMAP_INDEX(dR, dG, dB)];
 		}
 		dst++;
 		src += srcbpp;
@@ -210,9 +257,7 @@ static void BlitNto1SurfaceAlphaKey(SDL_BlitInfo *info)
 			      ((dG>>5)<<(2)) |
 			      ((dB>>6)<<(0));
 		    } else {
-			*dst = palmap[((dR>>5)<<(3+2))|
-				      ((dG>>5)<<(2))  |
-				      ((dB>>6)<<(0))  ];
+			*dst = palmap[INVMAP_INDEX(dR, dG, dB)];
 		    }
 		}
 		dst++;
@@ -1633,6 +1678,52 @@ static void BlitRGBtoRGBPixelAlpha(SDL_BlitInfo *info)
 	}
 }
 
+/* fast premultiplied ARGB8888->(A)RGB8888 blending: d = s + d * (1 - a)
+   on all four bytes.  The add saturates, so additive pixels (color with
+   zero alpha) work as well. */
+static void BlitRGBtoRGBPixelAlphaPremul(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = info->s_skip >> 2;
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = info->d_skip >> 2;
+	int ashift = info->src->Ashift;
+
+	while(height--) {
+	    DUFFS_LOOP4({
+		Uint32 s = *srcp;
+		if(s) {
+		  Uint32 ialpha = SDL_ALPHA_OPAQUE - ((s >> ashift) & 0xff);
+		  if(!ialpha) {
+		    *dstp = s;
+		  } else {
+		    /* scale two bytes at a time, rounding like /255 */
+		    Uint32 d = *dstp;
+		    Uint32 rb = (d & 0xff00ff) * ialpha + 0x800080;
+		    Uint32 ag = ((d >> 8) & 0xff00ff) * ialpha + 0x800080;
+		    Uint32 sum;
+		    Uint32 top;
+		    Uint32 carry;
+		    rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+		    ag = (ag + ((ag >> 8) & 0xff00ff)) & 0xff00ff00;
+		    d = rb | ag;
+		    /* bytewise saturating s + d */
+		    sum = (s & 0x7f7f7f7f) + (d & 0x7f7f7f7f);
+		    top = (s ^ d) & 0x80808080;
+		    carry = ((s & d) | (top & sum)) & 0x80808080;
+		    *dstp = (sum ^ top) | ((carry >> 7) * 0xff);
+		  }
+		}
+		++srcp;
+		++dstp;
+	    }, width);
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+}
+
 #if GCC_ASMBLIT
 /* fast (as in MMX with prefetch) ARGB888->(A)RGB888 blending with pixel alpha */
 static void BlitRGBtoRGBPixelAlphaMMX3DNOW(SDL_BlitInfo *info)
@@ -2644,6 +2735,334 @@ static void BlitARGBto555PixelAlpha(SDL_BlitInfo *info)
 	}
 }
 
+#if SDL_SSE2_INTRINSICS
+/* SSE2 ARGB8888->(A)RGB8888 blending with pixel alpha, 4 pixels at a time.
+   Groups that are completely transparent or completely opaque skip the
+   multiplies, and the destination alpha byte is left untouched.
+ */
+SDL_TARGETING("sse2")
+static void BlitRGBtoRGBPixelAlphaSSE2(SDL_BlitInfo *info)
+{
+	int width = info->d_width & ~3;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 3);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 3);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i amask = _mm_set1_epi32(0xff000000);
+	const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+	const __m128i keep_dalpha = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i c256 = _mm_set1_epi16(256);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)srcp);
+		__m128i sa = _mm_and_si128(s, amask);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) != 0xffff) {
+		    __m128i d = _mm_loadu_si128((const __m128i *)dstp);
+		    __m128i opaque = _mm_cmpeq_epi32(sa, amask);
+		    __m128i copy = _mm_or_si128(_mm_and_si128(s, rgbmask),
+						_mm_and_si128(d, amask));
+		    if(_mm_movemask_epi8(opaque) == 0xffff) {
+			d = copy;
+		    } else {
+			/* d = (s * a + d * (256 - a)) >> 8, with a = 0
+			   in the alpha lanes so that dst alpha stays */
+			__m128i s16, d16, a16, lo, hi;
+			s16 = _mm_unpacklo_epi8(s, zero);
+			d16 = _mm_unpacklo_epi8(d, zero);
+			a16 = _mm_shufflelo_epi16(s16, 0xff);
+			a16 = _mm_shufflehi_epi16(a16, 0xff);
+			a16 = _mm_and_si128(a16, keep_dalpha);
+			lo = _mm_add_epi16(_mm_mullo_epi16(s16, a16),
+				_mm_mullo_epi16(d16, _mm_sub_epi16(c256, a16)));
+			s16 = _mm_unpackhi_epi8(s, zero);
+			d16 = _mm_unpackhi_epi8(d, zero);
+			a16 = _mm_shufflelo_epi16(s16, 0xff);
+			a16 = _mm_shufflehi_epi16(a16, 0xff);
+			a16 = _mm_and_si128(a16, keep_dalpha);
+			hi = _mm_add_epi16(_mm_mullo_epi16(s16, a16),
+				_mm_mullo_epi16(d16, _mm_sub_epi16(c256, a16)));
+			d = _mm_packus_epi16(_mm_srli_epi16(lo, 8),
+					     _mm_srli_epi16(hi, 8));
+			/* opaque pixels are copied, as in the C version */
+			d = _mm_or_si128(_mm_and_si128(opaque, copy),
+					 _mm_andnot_si128(opaque, d));
+		    }
+		    _mm_storeu_si128((__m128i *)dstp, d);
+		}
+		srcp += 4;
+		dstp += 4;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	SDL_BlitTrailingColumns(info, width, BlitRGBtoRGBPixelAlpha);
+}
+
+/* AVX2 version of the above, 8 pixels at a time */
+SDL_TARGETING("avx2")
+static void BlitRGBtoRGBPixelAlphaAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width & ~7;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 7);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 7);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i amask = _mm256_set1_epi32(0xff000000);
+	const __m256i rgbmask = _mm256_set1_epi32(0x00ffffff);
+	const __m256i keep_dalpha = _mm256_set1_epi64x(0x0000ffffffffffffLL);
+	const __m256i c256 = _mm256_set1_epi16(256);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)srcp);
+		__m256i sa = _mm256_and_si256(s, amask);
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) != -1) {
+		    __m256i d = _mm256_loadu_si256((const __m256i *)dstp);
+		    __m256i opaque = _mm256_cmpeq_epi32(sa, amask);
+		    __m256i copy = _mm256_or_si256(_mm256_and_si256(s, rgbmask),
+						   _mm256_and_si256(d, amask));
+		    if(_mm256_movemask_epi8(opaque) == -1) {
+			d = copy;
+		    } else {
+			__m256i s16, d16, a16, lo, hi;
+			s16 = _mm256_unpacklo_epi8(s, zero);
+			d16 = _mm256_unpacklo_epi8(d, zero);
+			a16 = _mm256_shufflelo_epi16(s16, 0xff);
+			a16 = _mm256_shufflehi_epi16(a16, 0xff);
+			a16 = _mm256_and_si256(a16, keep_dalpha);
+			lo = _mm256_add_epi16(_mm256_mullo_epi16(s16, a16),
+				_mm256_mullo_epi16(d16, _mm256_sub_epi16(c256, a16)));
+			s16 = _mm256_unpackhi_epi8(s, zero);
+			d16 = _mm256_unpackhi_epi8(d, zero);
+			a16 = _mm256_shufflelo_epi16(s16, 0xff);
+			a16 = _mm256_shufflehi_epi16(a16, 0xff);
+			a16 = _mm256_and_si256(a16, keep_dalpha);
+			hi = _mm256_add_epi16(_mm256_mullo_epi16(s16, a16),
+				_mm256_mullo_epi16(d16, _mm256_sub_epi16(c256, a16)));
+			d = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8),
+						_mm256_srli_epi16(hi, 8));
+			d = _mm256_or_si256(_mm256_and_si256(opaque, copy),
+					    _mm256_andnot_si256(opaque, d));
+		    }
+		    _mm256_storeu_si256((__m256i *)dstp, d);
+		}
+		srcp += 8;
+		dstp += 8;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	_mm256_zeroupper();
+	SDL_BlitTrailingColumns(info, width, BlitRGBtoRGBPixelAlphaSSE2);
+}
+
+/* SSE2 premultiplied ARGB8888->(A)RGB8888 blending, 4 pixels at a time.
+   Every byte gets d = s + d * (255 - a) / 255 with the same rounding and
+   saturation as the C version. */
+SDL_TARGETING("sse2")
+static void BlitRGBtoRGBPixelAlphaPremulSSE2(SDL_BlitInfo *info)
+{
+	int width = info->d_width & ~3;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 3);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 3);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_cmpeq_epi32(zero, zero);
+	const __m128i ashift = _mm_cvtsi32_si128(info->src->Ashift);
+	const __m128i lowbyte = _mm_set1_epi32(0xff);
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)srcp);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) != 0xffff) {
+		    /* 255 - alpha in every byte of each pixel */
+		    __m128i ia = _mm_and_si128(_mm_srl_epi32(s, ashift), lowbyte);
+		    ia = _mm_or_si128(ia, _mm_slli_epi32(ia, 8));
+		    ia = _mm_xor_si128(_mm_or_si128(ia, _mm_slli_epi32(ia, 16)),
+				       ones);
+		    if(_mm_movemask_epi8(_mm_cmpeq_epi32(ia, zero)) == 0xffff) {
+			_mm_storeu_si128((__m128i *)dstp, s);
+		    } else {
+			__m128i d = _mm_loadu_si128((const __m128i *)dstp);
+			__m128i lo, hi;
+			lo = _mm_add_epi16(_mm_mullo_epi16(
+				_mm_unpacklo_epi8(d, zero),
+				_mm_unpacklo_epi8(ia, zero)), c128);
+			hi = _mm_add_epi16(_mm_mullo_epi16(
+				_mm_unpackhi_epi8(d, zero),
+				_mm_unpackhi_epi8(ia, zero)), c128);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo,
+						_mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi,
+						_mm_srli_epi16(hi, 8)), 8);
+			d = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+			_mm_storeu_si128((__m128i *)dstp, d);
+		    }
+		}
+		srcp += 4;
+		dstp += 4;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	SDL_BlitTrailingColumns(info, width, BlitRGBtoRGBPixelAlphaPremul);
+}
+
+/* AVX2 version of the above, 8 pixels at a time */
+SDL_TARGETING("avx2")
+static void BlitRGBtoRGBPixelAlphaPremulAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width & ~7;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 7);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 7);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_cmpeq_epi32(zero, zero);
+	const __m128i ashift = _mm_cvtsi32_si128(info->src->Ashift);
+	const __m256i lowbyte = _mm256_set1_epi32(0xff);
+	const __m256i c128 = _mm256_set1_epi16(128);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)srcp);
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) != -1) {
+		    __m256i ia = _mm256_and_si256(_mm256_srl_epi32(s, ashift),
+						  lowbyte);
+		    ia = _mm256_or_si256(ia, _mm256_slli_epi32(ia, 8));
+		    ia = _mm256_xor_si256(_mm256_or_si256(ia,
+					      _mm256_slli_epi32(ia, 16)), ones);
+		    if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(ia, zero)) == -1) {
+			_mm256_storeu_si256((__m256i *)dstp, s);
+		    } else {
+			__m256i d = _mm256_loadu_si256((const __m256i *)dstp);
+			__m256i lo, hi;
+			lo = _mm256_add_epi16(_mm256_mullo_epi16(
+				_mm256_unpacklo_epi8(d, zero),
+				_mm256_unpacklo_epi8(ia, zero)), c128);
+			hi = _mm256_add_epi16(_mm256_mullo_epi16(
+				_mm256_unpackhi_epi8(d, zero),
+				_mm256_unpackhi_epi8(ia, zero)), c128);
+			lo = _mm256_srli_epi16(_mm256_add_epi16(lo,
+						_mm256_srli_epi16(lo, 8)), 8);
+			hi = _mm256_srli_epi16(_mm256_add_epi16(hi,
+						_mm256_srli_epi16(hi, 8)), 8);
+			d = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+			_mm256_storeu_si256((__m256i *)dstp, d);
+		    }
+		}
+		srcp += 8;
+		dstp += 8;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	_mm256_zeroupper();
+	SDL_BlitTrailingColumns(info, width, BlitRGBtoRGBPixelAlphaPremulSSE2);
+}
+
+/* SSE2 ARGB8888->RGB565/RGB555 blending with pixel alpha, 8 pixels at a
+   time.  Like the C versions, alpha is downscaled to 5 bits and every
+   channel is blended at destination precision.
+ */
+SDL_TARGETING("sse2")
+static __inline__ void BlitARGBto16PixelAlphaSSE2(SDL_BlitInfo *info,
+						 int gbits, SDL_loblit tail)
+{
+	int width = info->d_width & ~7;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 7);
+	Uint16 *dstp = (Uint16 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 1) + (info->d_width & 7);
+	const int gshift = 16 - gbits;		/* source green, top bits */
+	const int rshift = 5 + gbits;		/* destination red */
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask5 = _mm_set1_epi32(0x1f);
+	const __m128i gmask = _mm_set1_epi32((1 << gbits) - 1);
+	const __m128i mask5_16 = _mm_set1_epi16(0x1f);
+	const __m128i gmask_16 = _mm_set1_epi16((1 << gbits) - 1);
+	const __m128i opaque5 = _mm_set1_epi16(SDL_ALPHA_OPAQUE >> 3);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 8) {
+		__m128i s0 = _mm_loadu_si128((const __m128i *)srcp);
+		__m128i s1 = _mm_loadu_si128((const __m128i *)(srcp + 4));
+		__m128i a = _mm_packs_epi32(_mm_srli_epi32(s0, 27),
+					    _mm_srli_epi32(s1, 27));
+		__m128i transparent = _mm_cmpeq_epi16(a, zero);
+		if(_mm_movemask_epi8(transparent) != 0xffff) {
+		    __m128i opaque = _mm_cmpeq_epi16(a, opaque5);
+		    __m128i sr, sg, sb, copy, d;
+		    sb = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(s0, 3), mask5),
+					 _mm_and_si128(_mm_srli_epi32(s1, 3), mask5));
+		    sg = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(s0, gshift), gmask),
+					 _mm_and_si128(_mm_srli_epi32(s1, gshift), gmask));
+		    sr = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(s0, 19), mask5),
+					 _mm_and_si128(_mm_srli_epi32(s1, 19), mask5));
+		    copy = _mm_or_si128(_mm_slli_epi16(sr, rshift),
+				_mm_or_si128(_mm_slli_epi16(sg, 5), sb));
+		    if(_mm_movemask_epi8(opaque) == 0xffff) {
+			d = copy;
+		    } else {
+			__m128i dr, dg, db;
+			d = _mm_loadu_si128((const __m128i *)dstp);
+			db = _mm_and_si128(d, mask5_16);
+			dg = _mm_and_si128(_mm_srli_epi16(d, 5), gmask_16);
+			dr = _mm_and_si128(_mm_srli_epi16(d, rshift), mask5_16);
+			/* d += (s - d) * alpha >> 5 */
+			db = _mm_add_epi16(db, _mm_srai_epi16(
+				_mm_mullo_epi16(_mm_sub_epi16(sb, db), a), 5));
+			dg = _mm_add_epi16(dg, _mm_srai_epi16(
+				_mm_mullo_epi16(_mm_sub_epi16(sg, dg), a), 5));
+			dr = _mm_add_epi16(dr, _mm_srai_epi16(
+				_mm_mullo_epi16(_mm_sub_epi16(sr, dr), a), 5));
+			copy = _mm_or_si128(_mm_and_si128(opaque, copy),
+				_mm_andnot_si128(opaque,
+				    _mm_or_si128(_mm_slli_epi16(dr, rshift),
+					_mm_or_si128(_mm_slli_epi16(dg, 5), db))));
+			/* transparent pixels are not touched at all */
+			d = _mm_or_si128(_mm_and_si128(transparent, d),
+					 _mm_andnot_si128(transparent, copy));
+		    }
+		    _mm_storeu_si128((__m128i *)dstp, d);
+		}
+		srcp += 8;
+		dstp += 8;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	SDL_BlitTrailingColumns(info, width, tail);
+}
+
+SDL_TARGETING("sse2")
+static void BlitARGBto565PixelAlphaSSE2(SDL_BlitInfo *info)
+{
+	BlitARGBto16PixelAlphaSSE2(info, 6, BlitARGBto565PixelAlpha);
+}
+
+SDL_TARGETING("sse2")
+static void BlitARGBto555PixelAlphaSSE2(SDL_BlitInfo *info)
+{
+	BlitARGBto16PixelAlphaSSE2(info, 5, BlitARGBto555PixelAlpha);
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
 /* General (slow) N->N blending with per-surface alpha */
 static void BlitNtoNSurfaceAlpha(SDL_BlitInfo *info)
 {
@@ -2778,13 +3197,447 @@ static void BlitNtoNPixelAlpha(SDL_BlitInfo *info)
 	    dst += dstskip;
 	}
 }
+/* General (slow) N->N blending with premultiplied pixel alpha */
+static void BlitNtoNPixelAlphaPremul(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	SDL_PixelFormat *srcfmt = info->src;
+	SDL_PixelFormat *dstfmt = info->dst;
+	int srcbpp = srcfmt->BytesPerPixel;
+	int dstbpp = dstfmt->BytesPerPixel;
+
+	while ( height-- ) {
+	    DUFFS_LOOP4(
+	    {
+		Uint32 Pixel;
+		unsigned sR;
+		unsigned sG;
+		unsigned sB;
+		unsigned sA;
+		unsigned dR;
+		unsigned dG;
+		unsigned dB;
+		unsigned dA;
+		DISEMBLE_RGBA(src, srcbpp, srcfmt, Pixel, sR, sG, sB, sA);
+		if(sR | sG | sB | sA) {
+		  DISEMBLE_RGBA(dst, dstbpp, dstfmt, Pixel, dR, dG, dB, dA);
+		  PREMUL_ALPHA_BLEND(sR, sG, sB, sA, dR, dG, dB, dA);
+		  ASSEMBLE_RGBA(dst, dstbpp, dstfmt, dR, dG, dB, dA);
+		}
+		src += srcbpp;
+		dst += dstbpp;
+	    },
+	    width);
+	    src += srcskip;
+	    dst += dstskip;
+	}
+}
+
+/*
+ * General N->N blending with color modulation (SDL_SRCCOLORMOD).  The
+ * per-surface alpha scales the alpha channel, if there is one, giving a.
+ * Each channel becomes s * k / 255 + d * (255 - a) / 255, where k is
+ * mod * a / 255 for straight alpha and mod * per-surface alpha / 255 for
+ * premultiplied pixels.  The SIMD versions below compute the same.
+ */
+static __inline__ void BlitNtoNModulateAlphaCommon(SDL_BlitInfo *info,
+						   int premul, int keyed)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 *palmap = info->table;
+	SDL_PixelFormat *srcfmt = info->src;
+	SDL_PixelFormat *dstfmt = info->dst;
+	int srcbpp = srcfmt->BytesPerPixel;
+	int dstbpp = dstfmt->BytesPerPixel;
+	unsigned alpha = srcfmt->alpha;
+	unsigned mR = info->colormod->r;
+	unsigned mG = info->colormod->g;
+	unsigned mB = info->colormod->b;
+	Uint32 rgbmask = ~srcfmt->Amask;
+	Uint32 ckey = srcfmt->colorkey & rgbmask;
+
+	if(premul) {
+		mR = MULDIV255(mR, alpha);
+		mG = MULDIV255(mG, alpha);
+		mB = MULDIV255(mB, alpha);
+	}
+	while ( height-- ) {
+	    DUFFS_LOOP4(
+	    {
+		Uint32 Pixel;
+		unsigned sR;
+		unsigned sG;
+		unsigned sB;
+		unsigned sA;
+		unsigned dR;
+		unsigned dG;
+		unsigned dB;
+		unsigned dA;
+		RETRIEVE_RGB_PIXEL(src, srcbpp, Pixel);
+		RGBA_FROM_PIXEL(Pixel, srcfmt, sR, sG, sB, sA);
+		sA = srcfmt->Amask ? MULDIV255(sA, alpha) : alpha;
+		if((premul ? Pixel != 0 : sA != 0)
+		   && (!keyed || (Pixel & rgbmask) != ckey)) {
+		    if(premul) {
+			sR = MULDIV255(sR, mR);
+			sG = MULDIV255(sG, mG);
+			sB = MULDIV255(sB, mB);
+		    } else {
+			sR = MULDIV255(sR, MULDIV255(mR, sA));
+			sG = MULDIV255(sG, MULDIV255(mG, sA));
+			sB = MULDIV255(sB, MULDIV255(mB, sA));
+		    }
+		    if(dstbpp == 1) {
+			dR = dstfmt->palette->colors[*dst].r;
+			dG = dstfmt->palette->colors[*dst].g;
+			dB = dstfmt->palette->colors[*dst].b;
+			dA = 0;
+		    } else {
+			DISEMBLE_RGBA(dst, dstbpp, dstfmt, Pixel, dR, dG, dB, dA);
+		    }
+		    dR = sR + MULDIV255(dR, 255 - sA);
+		    dG = sG + MULDIV255(dG, 255 - sA);
+		    dB = sB + MULDIV255(dB, 255 - sA);
+		    if(premul) {
+			dA = sA + MULDIV255(dA, 255 - sA);
+			if(dR > 255) dR = 255;
+			if(dG > 255) dG = 255;
+			if(dB > 255) dB = 255;
+			if(dA > 255) dA = 255;
+		    } else if(!srcfmt->Amask) {
+			dA = SDL_ALPHA_OPAQUE;
+		    }
+		    if(dstbpp > 1) {
+			ASSEMBLE_RGBA(dst, dstbpp, dstfmt, dR, dG, dB, dA);
+		    } else if(palmap == NULL) {
+			*dst = ((dR>>5)<<(3+2))|((dG>>5)<<(2))|((dB>>6)<<(0));
+		    } else {
+			*dst = palmap[INVMAP_INDEX(dR, dG, dB)];
+		    }
+		}
+		src += srcbpp;
+		dst += dstbpp;
+	    },
+	    width);
+	    src += srcskip;
+	    dst += dstskip;
+	}
+}
+
+static void BlitNtoNModulateAlpha(SDL_BlitInfo *info)
+{
+	BlitNtoNModulateAlphaCommon(info, 0, 0);
+}
+
+static void BlitNtoNModulateAlphaKey(SDL_BlitInfo *info)
+{
+	BlitNtoNModulateAlphaCommon(info, 0, 1);
+}
+
+static void BlitNtoNModulatePremul(SDL_BlitInfo *info)
+{
+	BlitNtoNModulateAlphaCommon(info, 1, 0);
+}
+
+#if SDL_SSE2_INTRINSICS
+/* x * y / 255 for each byte, rounded as MULDIV255() */
+SDL_TARGETING("sse2")
+static __inline__ __m128i MulDiv255SSE2(__m128i x, __m128i y)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero),
+				   _mm_unpacklo_epi8(y, zero)), c128);
+	__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero),
+				   _mm_unpackhi_epi8(y, zero)), c128);
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+	return _mm_packus_epi16(lo, hi);
+}
+
+/* SSE2 modulated blending between 32-bit formats with the same byte
+   aligned RGB channels, 4 pixels at a time.  The fourth byte is the
+   source alpha channel, or unused if the source has none. */
+SDL_TARGETING("sse2")
+static __inline__ void BlitRGBtoRGBModulateCommonSSE2(SDL_BlitInfo *info,
+						      int premul,
+						      SDL_loblit tail)
+{
+	int width = info->d_width & ~3;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 3);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 3);
+	SDL_PixelFormat *sf = info->src;
+	unsigned alpha = sf->alpha;
+	Uint32 cmask = sf->Rmask | sf->Gmask | sf->Bmask;
+	Uint32 mod;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_cmpeq_epi32(zero, zero);
+	const __m128i ashift = _mm_cvtsi32_si128(sf->Ashift);
+	const __m128i lowbyte = _mm_set1_epi32(0xff);
+	const __m128i alphav = _mm_set1_epi32(alpha);
+	const __m128i c128 = _mm_set1_epi32(128);
+	const __m128i cmaskv = _mm_set1_epi32((int)cmask);
+	__m128i modv;
+
+	if(premul) {
+		/* the alpha byte is scaled by the per-surface alpha too */
+		mod = (MULDIV255(info->colormod->r, alpha) << sf->Rshift)
+		    | (MULDIV255(info->colormod->g, alpha) << sf->Gshift)
+		    | (MULDIV255(info->colormod->b, alpha) << sf->Bshift)
+		    | (alpha << sf->Ashift);
+	} else {
+		mod = ((Uint32)info->colormod->r << sf->Rshift)
+		    | ((Uint32)info->colormod->g << sf->Gshift)
+		    | ((Uint32)info->colormod->b << sf->Bshift);
+	}
+	modv = _mm_set1_epi32((int)mod);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)srcp);
+		__m128i a, k, ia;
+		if(sf->Amask) {
+		    /* a = pixel alpha * per-surface alpha / 255 */
+		    a = _mm_and_si128(_mm_srl_epi32(s, ashift), lowbyte);
+		    a = _mm_add_epi16(_mm_mullo_epi16(a, alphav), c128);
+		    a = _mm_srli_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), 8);
+		} else {
+		    a = alphav;
+		}
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(premul ? s : a, zero))
+		   != 0xffff) {
+		    __m128i d = _mm_loadu_si128((const __m128i *)dstp);
+		    a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+		    a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		    if(premul) {
+			k = modv;
+			ia = _mm_xor_si128(a, ones);
+		    } else {
+			/* the alpha byte of the destination is kept */
+			k = MulDiv255SSE2(modv, a);
+			ia = _mm_xor_si128(_mm_and_si128(a, cmaskv), ones);
+		    }
+		    d = _mm_adds_epu8(MulDiv255SSE2(s, k), MulDiv255SSE2(d, ia));
+		    _mm_storeu_si128((__m128i *)dstp, d);
+		}
+		srcp += 4;
+		dstp += 4;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	SDL_BlitTrailingColumns(info, width, tail);
+}
+
+SDL_TARGETING("sse2")
+static void BlitRGBtoRGBModulateAlphaSSE2(SDL_BlitInfo *info)
+{
+	BlitRGBtoRGBModulateCommonSSE2(info, 0, BlitNtoNModulateAlpha);
+}
+
+SDL_TARGETING("sse2")
+static void BlitRGBtoRGBModulatePremulSSE2(SDL_BlitInfo *info)
+{
+	BlitRGBtoRGBModulateCommonSSE2(info, 1, BlitNtoNModulatePremul);
+}
+
+SDL_TARGETING("avx2")
+static __inline__ __m256i MulDiv255AVX2(__m256i x, __m256i y)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c128 = _mm256_set1_epi16(128);
+	__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(
+		_mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi8(y, zero)), c128);
+	__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(
+		_mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi8(y, zero)), c128);
+	lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+	hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+	return _mm256_packus_epi16(lo, hi);
+}
 
+/* AVX2 version of the above, 8 pixels at a time */
+SDL_TARGETING("avx2")
+static __inline__ void BlitRGBtoRGBModulateCommonAVX2(SDL_BlitInfo *info,
+						      int premul,
+						      SDL_loblit tail)
+{
+	int width = info->d_width & ~7;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 7);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 7);
+	SDL_PixelFormat *sf = info->src;
+	unsigned alpha = sf->alpha;
+	Uint32 cmask = sf->Rmask | sf->Gmask | sf->Bmask;
+	Uint32 mod;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_cmpeq_epi32(zero, zero);
+	const __m128i ashift = _mm_cvtsi32_si128(sf->Ashift);
+	const __m256i lowbyte = _mm256_set1_epi32(0xff);
+	const __m256i alphav = _mm256_set1_epi32(alpha);
+	const __m256i c128 = _mm256_set1_epi32(128);
+	const __m256i cmaskv = _mm256_set1_epi32((int)cmask);
+	__m256i modv;
+
+	if(premul) {
+		mod = (MULDIV255(info->colormod->r, alpha) << sf->Rshift)
+		    | (MULDIV255(info->colormod->g, alpha) << sf->Gshift)
+		    | (MULDIV255(info->colormod->b, alpha) << sf->Bshift)
+		    | (alpha << sf->Ashift);
+	} else {
+		mod = ((Uint32)info->colormod->r << sf->Rshift)
+		    | ((Uint32)info->colormod->g << sf->Gshift)
+		    | ((Uint32)info->colormod->b << sf->Bshift);
+	}
+	modv = _mm256_set1_epi32((int)mod);
+
+	while(height--) {
+	    int n;
+	    for(n = width; n > 0; n -= 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)srcp);
+		__m256i a, k, ia;
+		if(sf->Amask) {
+		    a = _mm256_and_si256(_mm256_srl_epi32(s, ashift), lowbyte);
+		    a = _mm256_add_epi16(_mm256_mullo_epi16(a, alphav), c128);
+		    a = _mm256_srli_epi16(_mm256_add_epi16(a,
+					  _mm256_srli_epi16(a, 8)), 8);
+		} else {
+		    a = alphav;
+		}
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(premul ? s : a, zero))
+		   != -1) {
+		    __m256i d = _mm256_loadu_si256((const __m256i *)dstp);
+		    a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+		    a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+		    if(premul) {
+			k = modv;
+			ia = _mm256_xor_si256(a, ones);
+		    } else {
+			k = MulDiv255AVX2(modv, a);
+			ia = _mm256_xor_si256(_mm256_and_si256(a, cmaskv), ones);
+		    }
+		    d = _mm256_adds_epu8(MulDiv255AVX2(s, k), MulDiv255AVX2(d, ia));
+		    _mm256_storeu_si256((__m256i *)dstp, d);
+		}
+		srcp += 8;
+		dstp += 8;
+	    }
+	    srcp += srcskip;
+	    dstp += dstskip;
+	}
+	_mm256_zeroupper();
+	SDL_BlitTrailingColumns(info, width, tail);
+}
+
+SDL_TARGETING("avx2")
+static void BlitRGBtoRGBModulateAlphaAVX2(SDL_BlitInfo *info)
+{
+	BlitRGBtoRGBModulateCommonAVX2(info, 0, BlitRGBtoRGBModulateAlphaSSE2);
+}
+
+SDL_TARGETING("avx2")
+static void BlitRGBtoRGBModulatePremulAVX2(SDL_BlitInfo *info)
+{
+	BlitRGBtoRGBModulateCommonAVX2(info, 1, BlitRGBtoRGBModulatePremulSSE2);
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+/* Blitters for surfaces with SDL_SRCCOLORMOD */
+static SDL_loblit CalculateModulateAlphaBlit(SDL_Surface *surface,
+					     int blit_index)
+{
+    SDL_PixelFormat *sf = surface->format;
+    SDL_PixelFormat *df = surface->map->dst->format;
+    int premul = sf->Amask && (surface->flags & SDL_SRCALPHA_PREMUL);
+
+    /* the color key is ignored for surfaces with an alpha channel */
+    if(blit_index == 3 && !sf->Amask)
+	return BlitNtoNModulateAlphaKey;
+
+#if SDL_SSE2_INTRINSICS
+    if(sf->BytesPerPixel == 4 && df->BytesPerPixel == 4
+       && sf->Rmask == df->Rmask
+       && sf->Gmask == df->Gmask
+       && sf->Bmask == df->Bmask
+       && (df->Amask == 0 || df->Amask == sf->Amask)
+       && sf->Rloss == 0 && sf->Gloss == 0 && sf->Bloss == 0
+       && (sf->Amask == 0 || sf->Aloss == 0)
+       && sf->Rshift % 8 == 0 && sf->Gshift % 8 == 0
+       && sf->Bshift % 8 == 0 && sf->Ashift % 8 == 0)
+    {
+	if(SDL_HasAVX2())
+	    return premul ? BlitRGBtoRGBModulatePremulAVX2
+			  : BlitRGBtoRGBModulateAlphaAVX2;
+	if(SDL_HasSSE2())
+	    return premul ? BlitRGBtoRGBModulatePremulSSE2
+			  : BlitRGBtoRGBModulateAlphaSSE2;
+    }
+#endif
+    return premul ? BlitNtoNModulatePremul : BlitNtoNModulateAlpha;
+}
+
+/* Blitters for surfaces with SDL_SRCALPHA_PREMUL and an alpha channel */
+static SDL_loblit CalculatePremulAlphaBlit(SDL_PixelFormat *sf,
+					   SDL_PixelFormat *df)
+{
+    switch(df->BytesPerPixel) {
+    case 1:
+	return BlitNto1PixelAlphaPremul;
+
+    case 4:
+	/* the packed blitters work on whole bytes, alpha included */
+	if(sf->BytesPerPixel == 4
+	   && sf->Rmask == df->Rmask
+	   && sf->Gmask == df->Gmask
+	   && sf->Bmask == df->Bmask
+	   && (df->Amask == 0 || df->Amask == sf->Amask)
+	   && sf->Rloss == 0 && sf->Gloss == 0
+	   && sf->Bloss == 0 && sf->Aloss == 0
+	   && sf->Rshift % 8 == 0 && sf->Gshift % 8 == 0
+	   && sf->Bshift % 8 == 0 && sf->Ashift % 8 == 0)
+	{
+#if SDL_SSE2_INTRINSICS
+		if(SDL_HasAVX2())
+			return BlitRGBtoRGBPixelAlphaPremulAVX2;
+		if(SDL_HasSSE2())
+			return BlitRGBtoRGBPixelAlphaPremulSSE2;
+#endif
+		return BlitRGBtoRGBPixelAlphaPremul;
+	}
+	return BlitNtoNPixelAlphaPremul;
+
+    default:
+	return BlitNtoNPixelAlphaPremul;
+    }
+}
 
 SDL_loblit SDL_CalculateAlphaBlit(SDL_Surface *surface, int blit_index)
 {
     SDL_PixelFormat *sf = surface->format;
     SDL_PixelFormat *df = surface->map->dst->format;
 
+    if(surface->flags & SDL_SRCCOLORMOD) {
+	return CalculateModulateAlphaBlit(surface, blit_index);
+    }
+    if(sf->Amask && (surface->flags & SDL_SRCALPHA_PREMUL)) {
+	return CalculatePremulAlphaBlit(sf, df);
+    }
+
     if(sf->Amask == 0) {
 	if((surface->flags & SDL_SRCCOLORKEY) == SDL_SRCCOLORKEY) {
 	    if(df->BytesPerPixel == 1)
@@ -2896,10 +3749,19 @@ SDL_loblit SDL_CalculateAlphaBlit(SDL_Surface *surface, int blit_index)
 	       && sf->Gmask == 0xff00
 	       && ((sf->Rmask == 0xff && df->Rmask == 0x1f)
 		   || (sf->Bmask == 0xff && df->Bmask == 0x1f))) {
-		if(df->Gmask == 0x7e0)
+		if(df->Gmask == 0x7e0) {
+#if SDL_SSE2_INTRINSICS
+		    if(SDL_HasSSE2())
+			return BlitARGBto565PixelAlphaSSE2;
+#endif
 		    return BlitARGBto565PixelAlpha;
-		else if(df->Gmask == 0x3e0)
+		} else if(df->Gmask == 0x3e0) {
+#if SDL_SSE2_INTRINSICS
+		    if(SDL_HasSSE2())
+			return BlitARGBto555PixelAlphaSSE2;
+#endif
 		    return BlitARGBto555PixelAlpha;
+		}
 	    }
 	    return BlitNtoNPixelAlpha;
 
@@ -2909,6 +3771,15 @@ SDL_loblit SDL_CalculateAlphaBlit(SDL_Surface *surface, int blit_index)
 	       && sf->Bmask == df->Bmask
 	       && sf->BytesPerPixel == 4)
 	    {
+#if SDL_SSE2_INTRINSICS
+		if(sf->Amask == 0xff000000)
+		{
+			if(SDL_HasAVX2())
+				return BlitRGBtoRGBPixelAlphaAVX2;
+			if(SDL_HasSSE2())
+				return BlitRGBtoRGBPixelAlphaSSE2;
+		}
+#endif
 #if MMX_ASMBLIT
 		if(sf->Rshift % 8 == 0
 		   && sf->Gshift % 8 == 0
@@ -26,6 +26,10 @@
 #include "SDL_cpuinfo.h"
 #include "SDL_blit.h"
 
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
+
 /* General optimized routines that write char by char */
 #define HAVE_FAST_WRITE_INT8 1
 
@@ -41,7 +45,10 @@ enum blit_features {
 	BLIT_FEATURE_HAS_MMX = 1,
 	BLIT_FEATURE_HAS_ALTIVEC = 2,
 	BLIT_FEATURE_ALTIVEC_DONT_USE_PREFETCH = 4,
-	BLIT_FEATURE_HAS_ARM_SIMD = 8
+	BLIT_FEATURE_HAS_ARM_SIMD = 8,
+	BLIT_FEATURE_HAS_SSE2 = 16,
+	BLIT_FEATURE_HAS_SSSE3 = 32,
+	BLIT_FEATURE_HAS_AVX2 = 64
 };
 
 #if SDL_ALTIVEC_BLITTERS
@@ -906,7 +913,11 @@ static enum blit_features GetBlitFeatures( void )
 #endif
 #else
 /* Feature 1 is has-MMX */
-#define GetBlitFeatures() ((SDL_HasMMX() ? BLIT_FEATURE_HAS_MMX : 0) | (SDL_HasARMSIMD() ? BLIT_FEATURE_HAS_ARM_SIMD : 0))
+#define GetBlitFeatures() ((SDL_HasMMX() ? BLIT_FEATURE_HAS_MMX : 0) | \
+                           (SDL_HasARMSIMD() ? BLIT_FEATURE_HAS_ARM_SIMD : 0) | \
+                           (SDL_HasSSE2() ? BLIT_FEATURE_HAS_SSE2 : 0) | \
+                           (SDL_HasSSSE3() ? BLIT_FEATURE_HAS_SSSE3 : 0) | \
+                           (SDL_HasAVX2() ? BLIT_FEATURE_HAS_AVX2 : 0))
 #endif
 
 #if SDL_ARM_SIMD_BLITTERS
@@ -948,6 +959,13 @@ static void Blit_RGB444_RGB888ARMSIMD(SDL_BlitInfo *info)
 #define LO	1
 #endif
 
+/* Index of an RGB 8-8-8 pixel in the 5-5-5 inverse colormap */
+#define RGB888_INVMAP(dst, src) { \
+	dst = (((src)&0x00F80000)>>9)| \
+	      (((src)&0x0000F800)>>6)| \
+	      (((src)&0x000000F8)>>3); \
+}
+
 #if SDL_HERMES_BLITTERS
 
 /* Heheheh, we coerce Hermes into using SDL blit information */
@@ -992,10 +1010,12 @@ static void Blit_RGB888_index8(SDL_BlitInfo *info)
 #ifdef USE_DUFFS_LOOP
 			DUFFS_LOOP(
 				RGB888_RGB332(*dst++, *src);
+				++src;
 			, width);
 #else
 			for ( c=width/4; c; --c ) {
 				/* Pack RGB into 8bit pixel */
+				RGB888_RGB332(*dst++, *src);
 				++src;
 				RGB888_RGB332(*dst++, *src);
 				++src;
@@ -1025,37 +1045,37 @@ static void Blit_RGB888_index8(SDL_BlitInfo *info)
 		while ( height-- ) {
 #ifdef USE_DUFFS_LOOP
 			DUFFS_LOOP(
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
 			, width);
 #else
 			for ( c=width/4; c; --c ) {
 				/* Pack RGB into 8bit pixel */
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
 			}
 			switch ( width & 3 ) {
 				case 3:
-					RGB888_RGB332(Pixel, *src);
+					RGB888_INVMAP(Pixel, *src);
 					*dst++ = map[Pixel];
 					++src;
 				case 2:
-					RGB888_RGB332(Pixel, *src);
+					RGB888_INVMAP(Pixel, *src);
 					*dst++ = map[Pixel];
 					++src;
 				case 1:
-					RGB888_RGB332(Pixel, *src);
+					RGB888_INVMAP(Pixel, *src);
 					*dst++ = map[Pixel];
 					++src;
 			}
@@ -1916,14 +1936,7 @@ static void Blit_RGB565_BGRA8888(SDL_BlitInfo *info)
     Blit_RGB565_32(info, RGB565_BGRA8888_LUT);
 }
 
-/* Special optimized blit for RGB 8-8-8 --> RGB 3-3-2 */
-#ifndef RGB888_RGB332
-#define RGB888_RGB332(dst, src) { \
-	dst = (((src)&0x00E00000)>>16)| \
-	      (((src)&0x0000E000)>>11)| \
-	      (((src)&0x000000C0)>>6); \
-}
-#endif
+/* Blit for RGB 8-8-8 --> palette through the inverse colormap */
 static void Blit_RGB888_index8_map(SDL_BlitInfo *info)
 {
 #ifndef USE_DUFFS_LOOP
@@ -1948,7 +1961,7 @@ static void Blit_RGB888_index8_map(SDL_BlitInfo *info)
 #ifdef USE_DUFFS_LOOP
 	while ( height-- ) {
 		DUFFS_LOOP(
-			RGB888_RGB332(Pixel, *src);
+			RGB888_INVMAP(Pixel, *src);
 			*dst++ = map[Pixel];
 			++src;
 		, width);
@@ -1959,30 +1972,30 @@ static void Blit_RGB888_index8_map(SDL_BlitInfo *info)
 	while ( height-- ) {
 		for ( c=width/4; c; --c ) {
 			/* Pack RGB into 8bit pixel */
-			RGB888_RGB332(Pixel, *src);
+			RGB888_INVMAP(Pixel, *src);
 			*dst++ = map[Pixel];
 			++src;
-			RGB888_RGB332(Pixel, *src);
+			RGB888_INVMAP(Pixel, *src);
 			*dst++ = map[Pixel];
 			++src;
-			RGB888_RGB332(Pixel, *src);
+			RGB888_INVMAP(Pixel, *src);
 			*dst++ = map[Pixel];
 			++src;
-			RGB888_RGB332(Pixel, *src);
+			RGB888_INVMAP(Pixel, *src);
 			*dst++ = map[Pixel];
 			++src;
 		}
 		switch ( width & 3 ) {
 			case 3:
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
 			case 2:
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
 			case 1:
-				RGB888_RGB332(Pixel, *src);
+				RGB888_INVMAP(Pixel, *src);
 				*dst++ = map[Pixel];
 				++src;
 		}
@@ -2057,9 +2070,7 @@ static void BlitNto1(SDL_BlitInfo *info)
 								sR, sG, sB);
 				if ( 1 ) {
 				  	/* Pack RGB into 8bit pixel */
-				  	*dst = map[((sR>>5)<<(3+2))|
-						   ((sG>>5)<<(2))  |
-						   ((sB>>6)<<(0))  ];
+				  	*dst = map[INVMAP_INDEX(sR, sG, sB)];
 				}
 				dst++;
 				src += srcbpp;
@@ -2070,9 +2081,7 @@ static void BlitNto1(SDL_BlitInfo *info)
 								sR, sG, sB);
 				if ( 1 ) {
 				  	/* Pack RGB into 8bit pixel */
-				  	*dst = map[((sR>>5)<<(3+2))|
-						   ((sG>>5)<<(2))  |
-						   ((sB>>6)<<(0))  ];
+				  	*dst = map[INVMAP_INDEX(sR, sG, sB)];
 				}
 				dst++;
 				src += srcbpp;
@@ -2451,9 +2460,7 @@ static void BlitNto1Key(SDL_BlitInfo *info)
 								sR, sG, sB);
 				if ( (Pixel & rgbmask) != ckey ) {
 				  	/* Pack RGB into 8bit pixel */
-				  	*dst = (Uint8)palmap[((sR>>5)<<(3+2))|
-							             ((sG>>5)<<(2))  |
-							             ((sB>>6)<<(0))  ];
+				  	*dst = (Uint8)palmap[INVMAP_INDEX(sR, sG, sB)];
 				}
 				dst++;
 				src += srcbpp;
@@ -2512,6 +2519,9 @@ static void BlitNtoNKey(SDL_BlitInfo *info)
 	unsigned alpha = dstfmt->Amask ? srcfmt->alpha : 0;
 	Uint32 rgbmask = ~srcfmt->Amask;
 
+	/* Set up some basic variables */
+	ckey &= rgbmask;
+
     /* BPP 4, same rgb */
     if (srcbpp == 4 && dstbpp == 4 && srcfmt->Rmask == dstfmt->Rmask && srcfmt->Gmask == dstfmt->Gmask && srcfmt->Bmask == dstfmt->Bmask) {
         Uint32 *src32 = (Uint32*)src;
@@ -2741,9 +2751,6 @@ static void BlitNtoNKey(SDL_BlitInfo *info)
     }
 #endif
 
-	/* Set up some basic variables */
-	ckey &= rgbmask;
-
 	while ( height-- ) {
 		DUFFS_LOOP(
 		{
@@ -2812,8 +2819,8 @@ static void BlitNtoNKeyCopyAlpha(SDL_BlitInfo *info)
                 src32 = (Uint32 *)((Uint8 *)src32 + srcskip);
                 dst32 = (Uint32 *)((Uint8 *)dst32 + dstskip);
             }
+            return;
         }
-        return;
     }
 
 #if HAVE_FAST_WRITE_INT8
@@ -3043,6 +3050,722 @@ Blit_3or4_to_3or4__inversed_rgb(SDL_BlitInfo * info)
     }
 }
 
+/* N->N copy with color modulation (SDL_SRCCOLORMOD): every color channel
+   becomes c * mod / 255, rounded.  Alpha is copied as by BlitNtoN. */
+static __inline__ void BlitNtoNModulateCommon(SDL_BlitInfo *info, int keyed)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 *palmap = info->table;
+	SDL_PixelFormat *srcfmt = info->src;
+	SDL_PixelFormat *dstfmt = info->dst;
+	int srcbpp = srcfmt->BytesPerPixel;
+	int dstbpp = dstfmt->BytesPerPixel;
+	unsigned mR = info->colormod->r;
+	unsigned mG = info->colormod->g;
+	unsigned mB = info->colormod->b;
+	Uint32 rgbmask = ~srcfmt->Amask;
+	Uint32 ckey = srcfmt->colorkey & rgbmask;
+
+	while ( height-- ) {
+	    DUFFS_LOOP(
+	    {
+		Uint32 Pixel;
+		unsigned sR;
+		unsigned sG;
+		unsigned sB;
+		unsigned sA;
+		RETRIEVE_RGB_PIXEL(src, srcbpp, Pixel);
+		if ( !keyed || (Pixel & rgbmask) != ckey ) {
+		    RGBA_FROM_PIXEL(Pixel, srcfmt, sR, sG, sB, sA);
+		    if ( !srcfmt->Amask ) {
+			sA = srcfmt->alpha;
+		    }
+		    sR = MULDIV255(sR, mR);
+		    sG = MULDIV255(sG, mG);
+		    sB = MULDIV255(sB, mB);
+		    if ( dstbpp > 1 ) {
+			ASSEMBLE_RGBA(dst, dstbpp, dstfmt, sR, sG, sB, sA);
+		    } else if ( palmap == NULL ) {
+			*dst = ((sR>>5)<<(3+2))|((sG>>5)<<(2))|((sB>>6)<<(0));
+		    } else {
+			*dst = palmap[INVMAP_INDEX(sR, sG, sB)];
+		    }
+		}
+		src += srcbpp;
+		dst += dstbpp;
+	    },
+	    width);
+	    src += srcskip;
+	    dst += dstskip;
+	}
+}
+
+static void BlitNtoNModulate(SDL_BlitInfo *info)
+{
+	BlitNtoNModulateCommon(info, 0);
+}
+
+static void BlitNtoNModulateKey(SDL_BlitInfo *info)
+{
+	BlitNtoNModulateCommon(info, 1);
+}
+
+#if SDL_SSE2_INTRINSICS
+/* Byte swizzle between 32-bit formats with 8 bits per channel.
+   shuffle[i] is the source byte feeding destination byte i, or 0x80
+   if that byte only comes from fill (the surface alpha, or zero).
+   Returns SDL_FALSE if the formats can't be described this way.
+ */
+#define BYTE_MASK(mask, shift)	((mask) == ((Uint32)0xFF << (shift)) && !((shift) & 7))
+
+static SDL_bool Get4to4Swizzle(const SDL_PixelFormat *srcfmt,
+			       const SDL_PixelFormat *dstfmt,
+			       Uint8 shuffle[4], Uint32 *fill)
+{
+	if ( !BYTE_MASK(srcfmt->Rmask, srcfmt->Rshift) ||
+	     !BYTE_MASK(srcfmt->Gmask, srcfmt->Gshift) ||
+	     !BYTE_MASK(srcfmt->Bmask, srcfmt->Bshift) ||
+	     !BYTE_MASK(dstfmt->Rmask, dstfmt->Rshift) ||
+	     !BYTE_MASK(dstfmt->Gmask, dstfmt->Gshift) ||
+	     !BYTE_MASK(dstfmt->Bmask, dstfmt->Bshift) ) {
+		return SDL_FALSE;
+	}
+	shuffle[0] = shuffle[1] = shuffle[2] = shuffle[3] = 0x80;
+	shuffle[dstfmt->Rshift >> 3] = srcfmt->Rshift >> 3;
+	shuffle[dstfmt->Gshift >> 3] = srcfmt->Gshift >> 3;
+	shuffle[dstfmt->Bshift >> 3] = srcfmt->Bshift >> 3;
+	*fill = 0;
+	if ( dstfmt->Amask ) {
+		if ( !BYTE_MASK(dstfmt->Amask, dstfmt->Ashift) ) {
+			return SDL_FALSE;
+		}
+		if ( srcfmt->Amask ) {
+			/* COPY_ALPHA */
+			if ( !BYTE_MASK(srcfmt->Amask, srcfmt->Ashift) ) {
+				return SDL_FALSE;
+			}
+			shuffle[dstfmt->Ashift >> 3] = srcfmt->Ashift >> 3;
+		} else {
+			/* SET_ALPHA */
+			*fill = (Uint32)srcfmt->alpha << dstfmt->Ashift;
+		}
+	}
+	return SDL_TRUE;
+}
+
+static __inline__ Uint32 Swizzle4to4(Uint32 pixel, const Uint8 shuffle[4], Uint32 fill)
+{
+	int i;
+
+	for ( i = 0; i < 4; ++i ) {
+		if ( shuffle[i] < 4 ) {
+			fill |= ((pixel >> (shuffle[i] * 8)) & 0xFF) << (i * 8);
+		}
+	}
+	return fill;
+}
+
+/* Fallback for formats which passed the mask table but aren't 8888 */
+static void Blit4to4SwizzleC(SDL_BlitInfo *info)
+{
+	if ( info->src->Amask && info->dst->Amask ) {
+		BlitNtoNCopyAlpha(info);
+	} else {
+		BlitNtoN(info);
+	}
+}
+
+/* SSE2 has no byte shuffle, so channels are moved with masks and shifts.
+   Channels which move by the same distance share one mask, and a byte
+   permutation never needs more than four distinct distances.
+ */
+SDL_TARGETING("sse2")
+static void Blit4to4SwizzleSSE2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 shuffle[4];
+	Uint32 fill;
+	Uint32 masks[4] = { 0, 0, 0, 0 };
+	int moves[4] = { 0, 0, 0, 0 };
+	__m128i m0, m1, m2, m3, l0, l1, l2, l3, r0, r1, r2, r3, fillv;
+	int i, j, ngroups;
+
+	if ( !Get4to4Swizzle(info->src, info->dst, shuffle, &fill) ) {
+		Blit4to4SwizzleC(info);
+		return;
+	}
+	ngroups = 0;
+	for ( i = 0; i < 4; ++i ) {
+		int move;
+		if ( shuffle[i] >= 4 ) {
+			continue;
+		}
+		move = (i - shuffle[i]) * 8;
+		for ( j = 0; j < ngroups && moves[j] != move; ++j )
+			;
+		if ( j == ngroups ) {
+			moves[ngroups++] = move;
+		}
+		masks[j] |= (Uint32)0xFF << (shuffle[i] * 8);
+	}
+#define SWIZZLE_GROUP(n) \
+	m##n = _mm_set1_epi32(masks[n]); \
+	l##n = _mm_cvtsi32_si128(moves[n] > 0 ? moves[n] : 0); \
+	r##n = _mm_cvtsi32_si128(moves[n] < 0 ? -moves[n] : 0);
+	SWIZZLE_GROUP(0)
+	SWIZZLE_GROUP(1)
+	SWIZZLE_GROUP(2)
+	SWIZZLE_GROUP(3)
+#undef SWIZZLE_GROUP
+	fillv = _mm_set1_epi32(fill);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)src);
+			__m128i d0, d1, d2, d3;
+			d0 = _mm_srl_epi32(_mm_sll_epi32(_mm_and_si128(s, m0), l0), r0);
+			d1 = _mm_srl_epi32(_mm_sll_epi32(_mm_and_si128(s, m1), l1), r1);
+			d2 = _mm_srl_epi32(_mm_sll_epi32(_mm_and_si128(s, m2), l2), r2);
+			d3 = _mm_srl_epi32(_mm_sll_epi32(_mm_and_si128(s, m3), l3), r3);
+			d0 = _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+			_mm_storeu_si128((__m128i *)dst, _mm_or_si128(d0, fillv));
+			src += 16;
+			dst += 16;
+			n -= 4;
+		}
+		while ( n-- ) {
+			*(Uint32 *)dst = Swizzle4to4(*(Uint32 *)src, shuffle, fill);
+			src += 4;
+			dst += 4;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+}
+
+/* pshufb control moving the bytes of four pixels at once */
+SDL_TARGETING("ssse3")
+static __m128i Get4to4ShuffleControl(const Uint8 shuffle[4])
+{
+	Uint8 control[16];
+	int i;
+
+	for ( i = 0; i < 16; ++i ) {
+		control[i] = (shuffle[i & 3] < 4) ? (i & ~3) + shuffle[i & 3] : 0x80;
+	}
+	return _mm_loadu_si128((const __m128i *)control);
+}
+
+SDL_TARGETING("ssse3")
+static void Blit4to4SwizzleSSSE3(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 shuffle[4];
+	Uint32 fill;
+	__m128i control, fillv;
+
+	if ( !Get4to4Swizzle(info->src, info->dst, shuffle, &fill) ) {
+		Blit4to4SwizzleC(info);
+		return;
+	}
+	control = Get4to4ShuffleControl(shuffle);
+	fillv = _mm_set1_epi32(fill);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 8 ) {
+			__m128i s0 = _mm_loadu_si128((const __m128i *)src);
+			__m128i s1 = _mm_loadu_si128((const __m128i *)(src + 16));
+			s0 = _mm_or_si128(_mm_shuffle_epi8(s0, control), fillv);
+			s1 = _mm_or_si128(_mm_shuffle_epi8(s1, control), fillv);
+			_mm_storeu_si128((__m128i *)dst, s0);
+			_mm_storeu_si128((__m128i *)(dst + 16), s1);
+			src += 32;
+			dst += 32;
+			n -= 8;
+		}
+		if ( n >= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)src);
+			s = _mm_or_si128(_mm_shuffle_epi8(s, control), fillv);
+			_mm_storeu_si128((__m128i *)dst, s);
+			src += 16;
+			dst += 16;
+			n -= 4;
+		}
+		while ( n-- ) {
+			*(Uint32 *)dst = Swizzle4to4(*(Uint32 *)src, shuffle, fill);
+			src += 4;
+			dst += 4;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+}
+
+SDL_TARGETING("avx2")
+static void Blit4to4SwizzleAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Uint8 shuffle[4];
+	Uint32 fill;
+	__m128i control;
+	__m256i control256, fill256;
+
+	if ( !Get4to4Swizzle(info->src, info->dst, shuffle, &fill) ) {
+		Blit4to4SwizzleC(info);
+		return;
+	}
+	control = Get4to4ShuffleControl(shuffle);
+	control256 = _mm256_broadcastsi128_si256(control);
+	fill256 = _mm256_set1_epi32(fill);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 16 ) {
+			__m256i s0 = _mm256_loadu_si256((const __m256i *)src);
+			__m256i s1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+			s0 = _mm256_or_si256(_mm256_shuffle_epi8(s0, control256), fill256);
+			s1 = _mm256_or_si256(_mm256_shuffle_epi8(s1, control256), fill256);
+			_mm256_storeu_si256((__m256i *)dst, s0);
+			_mm256_storeu_si256((__m256i *)(dst + 32), s1);
+			src += 64;
+			dst += 64;
+			n -= 16;
+		}
+		if ( n >= 8 ) {
+			__m256i s = _mm256_loadu_si256((const __m256i *)src);
+			s = _mm256_or_si256(_mm256_shuffle_epi8(s, control256), fill256);
+			_mm256_storeu_si256((__m256i *)dst, s);
+			src += 32;
+			dst += 32;
+			n -= 8;
+		}
+		if ( n >= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)src);
+			s = _mm_or_si128(_mm_shuffle_epi8(s, control),
+			                 _mm256_castsi256_si128(fill256));
+			_mm_storeu_si128((__m128i *)dst, s);
+			src += 16;
+			dst += 16;
+			n -= 4;
+		}
+		while ( n-- ) {
+			*(Uint32 *)dst = Swizzle4to4(*(Uint32 *)src, shuffle, fill);
+			src += 4;
+			dst += 4;
+		}
+		src += srcskip;
+		dst += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+/* Colorkey blits between 32-bit surfaces.  Each pixel which doesn't
+   match the key is moved through the byte shuffle (when the channels
+   are reordered), then masked and filled.  Groups of pixels which are
+   all keyed are skipped and groups with no keyed pixels are stored
+   without reading the destination.
+ */
+typedef struct {
+	Uint32 ckey;
+	Uint32 rgbmask;
+	Uint32 keep;
+	Uint32 fill;
+	SDL_bool swizzle;
+	Uint8 shuffle[4];
+} Key4to4;
+
+static SDL_bool GetKey4to4(const SDL_PixelFormat *srcfmt,
+			   const SDL_PixelFormat *dstfmt, Key4to4 *key)
+{
+	key->rgbmask = ~srcfmt->Amask;
+	key->ckey = srcfmt->colorkey & key->rgbmask;
+	key->keep = 0xFFFFFFFF;
+	key->fill = 0;
+	key->swizzle = SDL_FALSE;
+	if ( srcfmt->Rmask == dstfmt->Rmask &&
+	     srcfmt->Gmask == dstfmt->Gmask &&
+	     srcfmt->Bmask == dstfmt->Bmask ) {
+		if ( !srcfmt->Amask || !dstfmt->Amask ) {
+			/* Same as BlitNtoNKey */
+			if ( dstfmt->Amask ) {
+				key->fill = (Uint32)srcfmt->alpha << dstfmt->Ashift;
+			} else {
+				key->keep = srcfmt->Rmask | srcfmt->Gmask | srcfmt->Bmask;
+			}
+			return SDL_TRUE;
+		}
+		if ( srcfmt->Amask == dstfmt->Amask ) {
+			/* Same as BlitNtoNKeyCopyAlpha */
+			return SDL_TRUE;
+		}
+	}
+	key->swizzle = SDL_TRUE;
+	return Get4to4Swizzle(srcfmt, dstfmt, key->shuffle, &key->fill);
+}
+
+static void Blit32to32KeyC(SDL_BlitInfo *info)
+{
+	if ( info->src->Amask && info->dst->Amask ) {
+		BlitNtoNKeyCopyAlpha(info);
+	} else {
+		BlitNtoNKey(info);
+	}
+}
+
+/* Finish a row of keyed pixels one at a time */
+static __inline__ void Blit32to32KeyPixels(Uint32 *src, Uint32 *dst, int n,
+					   const Key4to4 *key)
+{
+	while ( n-- ) {
+		Uint32 pixel = *src++;
+		if ( (pixel & key->rgbmask) != key->ckey ) {
+			if ( key->swizzle ) {
+				pixel = Swizzle4to4(pixel, key->shuffle, 0);
+			}
+			*dst = (pixel & key->keep) | key->fill;
+		}
+		++dst;
+	}
+}
+
+SDL_TARGETING("sse2")
+static void Blit32to32KeySSE2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Key4to4 key;
+	__m128i ckey, rgbmask, keep, fill;
+
+	if ( !GetKey4to4(info->src, info->dst, &key) || key.swizzle ) {
+		Blit32to32KeyC(info);
+		return;
+	}
+	ckey = _mm_set1_epi32(key.ckey);
+	rgbmask = _mm_set1_epi32(key.rgbmask);
+	keep = _mm_set1_epi32(key.keep);
+	fill = _mm_set1_epi32(key.fill);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)src);
+			__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(s, rgbmask), ckey);
+			int bits = _mm_movemask_epi8(keyed);
+			if ( bits != 0xFFFF ) {
+				s = _mm_or_si128(_mm_and_si128(s, keep), fill);
+				if ( bits ) {
+					__m128i d = _mm_loadu_si128((const __m128i *)dst);
+					s = _mm_or_si128(_mm_andnot_si128(keyed, s),
+					                 _mm_and_si128(keyed, d));
+				}
+				_mm_storeu_si128((__m128i *)dst, s);
+			}
+			src += 16;
+			dst += 16;
+			n -= 4;
+		}
+		Blit32to32KeyPixels((Uint32 *)src, (Uint32 *)dst, n, &key);
+		src += n * 4 + srcskip;
+		dst += n * 4 + dstskip;
+	}
+}
+
+SDL_TARGETING("ssse3")
+static void Blit32to32KeySSSE3(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Key4to4 key;
+	__m128i ckey, rgbmask, keep, fill, control;
+
+	if ( !GetKey4to4(info->src, info->dst, &key) ) {
+		Blit32to32KeyC(info);
+		return;
+	}
+	if ( !key.swizzle ) {
+		Blit32to32KeySSE2(info);
+		return;
+	}
+	ckey = _mm_set1_epi32(key.ckey);
+	rgbmask = _mm_set1_epi32(key.rgbmask);
+	keep = _mm_set1_epi32(key.keep);
+	fill = _mm_set1_epi32(key.fill);
+	control = Get4to4ShuffleControl(key.shuffle);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)src);
+			__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(s, rgbmask), ckey);
+			int bits = _mm_movemask_epi8(keyed);
+			if ( bits != 0xFFFF ) {
+				s = _mm_shuffle_epi8(s, control);
+				s = _mm_or_si128(_mm_and_si128(s, keep), fill);
+				if ( bits ) {
+					__m128i d = _mm_loadu_si128((const __m128i *)dst);
+					s = _mm_or_si128(_mm_andnot_si128(keyed, s),
+					                 _mm_and_si128(keyed, d));
+				}
+				_mm_storeu_si128((__m128i *)dst, s);
+			}
+			src += 16;
+			dst += 16;
+			n -= 4;
+		}
+		Blit32to32KeyPixels((Uint32 *)src, (Uint32 *)dst, n, &key);
+		src += n * 4 + srcskip;
+		dst += n * 4 + dstskip;
+	}
+}
+
+SDL_TARGETING("avx2")
+static void Blit32to32KeyAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint8 *src = info->s_pixels;
+	int srcskip = info->s_skip;
+	Uint8 *dst = info->d_pixels;
+	int dstskip = info->d_skip;
+	Key4to4 key;
+	__m256i ckey, rgbmask, keep, fill, control;
+
+	if ( !GetKey4to4(info->src, info->dst, &key) ) {
+		Blit32to32KeyC(info);
+		return;
+	}
+	ckey = _mm256_set1_epi32(key.ckey);
+	rgbmask = _mm256_set1_epi32(key.rgbmask);
+	keep = _mm256_set1_epi32(key.keep);
+	fill = _mm256_set1_epi32(key.fill);
+	if ( key.swizzle ) {
+		control = _mm256_broadcastsi128_si256(Get4to4ShuffleControl(key.shuffle));
+	} else {
+		control = _mm256_setzero_si256();
+	}
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 8 ) {
+			__m256i s = _mm256_loadu_si256((const __m256i *)src);
+			__m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(s, rgbmask), ckey);
+			int bits = _mm256_movemask_epi8(keyed);
+			if ( bits != -1 ) {
+				if ( key.swizzle ) {
+					s = _mm256_shuffle_epi8(s, control);
+				}
+				s = _mm256_or_si256(_mm256_and_si256(s, keep), fill);
+				if ( bits ) {
+					__m256i d = _mm256_loadu_si256((const __m256i *)dst);
+					s = _mm256_blendv_epi8(s, d, keyed);
+				}
+				_mm256_storeu_si256((__m256i *)dst, s);
+			}
+			src += 32;
+			dst += 32;
+			n -= 8;
+		}
+		Blit32to32KeyPixels((Uint32 *)src, (Uint32 *)dst, n, &key);
+		src += n * 4 + srcskip;
+		dst += n * 4 + dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+/* Colorkey blits between identical 16-bit formats, eight or sixteen
+   pixels at a time
+ */
+SDL_TARGETING("sse2")
+static void Blit2to2KeySSE2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint16 *srcp = (Uint16 *)info->s_pixels;
+	int srcskip = info->s_skip / 2;
+	Uint16 *dstp = (Uint16 *)info->d_pixels;
+	int dstskip = info->d_skip / 2;
+	Uint16 rgbmask = (Uint16)~info->src->Amask;
+	Uint16 ckey = (Uint16)info->src->colorkey & rgbmask;
+	__m128i ckeyv = _mm_set1_epi16((short)ckey);
+	__m128i rgbmaskv = _mm_set1_epi16((short)rgbmask);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 8 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)srcp);
+			__m128i keyed = _mm_cmpeq_epi16(_mm_and_si128(s, rgbmaskv), ckeyv);
+			int bits = _mm_movemask_epi8(keyed);
+			if ( bits != 0xFFFF ) {
+				if ( bits ) {
+					__m128i d = _mm_loadu_si128((const __m128i *)dstp);
+					s = _mm_or_si128(_mm_andnot_si128(keyed, s),
+					                 _mm_and_si128(keyed, d));
+				}
+				_mm_storeu_si128((__m128i *)dstp, s);
+			}
+			srcp += 8;
+			dstp += 8;
+			n -= 8;
+		}
+		while ( n-- ) {
+			if ( (*srcp & rgbmask) != ckey ) {
+				*dstp = *srcp;
+			}
+			++srcp;
+			++dstp;
+		}
+		srcp += srcskip;
+		dstp += dstskip;
+	}
+}
+
+SDL_TARGETING("avx2")
+static void Blit2to2KeyAVX2(SDL_BlitInfo *info)
+{
+	int width = info->d_width;
+	int height = info->d_height;
+	Uint16 *srcp = (Uint16 *)info->s_pixels;
+	int srcskip = info->s_skip / 2;
+	Uint16 *dstp = (Uint16 *)info->d_pixels;
+	int dstskip = info->d_skip / 2;
+	Uint16 rgbmask = (Uint16)~info->src->Amask;
+	Uint16 ckey = (Uint16)info->src->colorkey & rgbmask;
+	__m256i ckeyv = _mm256_set1_epi16((short)ckey);
+	__m256i rgbmaskv = _mm256_set1_epi16((short)rgbmask);
+
+	while ( height-- ) {
+		int n = width;
+		while ( n >= 16 ) {
+			__m256i s = _mm256_loadu_si256((const __m256i *)srcp);
+			__m256i keyed = _mm256_cmpeq_epi16(_mm256_and_si256(s, rgbmaskv), ckeyv);
+			int bits = _mm256_movemask_epi8(keyed);
+			if ( bits != -1 ) {
+				if ( bits ) {
+					__m256i d = _mm256_loadu_si256((const __m256i *)dstp);
+					s = _mm256_blendv_epi8(s, d, keyed);
+				}
+				_mm256_storeu_si256((__m256i *)dstp, s);
+			}
+			srcp += 16;
+			dstp += 16;
+			n -= 16;
+		}
+		while ( n-- ) {
+			if ( (*srcp & rgbmask) != ckey ) {
+				*dstp = *srcp;
+			}
+			++srcp;
+			++dstp;
+		}
+		srcp += srcskip;
+		dstp += dstskip;
+	}
+	_mm256_zeroupper();
+}
+
+/* SSE2 modulated copy between 32-bit formats with the same byte aligned
+   RGB channels, 4 pixels at a time.  The fourth byte is copied through
+   unchanged, which is the source alpha or an unused destination byte. */
+SDL_TARGETING("sse2")
+static __inline__ void Blit4to4ModulateCommonSSE2(SDL_BlitInfo *info,
+						  int keyed, SDL_loblit tail)
+{
+	int width = info->d_width & ~3;
+	int height = info->d_height;
+	Uint32 *srcp = (Uint32 *)info->s_pixels;
+	int srcskip = (info->s_skip >> 2) + (info->d_width & 3);
+	Uint32 *dstp = (Uint32 *)info->d_pixels;
+	int dstskip = (info->d_skip >> 2) + (info->d_width & 3);
+	SDL_PixelFormat *srcfmt = info->src;
+	Uint32 rgbmask = ~srcfmt->Amask;
+	Uint32 mod = ~(srcfmt->Rmask | srcfmt->Gmask | srcfmt->Bmask)
+		| ((Uint32)info->colormod->r << srcfmt->Rshift)
+		| ((Uint32)info->colormod->g << srcfmt->Gshift)
+		| ((Uint32)info->colormod->b << srcfmt->Bshift);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i mod16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)mod), zero);
+	const __m128i ckey = _mm_set1_epi32((int)(srcfmt->colorkey & rgbmask));
+	const __m128i rgbmaskv = _mm_set1_epi32((int)rgbmask);
+
+	while ( height-- ) {
+		int n;
+		for ( n = width; n > 0; n -= 4 ) {
+			__m128i s = _mm_loadu_si128((const __m128i *)srcp);
+			__m128i keys = zero;
+			int bits = 0;
+			if ( keyed ) {
+				keys = _mm_cmpeq_epi32(_mm_and_si128(s, rgbmaskv), ckey);
+				bits = _mm_movemask_epi8(keys);
+			}
+			if ( bits != 0xFFFF ) {
+				/* c * mod / 255 = (t + (t >> 8)) >> 8, t = c * mod + 128 */
+				__m128i lo = _mm_add_epi16(_mm_mullo_epi16(
+					_mm_unpacklo_epi8(s, zero), mod16), c128);
+				__m128i hi = _mm_add_epi16(_mm_mullo_epi16(
+					_mm_unpackhi_epi8(s, zero), mod16), c128);
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+				s = _mm_packus_epi16(lo, hi);
+				if ( bits ) {
+					__m128i d = _mm_loadu_si128((const __m128i *)dstp);
+					s = _mm_or_si128(_mm_andnot_si128(keys, s),
+					                 _mm_and_si128(keys, d));
+				}
+				_mm_storeu_si128((__m128i *)dstp, s);
+			}
+			srcp += 4;
+			dstp += 4;
+		}
+		srcp += srcskip;
+		dstp += dstskip;
+	}
+	SDL_BlitTrailingColumns(info, width, tail);
+}
+
+SDL_TARGETING("sse2")
+static void Blit4to4ModulateSSE2(SDL_BlitInfo *info)
+{
+	Blit4to4ModulateCommonSSE2(info, 0, BlitNtoNModulate);
+}
+
+SDL_TARGETING("sse2")
+static void Blit4to4ModulateKeySSE2(SDL_BlitInfo *info)
+{
+	Blit4to4ModulateCommonSSE2(info, 1, BlitNtoNModulateKey);
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
 /* Normal N to N optimized blitters */
 struct blit_table {
 	Uint32 srcR, srcG, srcB;
@@ -3123,7 +3846,25 @@ static const struct blit_table normal_blit_3[] = {
 	/* Default for 24-bit RGB source, never optimized */
     { 0,0,0, 0, 0,0,0, 0, NULL, BlitNtoN, 0 }
 };
+#if SDL_SSE2_INTRINSICS
+#define SWIZZLE_4to4(sR, sG, sB, dR, dG, dB) \
+    { sR,sG,sB, 4, dR,dG,dB, BLIT_FEATURE_HAS_AVX2, NULL, Blit4to4SwizzleAVX2, NO_ALPHA | SET_ALPHA | COPY_ALPHA }, \
+    { sR,sG,sB, 4, dR,dG,dB, BLIT_FEATURE_HAS_SSSE3, NULL, Blit4to4SwizzleSSSE3, NO_ALPHA | SET_ALPHA | COPY_ALPHA }, \
+    { sR,sG,sB, 4, dR,dG,dB, BLIT_FEATURE_HAS_SSE2, NULL, Blit4to4SwizzleSSE2, NO_ALPHA | SET_ALPHA | COPY_ALPHA }
+#define SWIZZLE_4to4_FROM(sR, sG, sB) \
+    SWIZZLE_4to4(sR,sG,sB, 0x00FF0000,0x0000FF00,0x000000FF), \
+    SWIZZLE_4to4(sR,sG,sB, 0x000000FF,0x0000FF00,0x00FF0000), \
+    SWIZZLE_4to4(sR,sG,sB, 0xFF000000,0x00FF0000,0x0000FF00), \
+    SWIZZLE_4to4(sR,sG,sB, 0x0000FF00,0x00FF0000,0xFF000000)
+#endif
 static const struct blit_table normal_blit_4[] = {
+#if SDL_SSE2_INTRINSICS
+    /* 8888 <-> 8888 permutations, any alpha handling */
+    SWIZZLE_4to4_FROM(0x00FF0000,0x0000FF00,0x000000FF),
+    SWIZZLE_4to4_FROM(0x000000FF,0x0000FF00,0x00FF0000),
+    SWIZZLE_4to4_FROM(0xFF000000,0x00FF0000,0x0000FF00),
+    SWIZZLE_4to4_FROM(0x0000FF00,0x00FF0000,0xFF000000),
+#endif
 #if SDL_HERMES_BLITTERS
     { 0x00FF0000,0x0000FF00,0x000000FF, 2, 0x0000F800,0x000007E0,0x0000001F,
       BLIT_FEATURE_HAS_MMX, ConvertMMXpII32_16RGB565, ConvertMMX, NO_ALPHA },
@@ -3230,6 +3971,25 @@ SDL_loblit SDL_CalculateBlitN(SDL_Surface *surface, int blit_index)
 	if ( dstfmt->BitsPerPixel < 8 ) {
 		return(NULL);
 	}
+
+	if ( surface->flags & SDL_SRCCOLORMOD ) {
+#if SDL_SSE2_INTRINSICS
+		if ( (GetBlitFeatures() & BLIT_FEATURE_HAS_SSE2)
+		     && srcfmt->BytesPerPixel == 4 && dstfmt->BytesPerPixel == 4
+		     && srcfmt->Rmask == dstfmt->Rmask
+		     && srcfmt->Gmask == dstfmt->Gmask
+		     && srcfmt->Bmask == dstfmt->Bmask
+		     && (dstfmt->Amask == 0 || dstfmt->Amask == srcfmt->Amask)
+		     && srcfmt->Rloss == 0 && srcfmt->Gloss == 0
+		     && srcfmt->Bloss == 0
+		     && srcfmt->Rshift % 8 == 0 && srcfmt->Gshift % 8 == 0
+		     && srcfmt->Bshift % 8 == 0 ) {
+			return (blit_index == 1) ? Blit4to4ModulateKeySSE2
+						 : Blit4to4ModulateSSE2;
+		}
+#endif
+		return (blit_index == 1) ? BlitNtoNModulateKey : BlitNtoNModulate;
+	}
 	
 	if(blit_index == 1) {
 	    /* colorkey blit: Here we don't have too many options, mostly
@@ -3237,11 +3997,27 @@ SDL_loblit SDL_CalculateBlitN(SDL_Surface *surface, int blit_index)
 	       If a particular case turns out to be useful we'll add it. */
 
 	    if(srcfmt->BytesPerPixel == 2
-	       && surface->map->identity)
+	       && surface->map->identity) {
+#if SDL_SSE2_INTRINSICS
+		if(GetBlitFeatures() & BLIT_FEATURE_HAS_AVX2)
+		    return Blit2to2KeyAVX2;
+		if(GetBlitFeatures() & BLIT_FEATURE_HAS_SSE2)
+		    return Blit2to2KeySSE2;
+#endif
 		return Blit2to2Key;
-	    else if(dstfmt->BytesPerPixel == 1)
+	    } else if(dstfmt->BytesPerPixel == 1)
 		return BlitNto1Key;
 	    else {
+#if SDL_SSE2_INTRINSICS
+		if((srcfmt->BytesPerPixel == 4) && (dstfmt->BytesPerPixel == 4)) {
+		    if(GetBlitFeatures() & BLIT_FEATURE_HAS_AVX2)
+			return Blit32to32KeyAVX2;
+		    if(GetBlitFeatures() & BLIT_FEATURE_HAS_SSSE3)
+			return Blit32to32KeySSSE3;
+		    if(GetBlitFeatures() & BLIT_FEATURE_HAS_SSE2)
+			return Blit32to32KeySSE2;
+		}
+#endif
 #if SDL_ALTIVEC_BLITTERS
         if((srcfmt->BytesPerPixel == 4) && (dstfmt->BytesPerPixel == 4) && SDL_HasAltiVec()) {
             return Blit32to32KeyAltivec;
@@ -586,6 +586,7 @@ static void SDL_ConvertCursorSave(SDL_Surface *screen, int w, int h)
 	info.src = screen->format;
 	info.table = screen->map->table;
 	info.dst = SDL_VideoSurface->format;
+	info.colormod = &screen->map->colormod;
 	RunBlit = screen->map->sw_data->blit;
 
 	/* Run the actual software blit */
@@ -235,7 +235,7 @@ SDL_PixelFormat *SDL_ReallocFormat(SDL_Surface *surface, int bpp,
 /*
  * Change any previous mappings from/to the new surface format
  */
-void SDL_FormatChanged(SDL_Surface *surface)
+static void SDL_NewFormatVersion(SDL_Surface *surface)
 {
 	static int format_version = 0;
 	++format_version;
@@ -243,6 +243,10 @@ void SDL_FormatChanged(SDL_Surface *surface)
 		format_version = 1;
 	}
 	surface->format_version = format_version;
+}
+void SDL_FormatChanged(SDL_Surface *surface)
+{
+	SDL_NewFormatVersion(surface);
 	SDL_InvalidateMap(surface->map);
 }
 /*
@@ -252,6 +256,7 @@ void SDL_FreeFormat(SDL_PixelFormat *format)
 {
 	if ( format ) {
 		if ( format->palette ) {
+			SDL_FreeInverseMaps(format->palette);
 			if ( format->palette->colors ) {
 				SDL_free(format->palette->colors);
 			}
@@ -285,6 +290,11 @@ void SDL_DitherColors(SDL_Color *colors, int bpp)
 		colors[i].b = b;
 	}
 }
+/* Row and buffer alignment of SDL_CACHEALIGN surfaces */
+#define SURFACE_ALIGN		64
+/* Pitches that are a multiple of this get one cache line of skew */
+#define SURFACE_SKEW_PERIOD	1024
+
 /* 
  * Calculate the pad-aligned scanline width of a surface. Return 0 in case of
  * an error.
@@ -329,6 +339,19 @@ Uint16 SDL_CalculatePitch(SDL_Surface *surface)
 		}
 		pitch = (pitch + 3) & ~3;
 	}
+	if ( (surface->flags & SDL_CACHEALIGN) && (pitch <= 0xFFFF) ) {
+		/* Start every row on a cache line, and optionally skew
+		   power-of-two pitches so that the rows of a column don't
+		   all land in the same cache set.
+		 */
+		const char *skew = SDL_getenv("SDL_SURFACE_SKEW");
+
+		pitch = (pitch + (SURFACE_ALIGN-1)) & ~(SURFACE_ALIGN-1);
+		if ( skew && SDL_atoi(skew) &&
+		     (pitch % SURFACE_SKEW_PERIOD) == 0 ) {
+			pitch += SURFACE_ALIGN;
+		}
+	}
 	if (pitch > 0xFFFF) {
 		SDL_SetError("A scanline is too wide");
 		return(0);
@@ -336,25 +359,269 @@ Uint16 SDL_CalculatePitch(SDL_Surface *surface)
 	return((Uint16)pitch);
 }
 /*
- * Match an RGB value to a particular palette index
+ * Allocate and free the pixels of a software surface.  SDL_CACHEALIGN
+ * buffers are aligned by hand, with the pointer from SDL_malloc() stored
+ * just before the aligned block.
  */
-Uint8 SDL_FindColor(SDL_Palette *pal, Uint8 r, Uint8 g, Uint8 b)
+void *SDL_AllocPixels(SDL_Surface *surface)
+{
+	size_t size = (size_t)surface->h * surface->pitch;
+	Uint8 *mem, *pixels;
+
+	if ( !(surface->flags & SDL_CACHEALIGN) ) {
+		return SDL_malloc(size);
+	}
+	mem = (Uint8 *)SDL_malloc(size + sizeof(void *) + SURFACE_ALIGN - 1);
+	if ( mem == NULL ) {
+		return(NULL);
+	}
+	pixels = mem + sizeof(void *);
+	pixels += (SURFACE_ALIGN - ((uintptr_t)pixels & (SURFACE_ALIGN-1))) &
+	          (SURFACE_ALIGN-1);
+	((void **)pixels)[-1] = mem;
+	return(pixels);
+}
+void SDL_FreePixels(SDL_Surface *surface)
+{
+	if ( surface->pixels == NULL ) {
+		return;
+	}
+	if ( surface->flags & SDL_CACHEALIGN ) {
+		SDL_free(((void **)surface->pixels)[-1]);
+	} else {
+		SDL_free(surface->pixels);
+	}
+	surface->pixels = NULL;
+}
+/*
+ * Inverse colormaps for nearest color matching.
+ *
+ * The RGB cube is split into 4x4x4 blocks of 64 levels per side, and
+ * those into 16x16x16 cells of 16 levels.  Every block and cell keeps the
+ * palette entries which can be the nearest match for some color inside
+ * it: the ones no further from the box than the best entry is from the
+ * far corner of the box.  Lists are built on first use, a cell from the
+ * list of its block, and hold each distinct color once, at its lowest
+ * index.  Scanning a cell in index order therefore gives exactly the
+ * same pixel as searching the whole palette.
+ *
+ * The maps are cached for the last few palettes seen, and are rebuilt
+ * when the colors of a palette no longer match the copy taken when its
+ * map was made.  Like the rest of the video API this is not thread safe.
+ */
+#define INVMAP_CACHE_SIZE	4
+#define INVMAP_BLOCKS		64	/* 4x4x4 */
+#define INVMAP_CELLS		4096	/* 16x16x16 */
+
+typedef struct SDL_InverseMap {
+	SDL_Palette *palette;
+	int ncolors;
+	SDL_Color colors[256];		/* The palette when the map was made */
+	int nunique;
+	Uint8 unique[256];		/* First index of each distinct color */
+	Uint16 block_count[INVMAP_BLOCKS];
+	Uint8 blocks[INVMAP_BLOCKS][256];
+	Uint16 cell_count[INVMAP_CELLS];	/* 0 until the cell is built */
+	Uint32 cell_offset[INVMAP_CELLS];
+	Uint8 *pool;
+	Uint32 pool_used;
+	Uint32 pool_size;
+} SDL_InverseMap;
+
+static SDL_InverseMap *inverse_maps[INVMAP_CACHE_SIZE];
+static int next_inverse_map;
+
+/* Squared distances from a color to the nearest and furthest points of
+   the box with corner lo and the given size */
+static void BoxDistances(const SDL_Color *c, int rlo, int glo, int blo,
+                         int size, unsigned int *mind, unsigned int *maxd)
+{
+	const int v[3] = { c->r, c->g, c->b };
+	const int lo[3] = { rlo, glo, blo };
+	unsigned int dmin = 0, dmax = 0;
+	int i;
+
+	for ( i = 0; i < 3; ++i ) {
+		int below = lo[i] - v[i];
+		int above = v[i] - (lo[i] + size - 1);
+		int span = (v[i] - lo[i] > lo[i] + size - 1 - v[i]) ?
+		           v[i] - lo[i] : lo[i] + size - 1 - v[i];
+		if ( below > 0 ) {
+			dmin += below * below;
+		} else if ( above > 0 ) {
+			dmin += above * above;
+		}
+		dmax += span * span;
+	}
+	*mind = dmin;
+	*maxd = dmax;
+}
+
+/* Keep the entries of 'in' which may be nearest to a color in the box */
+static int PruneColors(const SDL_Color *colors, const Uint8 *in, int n,
+                       int rlo, int glo, int blo, int size, Uint8 *out)
+{
+	unsigned int mind[256];
+	unsigned int limit = ~0U;
+	int i, count;
+
+	for ( i = 0; i < n; ++i ) {
+		unsigned int maxd;
+		BoxDistances(&colors[in[i]], rlo, glo, blo, size,
+		             &mind[i], &maxd);
+		if ( maxd < limit ) {
+			limit = maxd;
+		}
+	}
+	count = 0;
+	for ( i = 0; i < n; ++i ) {
+		if ( mind[i] <= limit ) {
+			out[count++] = in[i];
+		}
+	}
+	return(count);
+}
+
+static void ResetInverseMap(SDL_InverseMap *inv, SDL_Palette *pal)
+{
+	Uint32 seen[512];
+	int i;
+
+	inv->palette = pal;
+	inv->ncolors = pal->ncolors;
+	SDL_memcpy(inv->colors, pal->colors, pal->ncolors*sizeof(SDL_Color));
+
+	/* Drop repeated colors, they can never win over the first one */
+	SDL_memset(seen, 0xFF, sizeof(seen));
+	inv->nunique = 0;
+	for ( i = 0; i < pal->ncolors; ++i ) {
+		Uint32 rgb = (pal->colors[i].r << 16) |
+		             (pal->colors[i].g << 8) | pal->colors[i].b;
+		Uint32 slot = ((rgb * 2654435761U) >> 23) & 511;
+		while ( seen[slot] != 0xFFFFFFFF && seen[slot] != rgb ) {
+			slot = (slot + 1) & 511;
+		}
+		if ( seen[slot] != rgb ) {
+			seen[slot] = rgb;
+			inv->unique[inv->nunique++] = (Uint8)i;
+		}
+	}
+	SDL_memset(inv->block_count, 0, sizeof(inv->block_count));
+	SDL_memset(inv->cell_count, 0, sizeof(inv->cell_count));
+	inv->pool_used = 0;
+}
+
+/* Find or make the inverse map of a palette, NULL if out of memory */
+static SDL_InverseMap *GetInverseMap(SDL_Palette *pal)
+{
+	SDL_InverseMap *inv;
+	int i;
+
+	if ( pal->ncolors <= 0 || pal->ncolors > 256 ) {
+		return(NULL);
+	}
+	for ( i = 0; i < INVMAP_CACHE_SIZE; ++i ) {
+		inv = inverse_maps[i];
+		if ( inv && inv->palette == pal ) {
+			if ( inv->ncolors != pal->ncolors ||
+			     SDL_memcmp(inv->colors, pal->colors,
+			                pal->ncolors*sizeof(SDL_Color)) != 0 ) {
+				ResetInverseMap(inv, pal);
+			}
+			return(inv);
+		}
+	}
+	i = next_inverse_map;
+	next_inverse_map = (next_inverse_map + 1) % INVMAP_CACHE_SIZE;
+	inv = inverse_maps[i];
+	if ( inv == NULL ) {
+		inv = (SDL_InverseMap *)SDL_malloc(sizeof(*inv));
+		if ( inv == NULL ) {
+			return(NULL);
+		}
+		inv->pool = NULL;
+		inv->pool_size = 0;
+		inverse_maps[i] = inv;
+	}
+	ResetInverseMap(inv, pal);
+	return(inv);
+}
+
+/* Return the candidate list of the cell holding a color */
+static const Uint8 *InverseMapCell(SDL_InverseMap *inv,
+                                   Uint8 r, Uint8 g, Uint8 b, int *count)
+{
+	int cell = ((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4);
+
+	if ( inv->cell_count[cell] == 0 ) {
+		int block = ((r >> 6) << 4) | ((g >> 6) << 2) | (b >> 6);
+		Uint8 list[256];
+		int n;
+
+		if ( inv->block_count[block] == 0 ) {
+			inv->block_count[block] = (Uint16)PruneColors(
+				inv->colors, inv->unique, inv->nunique,
+				r & 0xC0, g & 0xC0, b & 0xC0, 64,
+				inv->blocks[block]);
+		}
+		n = PruneColors(inv->colors, inv->blocks[block],
+		                inv->block_count[block],
+		                r & 0xF0, g & 0xF0, b & 0xF0, 16, list);
+		if ( inv->pool_used + n > inv->pool_size ) {
+			Uint32 size = inv->pool_size ? inv->pool_size*2 : 16384;
+			Uint8 *pool = (Uint8 *)SDL_realloc(inv->pool, size);
+			if ( pool == NULL ) {
+				return(NULL);
+			}
+			inv->pool = pool;
+			inv->pool_size = size;
+		}
+		SDL_memcpy(inv->pool + inv->pool_used, list, n);
+		inv->cell_offset[cell] = inv->pool_used;
+		inv->cell_count[cell] = (Uint16)n;
+		inv->pool_used += n;
+	}
+	*count = inv->cell_count[cell];
+	return(inv->pool + inv->cell_offset[cell]);
+}
+
+/* Release the inverse map of a palette which is going away, or all of
+   them if pal is NULL */
+void SDL_FreeInverseMaps(SDL_Palette *pal)
+{
+	int i;
+
+	for ( i = 0; i < INVMAP_CACHE_SIZE; ++i ) {
+		SDL_InverseMap *inv = inverse_maps[i];
+		if ( inv && (pal == NULL || inv->palette == pal) ) {
+			if ( inv->pool ) {
+				SDL_free(inv->pool);
+			}
+			SDL_free(inv);
+			inverse_maps[i] = NULL;
+		}
+	}
+}
+
+/* Search a list of palette entries for the nearest color */
+static Uint8 NearestColor(const SDL_Color *colors, const Uint8 *list, int n,
+                          Uint8 r, Uint8 g, Uint8 b)
 {
-	/* Do colorspace distance matching */
 	unsigned int smallest;
 	unsigned int distance;
 	int rd, gd, bd;
 	int i;
 	Uint8 pixel=0;
-		
+
 	smallest = ~0;
-	for ( i=0; i<pal->ncolors; ++i ) {
-		rd = pal->colors[i].r - r;
-		gd = pal->colors[i].g - g;
-		bd = pal->colors[i].b - b;
+	for ( i=0; i<n; ++i ) {
+		const SDL_Color *c = &colors[list ? list[i] : i];
+		rd = c->r - r;
+		gd = c->g - g;
+		bd = c->b - b;
 		distance = (rd*rd)+(gd*gd)+(bd*bd);
 		if ( distance < smallest ) {
-			pixel = i;
+			pixel = list ? list[i] : i;
 			if ( distance == 0 ) { /* Perfect match! */
 				break;
 			}
@@ -364,6 +631,26 @@ Uint8 SDL_FindColor(SDL_Palette *pal, Uint8 r, Uint8 g, Uint8 b)
 	return(pixel);
 }
 
+/*
+ * Match an RGB value to a particular palette index
+ */
+Uint8 SDL_FindColor(SDL_Palette *pal, Uint8 r, Uint8 g, Uint8 b)
+{
+	SDL_InverseMap *inv;
+	const Uint8 *list;
+	int n;
+
+	inv = GetInverseMap(pal);
+	if ( inv ) {
+		list = InverseMapCell(inv, r, g, b, &n);
+		if ( list ) {
+			return NearestColor(inv->colors, list, n, r, g, b);
+		}
+	}
+	/* Do colorspace distance matching */
+	return NearestColor(pal->colors, NULL, pal->ncolors, r, g, b);
+}
+
 /* Find the opaque pixel value corresponding to an RGB triple */
 Uint32 SDL_MapRGB
 (const SDL_PixelFormat * const format,
@@ -489,46 +776,93 @@ static Uint8 *Map1to1(SDL_Palette *src, SDL_Palette *dst, int *identical)
 	return(map);
 }
 /* Map from Palette to BitField */
-static Uint8 *Map1toN(SDL_PixelFormat *src, SDL_PixelFormat *dst)
+/* Map a range of palette entries to destination pixels */
+static void Map1toNColors(Uint8 *map, SDL_PixelFormat *src,
+                          SDL_PixelFormat *dst, int firstcolor, int ncolors)
 {
-	Uint8 *map;
 	int i;
 	int  bpp;
 	unsigned alpha;
 	SDL_Palette *pal = src->palette;
 
 	bpp = ((dst->BytesPerPixel == 3) ? 4 : dst->BytesPerPixel);
-	map = (Uint8 *) SDL_calloc(256, bpp);
-	if ( map == NULL ) {
-		SDL_OutOfMemory();
-		return(NULL);
-	}
-
 	alpha = dst->Amask ? src->alpha : 0;
 	/* We memory copy to the pixel map so the endianness is preserved */
-	for ( i=0; i<pal->ncolors; ++i ) {
+	for ( i=firstcolor; i<firstcolor+ncolors; ++i ) {
 		ASSEMBLE_RGBA(&map[i*bpp], dst->BytesPerPixel, dst,
 			      pal->colors[i].r, pal->colors[i].g,
 			      pal->colors[i].b, alpha);
 	}
+}
+static Uint8 *Map1toN(SDL_PixelFormat *src, SDL_PixelFormat *dst)
+{
+	Uint8 *map;
+	int  bpp;
+
+	/* One spare entry, so the blitters may read whole words */
+	bpp = ((dst->BytesPerPixel == 3) ? 4 : dst->BytesPerPixel);
+	map = (Uint8 *) SDL_calloc(256+1, bpp);
+	if ( map == NULL ) {
+		SDL_OutOfMemory();
+		return(NULL);
+	}
+	Map1toNColors(map, src, dst, 0, src->palette->ncolors);
 	return(map);
 }
-/* Map from BitField to Dithered-Palette to Palette */
+/* Map from BitField to Palette, through a 5-5-5 inverse colormap.  Each
+   entry is the palette color nearest to the middle of its RGB cell. */
 static Uint8 *MapNto1(SDL_PixelFormat *src, SDL_PixelFormat *dst, int *identical)
 {
-	/* Generate a 256 color dither palette */
-	SDL_Palette dithered;
-	SDL_Color colors[256];
 	SDL_Palette *pal = dst->palette;
-	
-	/* SDL_DitherColors does not initialize the 'unused' component of colors,
-	   but Map1to1 compares it against pal, so we should initialize it. */  
-	SDL_memset(colors, 0, sizeof(colors));
+	SDL_InverseMap *inv;
+	SDL_Color colors[256];
+	Uint8 *map;
+	int r, g, b;
 
-	dithered.ncolors = 256;
-	SDL_DitherColors(colors, 8);
-	dithered.colors = colors;
-	return(Map1to1(&dithered, pal, identical));
+	if ( identical ) {
+		/* SDL_DitherColors does not initialize the 'unused' component
+		   of colors, but we compare it against pal, so initialize it. */
+		SDL_memset(colors, 0, sizeof(colors));
+		SDL_DitherColors(colors, 8);
+		if ( pal->ncolors >= 256 &&
+		     SDL_memcmp(colors, pal->colors, sizeof(colors)) == 0 ) {
+			/* The blitters pack RGB 3-3-2 directly */
+			*identical = 1;
+			return(NULL);
+		}
+		*identical = 0;
+	}
+	map = (Uint8 *)SDL_malloc(32*32*32);
+	if ( map == NULL ) {
+		SDL_OutOfMemory();
+		return(NULL);
+	}
+	inv = GetInverseMap(pal);
+	for ( r = 0; r < 32; ++r ) {
+		for ( g = 0; g < 32; ++g ) {
+			for ( b = 0; b < 32; ++b ) {
+				Uint8 cr = (Uint8)((r << 3) | 4);
+				Uint8 cg = (Uint8)((g << 3) | 4);
+				Uint8 cb = (Uint8)((b << 3) | 4);
+				const Uint8 *list = NULL;
+				int n;
+
+				if ( inv ) {
+					list = InverseMapCell(inv, cr, cg, cb, &n);
+				}
+				if ( list ) {
+					map[INVMAP_INDEX(cr, cg, cb)] =
+					  NearestColor(inv->colors, list, n,
+					               cr, cg, cb);
+				} else {
+					map[INVMAP_INDEX(cr, cg, cb)] =
+					  NearestColor(pal->colors, NULL,
+					               pal->ncolors, cr, cg, cb);
+				}
+			}
+		}
+	}
+	return(map);
 }
 
 SDL_BlitMap *SDL_AllocBlitMap(void)
@@ -542,6 +876,9 @@ SDL_BlitMap *SDL_AllocBlitMap(void)
 		return(NULL);
 	}
 	SDL_memset(map, 0, sizeof(*map));
+	map->colormod.r = 255;
+	map->colormod.g = 255;
+	map->colormod.b = 255;
 
 	/* Allocate the software blit data */
 	map->sw_data = (struct private_swaccel *)SDL_malloc(sizeof(*map->sw_data));
@@ -555,11 +892,8 @@ SDL_BlitMap *SDL_AllocBlitMap(void)
 	/* It's ready to go */
 	return(map);
 }
-void SDL_InvalidateMap(SDL_BlitMap *map)
+static void SDL_ClearMap(SDL_BlitMap *map)
 {
-	if ( ! map ) {
-		return;
-	}
 	map->dst = NULL;
 	map->format_version = (unsigned int)-1;
 	if ( map->table ) {
@@ -567,18 +901,161 @@ void SDL_InvalidateMap(SDL_BlitMap *map)
 		map->table = NULL;
 	}
 }
+void SDL_InvalidateMap(SDL_BlitMap *map)
+{
+	int i;
+
+	if ( ! map ) {
+		return;
+	}
+	SDL_ClearMap(map);
+
+	/* The cached mappings were made for the old source state too */
+	for ( i = 0; i < SDL_BLITMAP_CACHE_SIZE; ++i ) {
+		if ( map->cache[i].table ) {
+			SDL_free(map->cache[i].table);
+		}
+	}
+	SDL_memset(map->cache, 0, sizeof(map->cache));
+}
+/*
+ * Move the current mapping of a surface into its cache of recently used
+ * destinations.  Only plain software mappings are kept, since hardware
+ * and RLE accelerated mappings hold state of their own.
+ */
+static void SDL_CacheMap(SDL_Surface *src)
+{
+	SDL_BlitMap *map = src->map;
+	SDL_BlitMapEntry *last = &map->cache[SDL_BLITMAP_CACHE_SIZE-1];
+
+	if ( ! map->dst || map->sw_blit != SDL_SoftBlit ||
+	     (src->flags & SDL_HWACCEL) == SDL_HWACCEL ) {
+		return;
+	}
+
+	/* Drop the least recently used mapping */
+	if ( last->table ) {
+		SDL_free(last->table);
+	}
+	SDL_memmove(&map->cache[1], &map->cache[0],
+	            (SDL_BLITMAP_CACHE_SIZE-1)*sizeof(map->cache[0]));
+
+	map->cache[0].dst = map->dst;
+	map->cache[0].format_version = map->format_version;
+	map->cache[0].identity = map->identity;
+	map->cache[0].table = map->table;
+	map->cache[0].table_format = map->table_format;
+	map->cache[0].blit = map->sw_data->blit;
+	map->cache[0].aux_data = map->sw_data->aux_data;
+	map->table = NULL;
+}
+/*
+ * Make a cached mapping to 'dst' current again, if there is one
+ */
+static int SDL_UncacheMap(SDL_Surface *src, SDL_Surface *dst)
+{
+	SDL_BlitMap *map = src->map;
+	SDL_BlitMapEntry *entry;
+	int i;
+
+	for ( i = 0; i < SDL_BLITMAP_CACHE_SIZE; ++i ) {
+		entry = &map->cache[i];
+		if ( entry->dst == dst &&
+		     entry->format_version == dst->format_version ) {
+			break;
+		}
+	}
+	if ( i == SDL_BLITMAP_CACHE_SIZE ) {
+		return(0);
+	}
+
+	map->dst = dst;
+	map->format_version = entry->format_version;
+	map->identity = entry->identity;
+	map->table = entry->table;
+	map->table_format = entry->table_format;
+	map->sw_data->blit = entry->blit;
+	map->sw_data->aux_data = entry->aux_data;
+	map->sw_blit = SDL_SoftBlit;
+	src->flags &= ~SDL_HWACCEL;
+
+	SDL_memmove(&map->cache[i], &map->cache[i+1],
+	            (SDL_BLITMAP_CACHE_SIZE-1-i)*sizeof(map->cache[0]));
+	SDL_memset(&map->cache[SDL_BLITMAP_CACHE_SIZE-1], 0,
+	           sizeof(map->cache[0]));
+	return(1);
+}
+/*
+ * Update the mappings of a palettized surface after some of its colors
+ * changed.  Mappings to surfaces which aren't palettized hold one pixel
+ * per color, so only the changed entries are rewritten.  Anything else
+ * is mapped again at the next blit, as after SDL_FormatChanged().
+ * The destination may have been freed already, so the table is remapped
+ * from the copy of its format made when the table was built.
+ */
+static int SDL_RemapColors(SDL_Surface *src, Uint8 *table,
+                           SDL_PixelFormat *dstfmt,
+                           int firstcolor, int ncolors)
+{
+	if ( table == NULL || dstfmt->BytesPerPixel == 1 ) {
+		return(0);
+	}
+	Map1toNColors(table, src->format, dstfmt, firstcolor, ncolors);
+	return(1);
+}
+void SDL_PaletteChanged(SDL_Surface *surface, int firstcolor, int ncolors)
+{
+	SDL_BlitMap *map = surface->map;
+	SDL_BlitMapEntry *entry;
+	int i;
+
+	if ( ! map || surface->format->BytesPerPixel != 1 ||
+	     (surface->flags & (SDL_HWACCEL|SDL_RLEACCEL)) ) {
+		SDL_FormatChanged(surface);
+		return;
+	}
+
+	/* Mappings onto this surface depend on the whole palette */
+	SDL_NewFormatVersion(surface);
+
+	if ( map->dst ) {
+		if ( map->sw_blit != SDL_SoftBlit ||
+		     ! SDL_RemapColors(surface, map->table, &map->table_format,
+		                       firstcolor, ncolors) ) {
+			SDL_ClearMap(map);
+		}
+	}
+	for ( i = 0; i < SDL_BLITMAP_CACHE_SIZE; ++i ) {
+		entry = &map->cache[i];
+		if ( entry->dst &&
+		     ! SDL_RemapColors(surface, entry->table,
+		                       &entry->table_format,
+		                       firstcolor, ncolors) ) {
+			if ( entry->table ) {
+				SDL_free(entry->table);
+			}
+			SDL_memset(entry, 0, sizeof(*entry));
+		}
+	}
+}
 int SDL_MapSurface (SDL_Surface *src, SDL_Surface *dst)
 {
 	SDL_PixelFormat *srcfmt;
 	SDL_PixelFormat *dstfmt;
 	SDL_BlitMap *map;
 
-	/* Clear out any previous mapping */
+	/* Clear out any previous mapping, keeping it for later if we can */
 	map = src->map;
+	SDL_CacheMap(src);
 	if ( (src->flags & SDL_RLEACCEL) == SDL_RLEACCEL ) {
 		SDL_UnRLESurface(src, 1);
 	}
-	SDL_InvalidateMap(map);
+	SDL_ClearMap(map);
+
+	/* We may have blitted to this destination recently */
+	if ( SDL_UncacheMap(src, dst) ) {
+		return(0);
+	}
 
 	/* Figure out what kind of mapping we're doing */
 	map->identity = 0;
@@ -638,6 +1115,8 @@ int SDL_MapSurface (SDL_Surface *src, SDL_Surface *dst)
 
 	map->dst = dst;
 	map->format_version = dst->format_version;
+	map->table_format = *dstfmt;
+	map->table_format.palette = NULL;
 
 	/* Choose your blitters wisely */
 	return(SDL_CalculateBlit(src));
@@ -31,6 +31,7 @@ extern SDL_PixelFormat *SDL_AllocFormat(int bpp,
 extern SDL_PixelFormat *SDL_ReallocFormat(SDL_Surface *surface, int bpp,
 		Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask);
 extern void SDL_FormatChanged(SDL_Surface *surface);
+extern void SDL_PaletteChanged(SDL_Surface *surface, int firstcolor, int ncolors);
 extern void SDL_FreeFormat(SDL_PixelFormat *format);
 
 /* Blit mapping functions */
@@ -41,6 +42,9 @@ extern void SDL_FreeBlitMap(SDL_BlitMap *map);
 
 /* Miscellaneous functions */
 extern Uint16 SDL_CalculatePitch(SDL_Surface *surface);
+extern void *SDL_AllocPixels(SDL_Surface *surface);
+extern void SDL_FreePixels(SDL_Surface *surface);
 extern void SDL_DitherColors(SDL_Color *colors, int bpp);
 extern Uint8 SDL_FindColor(SDL_Palette *pal, Uint8 r, Uint8 g, Uint8 b);
+extern void SDL_FreeInverseMaps(SDL_Palette *pal);
 extern void SDL_ApplyGamma(Uint16 *gamma, SDL_Color *colors, SDL_Color *output, int ncolors);
@@ -29,6 +29,14 @@
 
 #include "SDL_video.h"
 #include "SDL_blit.h"
+#include "SDL_pixels_c.h"
+#include "SDL_sysvideo.h"
+
+#include "SDL_cpuinfo.h"
+
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
 
 /* This isn't ready for general consumption yet - it should be folded
    into the general blitting mechanism.
@@ -213,21 +221,430 @@ void copy_row3(Uint8 *src, int src_w, Uint8 *dst, int dst_w)
 	}
 }
 
-/* Perform a stretch blit between two surfaces of the same format.
-   NOTE:  This function is not safe to call from multiple threads!
-*/
-int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
-                    SDL_Surface *dst, SDL_Rect *dstrect)
+/* Rows stretched by a whole number factor, every pixel is repeated */
+#define DEFINE_SCALE_ROW(name, type)				\
+static void name(type *src, int src_w, type *dst, int scale)	\
+{								\
+	int i, j;						\
+	type pixel;						\
+								\
+	for ( i=src_w; i>0; --i ) {				\
+		pixel = *src++;					\
+		for ( j=scale; j>0; --j ) {			\
+			*dst++ = pixel;				\
+		}						\
+	}							\
+}
+DEFINE_SCALE_ROW(scale_row1, Uint8)
+DEFINE_SCALE_ROW(scale_row2, Uint16)
+DEFINE_SCALE_ROW(scale_row4, Uint32)
+
+static void scale_row3(Uint8 *src, int src_w, Uint8 *dst, int scale)
+{
+	int i, j;
+
+	for ( i=src_w; i>0; --i ) {
+		for ( j=scale; j>0; --j ) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst += 3;
+		}
+		src += 3;
+	}
+}
+
+#if SDL_SSE2_INTRINSICS
+/* 2x, 3x and 4x pixel art scaling of 32-bit rows, 4 pixels at a time */
+SDL_TARGETING("sse2")
+static void scale_row4_SSE2(Uint32 *src, int src_w, Uint32 *dst, int scale)
+{
+	int n = src_w / 4;
+	__m128i v;
+
+	switch (scale) {
+	    case 2:
+		while ( n-- ) {
+			v = _mm_loadu_si128((__m128i *)src);
+			_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128((__m128i *)(dst+4), _mm_unpackhi_epi32(v, v));
+			src += 4;
+			dst += 8;
+		}
+		break;
+	    case 3:
+		while ( n-- ) {
+			v = _mm_loadu_si128((__m128i *)src);
+			_mm_storeu_si128((__m128i *)dst,
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)));
+			_mm_storeu_si128((__m128i *)(dst+4),
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)));
+			_mm_storeu_si128((__m128i *)(dst+8),
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)));
+			src += 4;
+			dst += 12;
+		}
+		break;
+	    case 4:
+		while ( n-- ) {
+			v = _mm_loadu_si128((__m128i *)src);
+			_mm_storeu_si128((__m128i *)dst,
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(0,0,0,0)));
+			_mm_storeu_si128((__m128i *)(dst+4),
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(1,1,1,1)));
+			_mm_storeu_si128((__m128i *)(dst+8),
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,2,2)));
+			_mm_storeu_si128((__m128i *)(dst+12),
+			                 _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,3)));
+			src += 4;
+			dst += 16;
+		}
+		break;
+	}
+	scale_row4(src, src_w % 4, dst, scale);
+}
+
+/* 2x and 4x pixel art scaling of 16-bit rows, 8 pixels at a time */
+SDL_TARGETING("sse2")
+static void scale_row2_SSE2(Uint16 *src, int src_w, Uint16 *dst, int scale)
+{
+	int n = src_w / 8;
+	__m128i v, lo, hi;
+
+	while ( n-- ) {
+		v = _mm_loadu_si128((__m128i *)src);
+		lo = _mm_unpacklo_epi16(v, v);
+		hi = _mm_unpackhi_epi16(v, v);
+		if ( scale == 2 ) {
+			_mm_storeu_si128((__m128i *)dst, lo);
+			_mm_storeu_si128((__m128i *)(dst+8), hi);
+		} else {
+			_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi32(lo, lo));
+			_mm_storeu_si128((__m128i *)(dst+8), _mm_unpackhi_epi32(lo, lo));
+			_mm_storeu_si128((__m128i *)(dst+16), _mm_unpacklo_epi32(hi, hi));
+			_mm_storeu_si128((__m128i *)(dst+24), _mm_unpackhi_epi32(hi, hi));
+		}
+		src += 8;
+		dst += 8*scale;
+	}
+	scale_row2(src, src_w % 8, dst, scale);
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+static void scale_row(Uint8 *src, int src_w, Uint8 *dst, int scale, int bpp)
+{
+	switch (bpp) {
+	    case 1:
+		scale_row1(src, src_w, dst, scale);
+		break;
+	    case 2:
+#if SDL_SSE2_INTRINSICS
+		if ( (scale == 2 || scale == 4) && SDL_HasSSE2() ) {
+			scale_row2_SSE2((Uint16 *)src, src_w, (Uint16 *)dst, scale);
+			break;
+		}
+#endif
+		scale_row2((Uint16 *)src, src_w, (Uint16 *)dst, scale);
+		break;
+	    case 3:
+		scale_row3(src, src_w, dst, scale);
+		break;
+	    case 4:
+#if SDL_SSE2_INTRINSICS
+		if ( scale <= 4 && SDL_HasSSE2() ) {
+			scale_row4_SSE2((Uint32 *)src, src_w, (Uint32 *)dst, scale);
+			break;
+		}
+#endif
+		scale_row4((Uint32 *)src, src_w, (Uint32 *)dst, scale);
+		break;
+	}
+}
+
+/* Stretch one row, 'xscale' is the whole number scale factor or 0 */
+static void stretch_row(Uint8 *src, int src_w, Uint8 *dst, int dst_w,
+                        int xscale, int bpp)
+{
+	if ( xscale == 1 ) {
+		SDL_memcpy(dst, src, dst_w*bpp);
+		return;
+	}
+	if ( xscale ) {
+		scale_row(src, src_w, dst, xscale, bpp);
+		return;
+	}
+	switch (bpp) {
+	    case 1:
+		copy_row1(src, src_w, dst, dst_w);
+		break;
+	    case 2:
+		copy_row2((Uint16 *)src, src_w, (Uint16 *)dst, dst_w);
+		break;
+	    case 3:
+		copy_row3(src, src_w, dst, dst_w);
+		break;
+	    case 4:
+		copy_row4((Uint32 *)src, src_w, (Uint32 *)dst, dst_w);
+		break;
+	}
+}
+
+/*
+ * Bilinear filtering, for 16 and 32 bpp surfaces.
+ *
+ * The two source rows around each destination row are first blended into
+ * a temporary row, then each destination pixel blends the two temporary
+ * pixels around it.  32-bit pixels are blended one byte at a time with
+ * 8 bits of weight, so any 8888 layout works.  16-bit 565 and 555 pixels
+ * are spread out to 32 bits as 00000GGGGGG00000RRRRR000000BBBBB (and the
+ * like), which leaves room to blend all three fields at once with 5 bits
+ * of weight.
+ */
+typedef struct {
+	int *x0;		/* left source pixel of each destination pixel */
+	int *fx;		/* weight of the right source pixel */
+	Uint16 *weights;	/* the same as 16-bit vector weights */
+	Uint32 *row;		/* the vertically blended source row */
+	Uint32 mask;		/* the spread 16-bit fields */
+} SDL_StretchLinearData;
+
+static __inline__ Uint32 lerp32(Uint32 a, Uint32 b, int f)
+{
+	Uint32 rb, ag;
+
+	rb = ((a & 0x00FF00FF) * (256 - f) + (b & 0x00FF00FF) * f) >> 8;
+	ag = ((a >> 8) & 0x00FF00FF) * (256 - f) + ((b >> 8) & 0x00FF00FF) * f;
+	return (rb & 0x00FF00FF) | (ag & 0xFF00FF00);
+}
+
+static __inline__ Uint32 spread16(Uint16 pixel, Uint32 mask)
+{
+	return ((Uint32)pixel | ((Uint32)pixel << 16)) & mask;
+}
+
+/* Source coordinate of each destination pixel center, in 16.16 fixed point */
+static void linear_positions(int src_w, int dst_w, int *pos, int *frac)
+{
+	int i, inc, x;
+
+	inc = (src_w << 16) / dst_w;
+	x = inc / 2 - 0x8000;
+	for ( i=0; i<dst_w; ++i, x += inc ) {
+		if ( x <= 0 ) {
+			pos[i] = 0;
+			frac[i] = 0;
+		} else if ( (x >> 16) >= src_w - 1 ) {
+			pos[i] = src_w - 1;
+			frac[i] = 0;
+		} else {
+			pos[i] = x >> 16;
+			frac[i] = (x >> 8) & 0xFF;
+		}
+	}
+}
+
+#if SDL_SSE2_INTRINSICS
+/* The same arithmetic as lerp32(), 4 pixels at a time */
+SDL_TARGETING("sse2")
+static void blend_rows4_SSE2(Uint32 *row0, Uint32 *row1, int w, int f,
+                             Uint32 *dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16((short)(256 - f));
+	const __m128i wb = _mm_set1_epi16((short)f);
+	__m128i a, b, lo, hi;
+	int i;
+
+	for ( i=0; i<w; i+=4 ) {
+		a = _mm_loadu_si128((__m128i *)(row0 + i));
+		b = _mm_loadu_si128((__m128i *)(row1 + i));
+		lo = _mm_add_epi16(
+		    _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), wa),
+		    _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wb));
+		hi = _mm_add_epi16(
+		    _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), wa),
+		    _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb));
+		lo = _mm_srli_epi16(lo, 8);
+		hi = _mm_srli_epi16(hi, 8);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+}
+
+SDL_TARGETING("sse2")
+static __m128i blend_pair_SSE2(const Uint32 *row, int x0, int x1,
+                               const Uint16 *w0, const Uint16 *w1)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i p, lo, hi;
+
+	/* p holds left0 right0 left1 right1 */
+	p = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(row + x0)),
+	                       _mm_loadl_epi64((const __m128i *)(row + x1)));
+	lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero),
+	                     _mm_loadu_si128((const __m128i *)w0));
+	hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero),
+	                     _mm_loadu_si128((const __m128i *)w1));
+	return _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+	                                    _mm_unpackhi_epi64(lo, hi)), 8);
+}
+
+SDL_TARGETING("sse2")
+static void blend_columns4_SSE2(SDL_StretchLinearData *data, Uint32 *dst,
+                                int w)
+{
+	const Uint32 *row = data->row;
+	const int *x0 = data->x0;
+	const Uint16 *weights = data->weights;
+	__m128i p01, p23;
+	int i;
+
+	for ( i=0; i<w; i+=4 ) {
+		p01 = blend_pair_SSE2(row, x0[i], x0[i+1],
+		                      weights + i*8, weights + (i+1)*8);
+		p23 = blend_pair_SSE2(row, x0[i+2], x0[i+3],
+		                      weights + (i+2)*8, weights + (i+3)*8);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(p01, p23));
+	}
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+static void blend_rows4(Uint32 *row0, Uint32 *row1, int w, int f, Uint32 *dst)
+{
+	int i = 0;
+
+#if SDL_SSE2_INTRINSICS
+	if ( SDL_HasSSE2() ) {
+		i = w & ~3;
+		blend_rows4_SSE2(row0, row1, i, f, dst);
+	}
+#endif
+	for ( ; i<w; ++i ) {
+		dst[i] = lerp32(row0[i], row1[i], f);
+	}
+}
+
+static void blend_columns4(SDL_StretchLinearData *data, Uint32 *dst, int w)
+{
+	const Uint32 *row = data->row;
+	int i = 0;
+
+#if SDL_SSE2_INTRINSICS
+	if ( SDL_HasSSE2() ) {
+		i = w & ~3;
+		blend_columns4_SSE2(data, dst, i);
+	}
+#endif
+	for ( ; i<w; ++i ) {
+		const Uint32 *p = row + data->x0[i];
+		dst[i] = lerp32(p[0], p[1], data->fx[i]);
+	}
+}
+
+static void stretch_row_linear2(SDL_StretchLinearData *data,
+                                Uint16 *row0, Uint16 *row1, int src_w, int fy,
+                                Uint16 *dst, int dst_w)
+{
+	const Uint32 mask = data->mask;
+	Uint32 *row = data->row;
+	Uint32 a, b;
+	int i, f;
+
+	f = fy >> 3;
+	for ( i=0; i<src_w; ++i ) {
+		a = spread16(row0[i], mask);
+		b = spread16(row1[i], mask);
+		row[i] = ((a * (32 - f) + b * f) >> 5) & mask;
+	}
+	row[src_w] = row[src_w-1];
+	for ( i=0; i<dst_w; ++i ) {
+		a = row[data->x0[i]];
+		b = row[data->x0[i]+1];
+		f = data->fx[i] >> 3;
+		a = ((a * (32 - f) + b * f) >> 5) & mask;
+		dst[i] = (Uint16)(a | (a >> 16));
+	}
+}
+
+static void stretch_row_linear4(SDL_StretchLinearData *data,
+                                Uint32 *row0, Uint32 *row1, int src_w, int fy,
+                                Uint32 *dst, int dst_w)
+{
+	blend_rows4(row0, row1, src_w, fy, data->row);
+	data->row[src_w] = data->row[src_w-1];
+	blend_columns4(data, dst, dst_w);
+}
+
+static int SDL_StretchLinear(SDL_Surface *src, SDL_Rect *srcrect,
+                             SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	SDL_StretchLinearData data;
+	const int bpp = dst->format->BytesPerPixel;
+	int *y0, *fy;
+	Uint8 *srcp, *nextp, *dstp;
+	int i, j;
+
+	data.x0 = (int *)SDL_malloc(2 * (dstrect->w + dstrect->h) * sizeof(int));
+	data.weights = (Uint16 *)SDL_malloc(8 * dstrect->w * sizeof(Uint16));
+	data.row = (Uint32 *)SDL_malloc((srcrect->w + 1) * sizeof(Uint32));
+	if ( !data.x0 || !data.weights || !data.row ) {
+		SDL_free(data.x0);
+		SDL_free(data.weights);
+		SDL_free(data.row);
+		SDL_OutOfMemory();
+		return(-1);
+	}
+	data.fx = data.x0 + dstrect->w;
+	y0 = data.fx + dstrect->w;
+	fy = y0 + dstrect->h;
+	data.mask = (dst->format->Gmask << 16) |
+	            (dst->format->Rmask | dst->format->Bmask);
+
+	linear_positions(srcrect->w, dstrect->w, data.x0, data.fx);
+	linear_positions(srcrect->h, dstrect->h, y0, fy);
+	for ( i=0; i<dstrect->w; ++i ) {
+		for ( j=0; j<4; ++j ) {
+			data.weights[i*8+j] = 256 - data.fx[i];
+			data.weights[i*8+4+j] = data.fx[i];
+		}
+	}
+
+	for ( i=0; i<dstrect->h; ++i ) {
+		srcp = (Uint8 *)src->pixels + ((srcrect->y+y0[i])*src->pitch)
+		                            + (srcrect->x*bpp);
+		nextp = srcp;
+		if ( y0[i] < srcrect->h - 1 ) {
+			nextp += src->pitch;
+		}
+		dstp = (Uint8 *)dst->pixels + ((dstrect->y+i)*dst->pitch)
+		                            + (dstrect->x*bpp);
+		if ( bpp == 2 ) {
+			stretch_row_linear2(&data, (Uint16 *)srcp, (Uint16 *)nextp,
+			                    srcrect->w, fy[i],
+			                    (Uint16 *)dstp, dstrect->w);
+		} else {
+			stretch_row_linear4(&data, (Uint32 *)srcp, (Uint32 *)nextp,
+			                    srcrect->w, fy[i],
+			                    (Uint32 *)dstp, dstrect->w);
+		}
+	}
+
+	SDL_free(data.x0);
+	SDL_free(data.weights);
+	SDL_free(data.row);
+	return(0);
+}
+
+static int SDL_StretchNearest(SDL_Surface *src, SDL_Rect *srcrect,
+                              SDL_Surface *dst, SDL_Rect *dstrect)
 {
-	int src_locked;
-	int dst_locked;
 	int pos, inc;
+	int xscale, yscale;
 	int dst_maxrow;
 	int src_row, dst_row;
 	Uint8 *srcp = NULL;
 	Uint8 *dstp;
-	SDL_Rect full_src;
-	SDL_Rect full_dst;
+	Uint8 *last_srcp = NULL;
+	Uint8 *last_dstp = NULL;
 #ifdef USE_ASM_STRETCH
 	SDL_bool use_asm = SDL_TRUE;
 #ifdef __GNUC__
@@ -236,10 +653,239 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 #endif /* USE_ASM_STRETCH */
 	const int bpp = dst->format->BytesPerPixel;
 
-	if ( src->format->BitsPerPixel != dst->format->BitsPerPixel ) {
+	/* Set up the data... */
+	pos = 0x10000;
+	inc = (srcrect->h << 16) / dstrect->h;
+	src_row = srcrect->y;
+	dst_row = dstrect->y;
+
+	/* Whole number scale factors repeat every pixel and row exactly */
+	xscale = 0;
+	if ( (dstrect->w % srcrect->w) == 0 ) {
+		xscale = dstrect->w / srcrect->w;
+	}
+	yscale = 0;
+	if ( (dstrect->h % srcrect->h) == 0 ) {
+		yscale = dstrect->h / srcrect->h;
+	}
+
+#ifdef USE_ASM_STRETCH
+	/* Write the opcodes for this stretch */
+	if ( (bpp == 3) || xscale ||
+	     (generate_rowbytes(srcrect->w, dstrect->w, bpp) < 0) ) {
+		use_asm = SDL_FALSE;
+	}
+#endif
+
+	/* Perform the stretch blit */
+	for ( dst_maxrow = dst_row+dstrect->h; dst_row<dst_maxrow; ++dst_row ) {
+		dstp = (Uint8 *)dst->pixels + (dst_row*dst->pitch)
+		                            + (dstrect->x*bpp);
+		if ( yscale ) {
+			src_row = srcrect->y + (dst_row - dstrect->y) / yscale;
+			srcp = (Uint8 *)src->pixels + (src_row*src->pitch)
+			                            + (srcrect->x*bpp);
+		} else {
+			while ( pos >= 0x10000L ) {
+				srcp = (Uint8 *)src->pixels + (src_row*src->pitch)
+				                            + (srcrect->x*bpp);
+				++src_row;
+				pos -= 0x10000L;
+			}
+			pos += inc;
+		}
+
+		/* Repeated source rows are copied from the row above */
+		if ( srcp == last_srcp ) {
+			SDL_memcpy(dstp, last_dstp, dstrect->w*bpp);
+			continue;
+		}
+		last_srcp = srcp;
+		last_dstp = dstp;
+
+#ifdef USE_ASM_STRETCH
+		if (use_asm) {
+#ifdef __GNUC__
+			__asm__ __volatile__ (
+			"call *%4"
+			: "=&D" (u1), "=&S" (u2)
+			: "0" (dstp), "1" (srcp), "r" (copy_row)
+			: "memory" );
+#elif defined(_MSC_VER)
+		{ void *code = copy_row;
+			__asm {
+				push edi
+				push esi
+	
+				mov edi, dstp
+				mov esi, srcp
+				call dword ptr code
+
+				pop esi
+				pop edi
+			}
+		}
+#else
+#error Need inline assembly for this compiler
+#endif
+		} else
+#endif
+		stretch_row(srcp, srcrect->w, dstp, dstrect->w, xscale, bpp);
+	}
+	return(0);
+}
+
+/* Stretch between different formats, or with colorkey or alpha, in one
+   pass: each source row is stretched into a temporary row in the source
+   format, which the regular blitter then converts onto the destination.
+*/
+static int SDL_StretchConvert(SDL_Surface *src, SDL_Rect *srcrect,
+                              SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	SDL_BlitInfo info;
+	SDL_loblit RunBlit;
+	int pos, inc;
+	int xscale, yscale;
+	int i, src_row;
+	int reuse_rows;
+	Uint8 *srcp = NULL;
+	Uint8 *last_srcp = NULL;
+	Uint8 *row;
+	const int sbpp = src->format->BytesPerPixel;
+	const int dbpp = dst->format->BytesPerPixel;
+
+	row = (Uint8 *)SDL_malloc(dstrect->w * sbpp);
+	if ( row == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+
+	/* Set up a one row blit from the temporary row */
+	info.s_pixels = row;
+	info.s_width = dstrect->w;
+	info.s_height = 1;
+	info.s_skip = 0;
+	info.d_width = dstrect->w;
+	info.d_height = 1;
+	info.d_skip = dst->pitch - dstrect->w*dbpp;
+	info.aux_data = src->map->sw_data->aux_data;
+	info.src = src->format;
+	info.table = src->map->table;
+	info.dst = dst->format;
+	info.colormod = &src->map->colormod;
+	RunBlit = src->map->sw_data->blit;
+
+	/* Unless the blit depends on what is already there, rows made
+	   from the same source row are the same */
+	reuse_rows = !(src->flags & SDL_SRCCOLORKEY) &&
+	             !((src->flags & SDL_SRCALPHA) &&
+	               (src->format->alpha != SDL_ALPHA_OPAQUE ||
+	                src->format->Amask));
+
+	pos = 0x10000;
+	inc = (srcrect->h << 16) / dstrect->h;
+	src_row = srcrect->y;
+	xscale = 0;
+	if ( (dstrect->w % srcrect->w) == 0 ) {
+		xscale = dstrect->w / srcrect->w;
+	}
+	yscale = 0;
+	if ( (dstrect->h % srcrect->h) == 0 ) {
+		yscale = dstrect->h / srcrect->h;
+	}
+
+	for ( i=0; i<dstrect->h; ++i ) {
+		info.d_pixels = (Uint8 *)dst->pixels
+		                + ((dstrect->y+i)*dst->pitch) + (dstrect->x*dbpp);
+		if ( yscale ) {
+			src_row = srcrect->y + i / yscale;
+			srcp = (Uint8 *)src->pixels + (src_row*src->pitch)
+			                            + (srcrect->x*sbpp);
+		} else {
+			while ( pos >= 0x10000L ) {
+				srcp = (Uint8 *)src->pixels + (src_row*src->pitch)
+				                            + (srcrect->x*sbpp);
+				++src_row;
+				pos -= 0x10000L;
+			}
+			pos += inc;
+		}
+		if ( srcp == last_srcp ) {
+			if ( reuse_rows ) {
+				SDL_memcpy(info.d_pixels, info.d_pixels - dst->pitch,
+				           dstrect->w*dbpp);
+				continue;
+			}
+		} else {
+			stretch_row(srcp, srcrect->w, row, dstrect->w, xscale, sbpp);
+			last_srcp = srcp;
+		}
+		RunBlit(&info);
+	}
+
+	SDL_free(row);
+	return(0);
+}
+
+static int SDL_StretchSurface(SDL_Surface *src, SDL_Rect *srcrect,
+                              SDL_Surface *dst, SDL_Rect *dstrect, int linear)
+{
+	int src_locked;
+	int dst_locked;
+	int retval;
+	int convert;
+	SDL_Rect full_src;
+	SDL_Rect full_dst;
+
+	/* Surfaces in different formats, or with colorkey or alpha blending,
+	   go through the blit mapping; otherwise the pixels are copied */
+	convert = !linear &&
+	          ((src->format->BitsPerPixel != dst->format->BitsPerPixel) ||
+	           (src->format->Rmask != dst->format->Rmask) ||
+	           (src->format->Gmask != dst->format->Gmask) ||
+	           (src->format->Bmask != dst->format->Bmask) ||
+	           (src->format->Amask != dst->format->Amask) ||
+	           (src->flags & (SDL_SRCCOLORKEY|SDL_SRCALPHA)));
+	if ( convert ) {
+		if ( (src->format->BitsPerPixel < 8) ||
+		     (dst->format->BitsPerPixel < 8) ) {
+			SDL_SetError("Stretch blits need at least 8 bpp surfaces");
+			return(-1);
+		}
+	} else if ( src->format->BitsPerPixel != dst->format->BitsPerPixel ) {
 		SDL_SetError("Only works with same format surfaces");
 		return(-1);
 	}
+	if ( linear ) {
+		SDL_PixelFormat *fmt = dst->format;
+		int supported;
+
+		switch (fmt->BytesPerPixel) {
+		    case 2:
+			supported = !fmt->Amask &&
+			    ((fmt->Gmask == 0x07E0 &&
+			      (fmt->Rmask|fmt->Gmask|fmt->Bmask) == 0xFFFF) ||
+			     (fmt->Gmask == 0x03E0 &&
+			      (fmt->Rmask|fmt->Gmask|fmt->Bmask) == 0x7FFF));
+			break;
+		    case 4:
+			supported = 1;
+			break;
+		    default:
+			supported = 0;
+			break;
+		}
+		if ( !supported ) {
+			SDL_SetError("Filtered stretch only works with 16 and 32 bpp surfaces");
+			return(-1);
+		}
+		if ( (src->format->Rmask != fmt->Rmask) ||
+		     (src->format->Gmask != fmt->Gmask) ||
+		     (src->format->Bmask != fmt->Bmask) ) {
+			SDL_SetError("Only works with same format surfaces");
+			return(-1);
+		}
+	}
 
 	/* Verify the blit rectangles */
 	if ( srcrect ) {
@@ -270,6 +916,20 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 		full_dst.h = dst->h;
 		dstrect = &full_dst;
 	}
+	if ( !srcrect->w || !srcrect->h || !dstrect->w || !dstrect->h ) {
+		return(0);
+	}
+	SDL_AddDamage(dst, dstrect);
+
+	/* Make sure the blit mapping is valid before locking the surfaces */
+	if ( convert ) {
+		if ( (src->map->dst != dst) ||
+		     (src->map->dst->format_version != src->map->format_version) ) {
+			if ( SDL_MapSurface(src, dst) < 0 ) {
+				return(-1);
+			}
+		}
+	}
 
 	/* Lock the destination if it's in hardware */
 	dst_locked = 0;
@@ -293,74 +953,12 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 		src_locked = 1;
 	}
 
-	/* Set up the data... */
-	pos = 0x10000;
-	inc = (srcrect->h << 16) / dstrect->h;
-	src_row = srcrect->y;
-	dst_row = dstrect->y;
-
-#ifdef USE_ASM_STRETCH
-	/* Write the opcodes for this stretch */
-	if ( (bpp == 3) ||
-	     (generate_rowbytes(srcrect->w, dstrect->w, bpp) < 0) ) {
-		use_asm = SDL_FALSE;
-	}
-#endif
-
-	/* Perform the stretch blit */
-	for ( dst_maxrow = dst_row+dstrect->h; dst_row<dst_maxrow; ++dst_row ) {
-		dstp = (Uint8 *)dst->pixels + (dst_row*dst->pitch)
-		                            + (dstrect->x*bpp);
-		while ( pos >= 0x10000L ) {
-			srcp = (Uint8 *)src->pixels + (src_row*src->pitch)
-			                            + (srcrect->x*bpp);
-			++src_row;
-			pos -= 0x10000L;
-		}
-#ifdef USE_ASM_STRETCH
-		if (use_asm) {
-#ifdef __GNUC__
-			__asm__ __volatile__ (
-			"call *%4"
-			: "=&D" (u1), "=&S" (u2)
-			: "0" (dstp), "1" (srcp), "r" (copy_row)
-			: "memory" );
-#elif defined(_MSC_VER)
-		{ void *code = copy_row;
-			__asm {
-				push edi
-				push esi
-	
-				mov edi, dstp
-				mov esi, srcp
-				call dword ptr code
-
-				pop esi
-				pop edi
-			}
-		}
-#else
-#error Need inline assembly for this compiler
-#endif
-		} else
-#endif
-		switch (bpp) {
-		    case 1:
-			copy_row1(srcp, srcrect->w, dstp, dstrect->w);
-			break;
-		    case 2:
-			copy_row2((Uint16 *)srcp, srcrect->w,
-			          (Uint16 *)dstp, dstrect->w);
-			break;
-		    case 3:
-			copy_row3(srcp, srcrect->w, dstp, dstrect->w);
-			break;
-		    case 4:
-			copy_row4((Uint32 *)srcp, srcrect->w,
-			          (Uint32 *)dstp, dstrect->w);
-			break;
-		}
-		pos += inc;
+	if ( linear ) {
+		retval = SDL_StretchLinear(src, srcrect, dst, dstrect);
+	} else if ( convert ) {
+		retval = SDL_StretchConvert(src, srcrect, dst, dstrect);
+	} else {
+		retval = SDL_StretchNearest(src, srcrect, dst, dstrect);
 	}
 
 	/* We need to unlock the surfaces if they're locked */
@@ -370,6 +968,26 @@ int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
 	if ( src_locked ) {
 		SDL_UnlockSurface(src);
 	}
-	return(0);
+	return(retval);
+}
+
+/* Perform a stretch blit between two surfaces.  Surfaces of the same
+   format are copied as is, otherwise the source is converted to the
+   destination format, honouring its colorkey and alpha settings.
+   NOTE:  This function is not safe to call from multiple threads!
+*/
+int SDL_SoftStretch(SDL_Surface *src, SDL_Rect *srcrect,
+                    SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	return SDL_StretchSurface(src, srcrect, dst, dstrect, 0);
+}
+
+/* Perform a bilinear filtered stretch blit between two 16 or 32 bpp
+   surfaces of the same format.
+*/
+int SDL_SoftStretchLinear(SDL_Surface *src, SDL_Rect *srcrect,
+                          SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	return SDL_StretchSurface(src, srcrect, dst, dstrect, 1);
 }
 
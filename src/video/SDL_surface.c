@@ -30,6 +30,10 @@
 #include "SDL_leaks.h"
 #include "SDL_cpuinfo.h"
 
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
+
 
 /* Public routines */
 /*
@@ -108,6 +112,12 @@ SDL_Surface * SDL_CreateRGBSurface (Uint32 flags,
 	if ( Amask ) {
 		surface->flags |= SDL_SRCALPHA;
 	}
+	if ( (flags & SDL_HWSURFACE) == SDL_SWSURFACE ) {
+		const char *align = SDL_getenv("SDL_SURFACE_ALIGN");
+		if ( (flags & SDL_CACHEALIGN) || (align && SDL_atoi(align)) ) {
+			surface->flags |= SDL_CACHEALIGN;
+		}
+	}
 	surface->w = width;
 	surface->h = height;
 	surface->pitch = SDL_CalculatePitch(surface);
@@ -124,7 +134,7 @@ SDL_Surface * SDL_CreateRGBSurface (Uint32 flags,
 	if ( ((flags&SDL_HWSURFACE) == SDL_SWSURFACE) || 
 				(video->AllocHWSurface(this, surface) < 0) ) {
 		if ( surface->w && surface->h ) {
-			surface->pixels = SDL_malloc(surface->h*surface->pitch);
+			surface->pixels = SDL_AllocPixels(surface);
 			if ( surface->pixels == NULL ) {
 				SDL_FreeSurface(surface);
 				SDL_OutOfMemory();
@@ -162,6 +172,7 @@ SDL_Surface * SDL_CreateRGBSurfaceFrom (void *pixels,
 	                               Rmask, Gmask, Bmask, Amask);
 	if ( surface != NULL ) {
 		surface->flags |= SDL_PREALLOC;
+		surface->flags &= ~SDL_CACHEALIGN;
 		surface->pixels = pixels;
 		surface->w = width;
 		surface->h = height;
@@ -227,21 +238,27 @@ int SDL_SetAlpha (SDL_Surface *surface, Uint32 flag, Uint8 value)
 {
 	Uint32 oldflags = surface->flags;
 	Uint32 oldalpha = surface->format->alpha;
+	Uint32 premul;
 
 	/* Sanity check the flag as it gets passed in */
 	if ( flag & SDL_SRCALPHA ) {
+		premul = (flag & SDL_SRCALPHA_PREMUL);
 		if ( flag & (SDL_RLEACCEL|SDL_RLEACCELOK) ) {
 			flag = (SDL_SRCALPHA | SDL_RLEACCELOK);
 		} else {
 			flag = SDL_SRCALPHA;
 		}
 	} else {
+		premul = 0;
 		flag = 0;
 	}
 
-	/* Optimize away operations that don't change anything */
+	/* Optimize away operations that don't change anything.
+	   SDL_SRCALPHA_PREMUL describes the pixels, so it is never
+	   cleared here, only by converting them. */
 	if ( (flag == (surface->flags & (SDL_SRCALPHA|SDL_RLEACCELOK))) &&
-	     (!flag || value == oldalpha) ) {
+	     (!flag || value == oldalpha) &&
+	     (!premul || (surface->flags & SDL_SRCALPHA_PREMUL)) ) {
 		return(0);
 	}
 
@@ -265,6 +282,7 @@ int SDL_SetAlpha (SDL_Surface *surface, Uint32 flag, Uint8 value)
 		} else {
 		        surface->flags &= ~SDL_RLEACCELOK;
 		}
+		surface->flags |= premul;
 	} else {
 		surface->flags &= ~SDL_SRCALPHA;
 		surface->format->alpha = SDL_ALPHA_OPAQUE;
@@ -281,6 +299,68 @@ int SDL_SetAlpha (SDL_Surface *surface, Uint32 flag, Uint8 value)
 		SDL_InvalidateMap(surface->map);
 	return(0);
 }
+int SDL_SetColorMod (SDL_Surface *surface, Uint32 flag, Uint8 r, Uint8 g, Uint8 b)
+{
+	Uint32 oldflags = surface->flags;
+
+	if ( flag & SDL_SRCCOLORMOD ) {
+		if ( surface->format->BytesPerPixel < 2 ) {
+			SDL_SetError("Color modulation needs 16 bits per pixel or more");
+			return(-1);
+		}
+		if ( surface->flags & SDL_RLEACCEL ) {
+			SDL_UnRLESurface(surface, 1);
+		}
+		surface->flags |= SDL_SRCCOLORMOD;
+	} else {
+		surface->flags &= ~SDL_SRCCOLORMOD;
+	}
+	surface->map->colormod.r = r;
+	surface->map->colormod.g = g;
+	surface->map->colormod.b = b;
+
+	/* The blitters read the modulation at blit time, so the mapping
+	   only changes when modulation is switched on or off */
+	if ( oldflags != surface->flags ) {
+		SDL_InvalidateMap(surface->map);
+	}
+	return(0);
+}
+void SDL_GetColorMod (SDL_Surface *surface, Uint8 *r, Uint8 *g, Uint8 *b)
+{
+	if ( r ) {
+		*r = surface->map->colormod.r;
+	}
+	if ( g ) {
+		*g = surface->map->colormod.g;
+	}
+	if ( b ) {
+		*b = surface->map->colormod.b;
+	}
+}
+/*
+ * Map a surface for blits to the display now, which RLE encodes it
+ * if it has asked for RLE acceleration
+ */
+int SDL_PrepareRLE (SDL_Surface *surface)
+{
+	SDL_Surface *screen = NULL;
+
+	if ( current_video ) {
+		screen = SDL_PublicSurface;
+	}
+	if ( screen == NULL ) {
+		SDL_SetError("No video mode has been set");
+		return(-1);
+	}
+	if ( (surface->map->dst != screen) ||
+	     (screen->format_version != surface->map->format_version) ) {
+		if ( SDL_MapSurface(surface, screen) < 0 ) {
+			return(-1);
+		}
+	}
+	return(0);
+}
 int SDL_SetAlphaChannel(SDL_Surface *surface, Uint8 value)
 {
 	int row, col;
@@ -411,6 +491,7 @@ int SDL_LowerBlit (SDL_Surface *src, SDL_Rect *srcrect,
 	SDL_blit do_blit;
 	SDL_Rect hw_srcrect;
 	SDL_Rect hw_dstrect;
+	SDL_Rect damage;
 
 	/* Check to make sure the blit mapping is valid */
 	if ( (src->map->dst != dst) ||
@@ -420,6 +501,12 @@ int SDL_LowerBlit (SDL_Surface *src, SDL_Rect *srcrect,
 		}
 	}
 
+	damage.x = dstrect->x;
+	damage.y = dstrect->y;
+	damage.w = srcrect->w;
+	damage.h = srcrect->h;
+	SDL_AddDamage(dst, &damage);
+
 	/* Figure out which blitter to use */
 	if ( (src->flags & SDL_HWACCEL) == SDL_HWACCEL ) {
 		if ( src == SDL_VideoSurface ) {
@@ -442,28 +529,16 @@ int SDL_LowerBlit (SDL_Surface *src, SDL_Rect *srcrect,
 }
 
 
-int SDL_UpperBlit (SDL_Surface *src, SDL_Rect *srcrect,
-		   SDL_Surface *dst, SDL_Rect *dstrect)
+/*
+ * Clip a blit to the source surface and the destination clip rectangle.
+ * The final destination rectangle is stored in 'dstrect' and the final
+ * source rectangle in 'sr'.  Returns 0 if there is nothing to blit.
+ */
+static int SDL_ClipBlit (SDL_Surface *src, const SDL_Rect *srcrect,
+			 SDL_Surface *dst, SDL_Rect *dstrect, SDL_Rect *sr)
 {
-        SDL_Rect fulldst;
 	int srcx, srcy, w, h;
 
-	/* Make sure the surfaces aren't locked */
-	if ( ! src || ! dst ) {
-		SDL_SetError("SDL_UpperBlit: passed a NULL surface");
-		return(-1);
-	}
-	if ( src->locked || dst->locked ) {
-		SDL_SetError("Surfaces must not be locked during blit");
-		return(-1);
-	}
-
-	/* If the destination rectangle is NULL, use the entire dest surface */
-	if ( dstrect == NULL ) {
-	        fulldst.x = fulldst.y = 0;
-		dstrect = &fulldst;
-	}
-
 	/* clip the source rectangle to the source surface */
 	if(srcrect) {
 	        int maxw, maxh;
@@ -523,17 +598,121 @@ int SDL_UpperBlit (SDL_Surface *src, SDL_Rect *srcrect,
 	}
 
 	if(w > 0 && h > 0) {
-	        SDL_Rect sr;
-	        sr.x = srcx;
-		sr.y = srcy;
-		sr.w = dstrect->w = w;
-		sr.h = dstrect->h = h;
-		return SDL_LowerBlit(src, &sr, dst, dstrect);
+	        sr->x = srcx;
+		sr->y = srcy;
+		sr->w = dstrect->w = w;
+		sr->h = dstrect->h = h;
+		return 1;
 	}
 	dstrect->w = dstrect->h = 0;
 	return 0;
 }
 
+int SDL_UpperBlit (SDL_Surface *src, SDL_Rect *srcrect,
+		   SDL_Surface *dst, SDL_Rect *dstrect)
+{
+        SDL_Rect fulldst;
+	SDL_Rect sr;
+
+	/* Make sure the surfaces aren't locked */
+	if ( ! src || ! dst ) {
+		SDL_SetError("SDL_UpperBlit: passed a NULL surface");
+		return(-1);
+	}
+	if ( src->locked || dst->locked ) {
+		SDL_SetError("Surfaces must not be locked during blit");
+		return(-1);
+	}
+
+	/* If the destination rectangle is NULL, use the entire dest surface */
+	if ( dstrect == NULL ) {
+	        fulldst.x = fulldst.y = 0;
+		dstrect = &fulldst;
+	}
+
+	if ( SDL_ClipBlit(src, srcrect, dst, dstrect, &sr) ) {
+		return SDL_LowerBlit(src, &sr, dst, dstrect);
+	}
+	return 0;
+}
+
+/*
+ * Blit many rectangles from one surface to another, for example tiles
+ * or glyphs from an atlas.  The blit mapping is checked and the surfaces
+ * are locked only once for the whole batch.
+ */
+int SDL_BlitSurfaceBatch (SDL_Surface *src, const SDL_Rect *srcrects,
+			  SDL_Surface *dst, SDL_Rect *dstrects, int n)
+{
+	SDL_Rect sr;
+	int i, status;
+
+	if ( ! src || ! dst ) {
+		SDL_SetError("SDL_BlitSurfaceBatch: passed a NULL surface");
+		return(-1);
+	}
+	if ( ! dstrects || n < 0 ) {
+		SDL_SetError("SDL_BlitSurfaceBatch: invalid rectangle list");
+		return(-1);
+	}
+	if ( src->locked || dst->locked ) {
+		SDL_SetError("Surfaces must not be locked during blit");
+		return(-1);
+	}
+	if ( n == 0 ) {
+		return(0);
+	}
+
+	/* Check to make sure the blit mapping is valid */
+	if ( (src->map->dst != dst) ||
+             (src->map->dst->format_version != src->map->format_version) ) {
+		if ( SDL_MapSurface(src, dst) < 0 ) {
+			return(-1);
+		}
+	}
+
+	/* Hardware and RLE blits take the rectangles one at a time */
+	if ( (src->flags & SDL_HWACCEL) == SDL_HWACCEL ||
+	     src->map->sw_blit != SDL_SoftBlit ) {
+		status = 0;
+		for ( i = 0; i < n; ++i ) {
+			if ( SDL_ClipBlit(src, srcrects ? &srcrects[i] : NULL,
+			                  dst, &dstrects[i], &sr) ) {
+				int retval = SDL_LowerBlit(src, &sr,
+				                           dst, &dstrects[i]);
+				if ( retval < 0 && status == 0 ) {
+					status = retval;
+				}
+			}
+		}
+		return(status);
+	}
+
+	if ( SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0 ) {
+		return(-1);
+	}
+	if ( SDL_MUSTLOCK(src) && SDL_LockSurface(src) < 0 ) {
+		if ( SDL_MUSTLOCK(dst) ) {
+			SDL_UnlockSurface(dst);
+		}
+		return(-1);
+	}
+	for ( i = 0; i < n; ++i ) {
+		if ( SDL_ClipBlit(src, srcrects ? &srcrects[i] : NULL,
+		                  dst, &dstrects[i], &sr) ) {
+			SDL_AddDamage(dst, &dstrects[i]);
+			SDL_SoftBlitRect(src, &sr, dst, &dstrects[i]);
+		}
+	}
+	if ( SDL_MUSTLOCK(src) ) {
+		SDL_UnlockSurface(src);
+	}
+	if ( SDL_MUSTLOCK(dst) ) {
+		SDL_UnlockSurface(dst);
+	}
+	return(0);
+}
+
 static int SDL_FillRect1(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 {
 	/* FIXME: We have to worry about packing order.. *sigh* */
@@ -548,61 +727,143 @@ static int SDL_FillRect4(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 	return -1;
 }
 
-/* 
- * This function performs a fast fill of the given rectangle with 'color'
+#if SDL_SSE2_INTRINSICS
+/*
+ * Vector fills.  The fill color is expanded into a byte pattern starting
+ * at the beginning of each row.  Since 48 and 96 are multiples of 1, 2,
+ * 3 and 4, three 16 byte or three 32 byte vectors taken at the right
+ * offsets into the pattern repeat along the row for every pixel size.
+ * The rows must be at least 64 bytes.  Very large fills use
+ * non-temporal stores so they don't flush the whole cache.
  */
-int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
+#define FILL_PATTERN_SIZE	128
+#define FILL_STREAM_BYTES	(8*1024*1024)
+
+static void SDL_FillPattern(Uint8 *pattern, int bpp, Uint32 color)
 {
-	SDL_VideoDevice *video = current_video;
-	SDL_VideoDevice *this  = current_video;
-	int x, y;
-	Uint8 *row;
+	int i;
 
-	/* This function doesn't work on surfaces < 8 bpp */
-	if ( dst->format->BitsPerPixel < 8 ) {
-		switch(dst->format->BitsPerPixel) {
-		    case 1:
-			return SDL_FillRect1(dst, dstrect, color);
-			break;
-		    case 4:
-			return SDL_FillRect4(dst, dstrect, color);
-			break;
-		    default:
-			SDL_SetError("Fill rect on unsupported surface format");
-			return(-1);
-			break;
-		}
+	for ( i = 0; i < FILL_PATTERN_SIZE; ++i ) {
+		pattern[i] = (Uint8)(color >> (8 * (i % bpp)));
 	}
+}
 
-	/* If 'dstrect' == NULL, then fill the whole surface */
-	if ( dstrect ) {
-		/* Perform clipping */
-		if ( !SDL_IntersectRect(dstrect, &dst->clip_rect, dstrect) ) {
-			return(0);
+SDL_TARGETING("sse2")
+static void SDL_FillRowsSSE2(Uint8 *row, int pitch, int bytes, int h,
+                             const Uint8 *pattern, int stream)
+{
+	const __m128i head = _mm_loadu_si128((const __m128i *)pattern);
+	const __m128i tail = _mm_loadu_si128((const __m128i *)
+	                                     (pattern + (bytes - 16) % 48));
+
+	while ( h-- ) {
+		Uint8 *dst = row;
+		int align = 16 - ((uintptr_t)dst & 15);
+		int n = bytes - align;
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(pattern + align));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)
+		                             (pattern + (align + 16) % 48));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)
+		                             (pattern + (align + 32) % 48));
+
+		_mm_storeu_si128((__m128i *)dst, head);
+		dst += align;
+		if ( stream ) {
+			for ( ; n >= 48; n -= 48, dst += 48 ) {
+				_mm_stream_si128((__m128i *)dst, v0);
+				_mm_stream_si128((__m128i *)(dst + 16), v1);
+				_mm_stream_si128((__m128i *)(dst + 32), v2);
+			}
+		} else {
+			for ( ; n >= 48; n -= 48, dst += 48 ) {
+				_mm_store_si128((__m128i *)dst, v0);
+				_mm_store_si128((__m128i *)(dst + 16), v1);
+				_mm_store_si128((__m128i *)(dst + 32), v2);
+			}
 		}
-	} else {
-		dstrect = &dst->clip_rect;
+		if ( n >= 16 ) {
+			_mm_store_si128((__m128i *)dst, v0);
+			dst += 16;
+			n -= 16;
+			if ( n >= 16 ) {
+				_mm_store_si128((__m128i *)dst, v1);
+				dst += 16;
+				n -= 16;
+			}
+		}
+		if ( n > 0 ) {
+			_mm_storeu_si128((__m128i *)(dst + n - 16), tail);
+		}
+		row += pitch;
+	}
+	if ( stream ) {
+		_mm_sfence();
 	}
+}
 
-	/* Check for hardware acceleration */
-	if ( ((dst->flags & SDL_HWSURFACE) == SDL_HWSURFACE) &&
-					video->info.blit_fill ) {
-		SDL_Rect hw_rect;
-		if ( dst == SDL_VideoSurface ) {
-			hw_rect = *dstrect;
-			hw_rect.x += current_video->offset_x;
-			hw_rect.y += current_video->offset_y;
-			dstrect = &hw_rect;
+SDL_TARGETING("avx2")
+static void SDL_FillRowsAVX2(Uint8 *row, int pitch, int bytes, int h,
+                             const Uint8 *pattern, int stream)
+{
+	const __m256i head = _mm256_loadu_si256((const __m256i *)pattern);
+	const __m256i tail = _mm256_loadu_si256((const __m256i *)
+	                                        (pattern + (bytes - 32) % 96));
+
+	while ( h-- ) {
+		Uint8 *dst = row;
+		int align = 32 - ((uintptr_t)dst & 31);
+		int n = bytes - align;
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(pattern + align));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)
+		                                (pattern + (align + 32) % 96));
+		__m256i v2 = _mm256_loadu_si256((const __m256i *)
+		                                (pattern + (align + 64) % 96));
+
+		_mm256_storeu_si256((__m256i *)dst, head);
+		dst += align;
+		if ( stream ) {
+			for ( ; n >= 96; n -= 96, dst += 96 ) {
+				_mm256_stream_si256((__m256i *)dst, v0);
+				_mm256_stream_si256((__m256i *)(dst + 32), v1);
+				_mm256_stream_si256((__m256i *)(dst + 64), v2);
+			}
+		} else {
+			for ( ; n >= 96; n -= 96, dst += 96 ) {
+				_mm256_store_si256((__m256i *)dst, v0);
+				_mm256_store_si256((__m256i *)(dst + 32), v1);
+				_mm256_store_si256((__m256i *)(dst + 64), v2);
+			}
 		}
-		return(video->FillHWRect(this, dst, dstrect, color));
+		if ( n >= 32 ) {
+			_mm256_store_si256((__m256i *)dst, v0);
+			dst += 32;
+			n -= 32;
+			if ( n >= 32 ) {
+				_mm256_store_si256((__m256i *)dst, v1);
+				dst += 32;
+				n -= 32;
+			}
+		}
+		if ( n > 0 ) {
+			_mm256_storeu_si256((__m256i *)(dst + n - 32), tail);
+		}
+		row += pitch;
 	}
-
-	/* Perform software fill */
-	if ( SDL_LockSurface(dst) != 0 ) {
-		return(-1);
+	if ( stream ) {
+		_mm_sfence();
 	}
-	row = (Uint8 *)dst->pixels+dstrect->y*dst->pitch+
-			dstrect->x*dst->format->BytesPerPixel;
+	_mm256_zeroupper();
+}
+#endif /* SDL_SSE2_INTRINSICS */
+
+/*
+ * Software fill of 'h' rows of 'w' pixels starting at 'row'
+ */
+static void SDL_FillRows(SDL_Surface *dst, Uint8 *row, int w, int h,
+                         Uint32 color)
+{
+	int x, y;
+
 #if SDL_ARM_NEON_BLITTERS
     if (SDL_HasNEON() && dst->format->BytesPerPixel != 3) {
         void FillRect8ARMNEONAsm(int32_t w, int32_t h, uint8_t *dst, int32_t dst_stride, uint8_t src);
@@ -610,18 +871,17 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
         void FillRect32ARMNEONAsm(int32_t w, int32_t h, uint32_t *dst, int32_t dst_stride, uint32_t src);
         switch (dst->format->BytesPerPixel) {
         case 1:
-            FillRect8ARMNEONAsm(dstrect->w, dstrect->h, (uint8_t *) row, dst->pitch >> 0, color);
+            FillRect8ARMNEONAsm(w, h, (uint8_t *) row, dst->pitch >> 0, color);
             break;
         case 2:
-            FillRect16ARMNEONAsm(dstrect->w, dstrect->h, (uint16_t *) row, dst->pitch >> 1, color);
+            FillRect16ARMNEONAsm(w, h, (uint16_t *) row, dst->pitch >> 1, color);
             break;
         case 4:
-            FillRect32ARMNEONAsm(dstrect->w, dstrect->h, (uint32_t *) row, dst->pitch >> 2, color);
+            FillRect32ARMNEONAsm(w, h, (uint32_t *) row, dst->pitch >> 2, color);
             break;
         }
 
-        SDL_UnlockSurface(dst);
-        return(0);
+        return;
     }
 #endif
 #if SDL_ARM_SIMD_BLITTERS
@@ -631,25 +891,39 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 		void FillRect32ARMSIMDAsm(int32_t w, int32_t h, uint32_t *dst, int32_t dst_stride, uint32_t src);
 		switch (dst->format->BytesPerPixel) {
 		case 1:
-			FillRect8ARMSIMDAsm(dstrect->w, dstrect->h, (uint8_t *) row, dst->pitch >> 0, color);
+			FillRect8ARMSIMDAsm(w, h, (uint8_t *) row, dst->pitch >> 0, color);
 			break;
 		case 2:
-			FillRect16ARMSIMDAsm(dstrect->w, dstrect->h, (uint16_t *) row, dst->pitch >> 1, color);
+			FillRect16ARMSIMDAsm(w, h, (uint16_t *) row, dst->pitch >> 1, color);
 			break;
 		case 4:
-			FillRect32ARMSIMDAsm(dstrect->w, dstrect->h, (uint32_t *) row, dst->pitch >> 2, color);
+			FillRect32ARMSIMDAsm(w, h, (uint32_t *) row, dst->pitch >> 2, color);
 			break;
 		}
 
-		SDL_UnlockSurface(dst);
-		return(0);
+		return;
+	}
+#endif
+#if SDL_SSE2_INTRINSICS
+	x = w*dst->format->BytesPerPixel;
+	if ( x >= 64 && SDL_HasSSE2() ) {
+		Uint8 pattern[FILL_PATTERN_SIZE];
+		int stream = ((Uint32)x * h >= FILL_STREAM_BYTES);
+
+		SDL_FillPattern(pattern, dst->format->BytesPerPixel, color);
+		if ( SDL_HasAVX2() ) {
+			SDL_FillRowsAVX2(row, dst->pitch, x, h, pattern, stream);
+		} else {
+			SDL_FillRowsSSE2(row, dst->pitch, x, h, pattern, stream);
+		}
+		return;
 	}
 #endif
 	if ( dst->format->palette || (color == 0) ) {
-		x = dstrect->w*dst->format->BytesPerPixel;
+		x = w*dst->format->BytesPerPixel;
 		if ( !color && !((uintptr_t)row&3) && !(x&3) && !(dst->pitch&3) ) {
 			int n = x >> 2;
-			for ( y=dstrect->h; y; --y ) {
+			for ( y=h; y; --y ) {
 				SDL_memset4(row, 0, n);
 				row += dst->pitch;
 			}
@@ -662,14 +936,14 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 			 * uncachable, so only use it on software surfaces
 			 */
 			if((dst->flags & SDL_HWSURFACE) == SDL_HWSURFACE) {
-				if(dstrect->w >= 8) {
+				if(w >= 8) {
 					/*
 					 * 64-bit stores are probably most
 					 * efficient to uncached video memory
 					 */
 					double fill;
 					SDL_memset(&fill, color, (sizeof fill));
-					for(y = dstrect->h; y; y--) {
+					for(y = h; y; y--) {
 						Uint8 *d = row;
 						unsigned n = x;
 						unsigned nn;
@@ -705,7 +979,7 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 					}
 				} else {
 					/* narrow boxes */
-					for(y = dstrect->h; y; y--) {
+					for(y = h; y; y--) {
 						Uint8 *d = row;
 						Uint8 c = color;
 						int n = x;
@@ -719,7 +993,7 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 			} else
 #endif /* __powerpc__ */
 			{
-				for(y = dstrect->h; y; y--) {
+				for(y = h; y; y--) {
 					SDL_memset(row, color, x);
 					row += dst->pitch;
 				}
@@ -728,11 +1002,11 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 	} else {
 		switch (dst->format->BytesPerPixel) {
 		    case 2:
-			for ( y=dstrect->h; y; --y ) {
+			for ( y=h; y; --y ) {
 				Uint16 *pixels = (Uint16 *)row;
 				Uint16 c = (Uint16)color;
 				Uint32 cc = (Uint32)c << 16 | c;
-				int n = dstrect->w;
+				int n = w;
 				if((uintptr_t)pixels & 3) {
 					*pixels++ = c;
 					n--;
@@ -749,9 +1023,9 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 			#if SDL_BYTEORDER == SDL_BIG_ENDIAN
 				color <<= 8;
 			#endif
-			for ( y=dstrect->h; y; --y ) {
+			for ( y=h; y; --y ) {
 				Uint8 *pixels = row;
-				for ( x=dstrect->w; x; --x ) {
+				for ( x=w; x; --x ) {
 					SDL_memcpy(pixels, &color, 3);
 					pixels += 3;
 				}
@@ -760,19 +1034,167 @@ int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
 			break;
 
 		    case 4:
-			for(y = dstrect->h; y; --y) {
-				SDL_memset4(row, color, dstrect->w);
+			for(y = h; y; --y) {
+				SDL_memset4(row, color, w);
 				row += dst->pitch;
 			}
 			break;
 		}
 	}
+}
+
+/* One horizontal band of a software fill */
+typedef struct {
+	SDL_Surface *dst;
+	Uint8 *row;
+	int w;
+	int h;
+	Uint32 color;
+} SDL_FillBandData;
+
+static void SDL_FillBand(void *data, int band, int nbands)
+{
+	SDL_FillBandData *fill = (SDL_FillBandData *)data;
+	int y, h;
+
+	y = (fill->h * band) / nbands;
+	h = (fill->h * (band + 1)) / nbands - y;
+	SDL_FillRows(fill->dst, fill->row + y * fill->dst->pitch,
+	             fill->w, h, fill->color);
+}
+
+/*
+ * Software fill of a clipped rectangle, the surface is locked
+ */
+static void SDL_SoftFillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
+{
+	Uint8 *row;
+	int bands;
+
+	row = (Uint8 *)dst->pixels+dstrect->y*dst->pitch+
+			dstrect->x*dst->format->BytesPerPixel;
+	bands = SDL_GetBlitBands(dstrect->w, dstrect->h);
+	if ( bands > 1 ) {
+		SDL_FillBandData fill;
+
+		fill.dst = dst;
+		fill.row = row;
+		fill.w = dstrect->w;
+		fill.h = dstrect->h;
+		fill.color = color;
+		SDL_RunBlitBands(SDL_FillBand, &fill, bands);
+	} else {
+		SDL_FillRows(dst, row, dstrect->w, dstrect->h, color);
+	}
+}
+
+/* 
+ * This function performs a fast fill of the given rectangle with 'color'
+ */
+int SDL_FillRect(SDL_Surface *dst, SDL_Rect *dstrect, Uint32 color)
+{
+	SDL_VideoDevice *video = current_video;
+	SDL_VideoDevice *this  = current_video;
+
+	/* This function doesn't work on surfaces < 8 bpp */
+	if ( dst->format->BitsPerPixel < 8 ) {
+		switch(dst->format->BitsPerPixel) {
+		    case 1:
+			return SDL_FillRect1(dst, dstrect, color);
+			break;
+		    case 4:
+			return SDL_FillRect4(dst, dstrect, color);
+			break;
+		    default:
+			SDL_SetError("Fill rect on unsupported surface format");
+			return(-1);
+			break;
+		}
+	}
+
+	/* If 'dstrect' == NULL, then fill the whole surface */
+	if ( dstrect ) {
+		/* Perform clipping */
+		if ( !SDL_IntersectRect(dstrect, &dst->clip_rect, dstrect) ) {
+			return(0);
+		}
+	} else {
+		dstrect = &dst->clip_rect;
+	}
+	SDL_AddDamage(dst, dstrect);
+
+	/* Check for hardware acceleration */
+	if ( ((dst->flags & SDL_HWSURFACE) == SDL_HWSURFACE) &&
+					video->info.blit_fill ) {
+		SDL_Rect hw_rect;
+		if ( dst == SDL_VideoSurface ) {
+			hw_rect = *dstrect;
+			hw_rect.x += current_video->offset_x;
+			hw_rect.y += current_video->offset_y;
+			dstrect = &hw_rect;
+		}
+		return(video->FillHWRect(this, dst, dstrect, color));
+	}
+
+	/* Perform software fill */
+	if ( SDL_LockSurface(dst) != 0 ) {
+		return(-1);
+	}
+	SDL_SoftFillRect(dst, dstrect, color);
 	SDL_UnlockSurface(dst);
 
 	/* We're done! */
 	return(0);
 }
 
+/*
+ * This function fills many rectangles with the same color, locking the
+ * surface only once for all of them
+ */
+int SDL_FillRects(SDL_Surface *dst, const SDL_Rect *rects, int n,
+                  Uint32 color)
+{
+	SDL_VideoDevice *video = current_video;
+	SDL_Rect rect;
+	int i, status;
+
+	if ( ! dst ) {
+		SDL_SetError("SDL_FillRects: passed a NULL surface");
+		return(-1);
+	}
+	if ( ! rects || n < 0 ) {
+		SDL_SetError("SDL_FillRects: invalid rectangle list");
+		return(-1);
+	}
+
+	/* Hardware and sub-byte fills take the rectangles one at a time */
+	if ( (dst->format->BitsPerPixel < 8) ||
+	     (((dst->flags & SDL_HWSURFACE) == SDL_HWSURFACE) &&
+					video->info.blit_fill) ) {
+		status = 0;
+		for ( i = 0; i < n; ++i ) {
+			rect = rects[i];
+			if ( SDL_FillRect(dst, &rect, color) < 0 ) {
+				status = -1;
+			}
+		}
+		return(status);
+	}
+
+	/* Perform software fill */
+	if ( SDL_LockSurface(dst) != 0 ) {
+		return(-1);
+	}
+	for ( i = 0; i < n; ++i ) {
+		if ( SDL_IntersectRect(&rects[i], &dst->clip_rect, &rect) ) {
+			SDL_AddDamage(dst, &rect);
+			SDL_SoftFillRect(dst, &rect, color);
+		}
+	}
+	SDL_UnlockSurface(dst);
+	return(0);
+}
+
 /*
  * Lock a surface to directly access the pixels
  */
@@ -828,6 +1250,42 @@ void SDL_UnlockSurface (SDL_Surface *surface)
 	}
 }
 
+/*
+ * Multiply the color channels of a surface with an alpha channel by its
+ * alpha, for blits with SDL_SRCALPHA_PREMUL.
+ */
+static int SDL_PremultiplySurface (SDL_Surface *surface)
+{
+	SDL_PixelFormat *fmt = surface->format;
+	int bpp = fmt->BytesPerPixel;
+	int x, y;
+
+	if ( SDL_MUSTLOCK(surface) ) {
+		if ( SDL_LockSurface(surface) < 0 ) {
+			return(-1);
+		}
+	}
+	for ( y = 0; y < surface->h; ++y ) {
+		Uint8 *buf = (Uint8 *)surface->pixels + y * surface->pitch;
+		for ( x = 0; x < surface->w; ++x ) {
+			Uint32 Pixel;
+			unsigned r, g, b, a;
+			DISEMBLE_RGBA(buf, bpp, fmt, Pixel, r, g, b, a);
+			if ( a != SDL_ALPHA_OPAQUE ) {
+				r = MULDIV255(r, a);
+				g = MULDIV255(g, a);
+				b = MULDIV255(b, a);
+				ASSEMBLE_RGBA(buf, bpp, fmt, r, g, b, a);
+			}
+			buf += bpp;
+		}
+	}
+	if ( SDL_MUSTLOCK(surface) ) {
+		SDL_UnlockSurface(surface);
+	}
+	return(0);
+}
+
 /* 
  * Convert a surface into the specified pixel format.
  */
@@ -837,6 +1295,7 @@ SDL_Surface * SDL_ConvertSurface (SDL_Surface *surface,
 	SDL_Surface *convert;
 	Uint32 colorkey = 0;
 	Uint8 alpha = 0;
+	SDL_Color colormod;
 	Uint32 surface_flags;
 	SDL_Rect bounds;
 
@@ -901,6 +1360,12 @@ SDL_Surface * SDL_ConvertSurface (SDL_Surface *surface,
 		}
 	}
 
+	/* Pass the color modulation on instead of applying it */
+	if ( surface_flags & SDL_SRCCOLORMOD ) {
+		colormod = surface->map->colormod;
+		SDL_SetColorMod(surface, 0, colormod.r, colormod.g, colormod.b);
+	}
+
 	/* Copy over the image data */
 	bounds.x = 0;
 	bounds.y = 0;
@@ -936,6 +1401,33 @@ SDL_Surface * SDL_ConvertSurface (SDL_Surface *surface,
 		}
 	}
 
+	if ( surface_flags & SDL_SRCCOLORMOD ) {
+		if ( convert != NULL && convert->format->BytesPerPixel >= 2 ) {
+			SDL_SetColorMod(convert, SDL_SRCCOLORMOD,
+					colormod.r, colormod.g, colormod.b);
+		}
+		SDL_SetColorMod(surface, SDL_SRCCOLORMOD,
+				colormod.r, colormod.g, colormod.b);
+	}
+
+	/* The copied pixels stay premultiplied if they keep their alpha */
+	if ( (surface_flags & SDL_SRCALPHA_PREMUL) && format->Amask ) {
+		convert->flags |= SDL_SRCALPHA_PREMUL;
+		SDL_InvalidateMap(convert->map);
+	}
+
+	/* Premultiply the converted pixels by alpha if requested */
+	if ( (flags & SDL_SRCALPHA_PREMUL) && format->Amask &&
+	     !(surface_flags & SDL_SRCALPHA_PREMUL) ) {
+		if ( SDL_PremultiplySurface(convert) < 0 ) {
+			SDL_FreeSurface(convert);
+			return(NULL);
+		}
+		SDL_SetAlpha(convert, SDL_SRCALPHA|SDL_SRCALPHA_PREMUL|
+			     (convert->flags & SDL_RLEACCELOK),
+			     convert->format->alpha);
+	}
+
 	/* We're ready to go! */
 	return(convert);
 }
@@ -975,7 +1467,7 @@ void SDL_FreeSurface (SDL_Surface *surface)
 	}
 	if ( surface->pixels &&
 	     ((surface->flags & SDL_PREALLOC) != SDL_PREALLOC) ) {
-		SDL_free(surface->pixels);
+		SDL_FreePixels(surface);
 	}
 	SDL_free(surface);
 #ifdef CHECK_LEAKS
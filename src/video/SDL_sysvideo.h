@@ -270,6 +270,12 @@ struct SDL_VideoDevice {
 	int offset_x;
 	int offset_y;
 	SDL_GrabMode input_grab;
+	SDL_Rect *update_rects;	/* merged rectangles for SDL_UpdateRects() */
+	int max_update_rects;
+	Uint8 *damage;		/* tiles drawn on since SDL_Flip(), or NULL */
+	SDL_Rect *damage_rects;
+	int damage_cols;
+	int damage_rows;
 
 	/* Driver information flags */
 	int handles_any_size;	/* Driver handles any size video mode */
@@ -428,4 +434,7 @@ extern int refresh_rate;
 #define SDL_ShadowSurface	(current_video->shadow)
 #define SDL_PublicSurface	(current_video->visible)
 
+/* Record an area of the screen drawn on by SDL, when tracking damage */
+extern void SDL_AddDamage(SDL_Surface *surface, const SDL_Rect *rect);
+
 #endif /* _SDL_sysvideo_h */
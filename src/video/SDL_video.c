@@ -152,6 +152,8 @@ void SDL_VideoQuit(void);
 void SDL_GL_UpdateRectsLock(SDL_VideoDevice* this, int numrects, SDL_Rect* rects);
 
 static SDL_GrabMode SDL_WM_GrabInputOff(void);
+static void SDL_AllocDamage(SDL_VideoDevice *video, SDL_Surface *screen);
+static void SDL_FreeDamage(SDL_VideoDevice *video);
 #if SDL_VIDEO_OPENGL
 static int lock_count = 0;
 #endif
@@ -273,6 +275,8 @@ int SDL_VideoInit (const char *driver_name, Uint32 flags)
 		SDL_VideoQuit();
 		return(-1);
 	}
+	/* The driver lays out the screen pixels, don't align them */
+	SDL_VideoSurface->flags &= ~SDL_CACHEALIGN;
 	SDL_PublicSurface = NULL;	/* Until SDL_SetVideoMode() */
 
 #if 0 /* Don't change the current palette - may be used by other programs.
@@ -296,6 +300,9 @@ int SDL_VideoInit (const char *driver_name, Uint32 flags)
 	}
 	SDL_CursorInit(flags & SDL_INIT_EVENTTHREAD);
 
+	/* Start the software blit workers, if they were asked for */
+	SDL_InitBlitThreads();
+
 	/* We're ready to go! */
 	return(0);
 }
@@ -642,6 +649,8 @@ SDL_Surface * SDL_SetVideoMode (int width, int height, int bpp, Uint32 flags)
 	}
 
 	/* Check the requested flags */
+	/* The driver lays out the screen pixels, don't align them */
+	flags &= ~SDL_CACHEALIGN;
 	/* There's no palette in > 8 bits-per-pixel mode */
 	if ( video_bpp > 8 ) {
 		flags &= ~SDL_HWPALETTE;
@@ -673,6 +682,7 @@ SDL_Surface * SDL_SetVideoMode (int width, int height, int bpp, Uint32 flags)
 	if ( SDL_PublicSurface != NULL ) {
 		SDL_PublicSurface = NULL;
 	}
+	SDL_FreeDamage(video);
 	if ( SDL_ShadowSurface != NULL ) {
 		SDL_Surface *ready_to_go;
 		ready_to_go = SDL_ShadowSurface;
@@ -933,6 +943,7 @@ SDL_Surface * SDL_SetVideoMode (int width, int height, int bpp, Uint32 flags)
 	video->info.vfmt = SDL_VideoSurface->format;
 	video->info.current_w = SDL_VideoSurface->w;
 	video->info.current_h = SDL_VideoSurface->h;
+	SDL_AllocDamage(video, SDL_PublicSurface);
 
 	/* We're done! */
 	return(SDL_PublicSurface);
@@ -973,6 +984,7 @@ SDL_Surface *SDL_DisplayFormatAlpha(SDL_Surface *surface)
 	SDL_PixelFormat *format;
 	SDL_Surface *converted;
 	Uint32 flags;
+	const char *premul;
 	/* default to ARGB8888 */
 	Uint32 amask = 0xff000000;
 	Uint32 rmask = 0x00ff0000;
@@ -1020,11 +1032,123 @@ SDL_Surface *SDL_DisplayFormatAlpha(SDL_Surface *surface)
 	format = SDL_AllocFormat(32, rmask, gmask, bmask, amask);
 	flags = SDL_PublicSurface->flags & SDL_HWSURFACE;
 	flags |= surface->flags & (SDL_SRCALPHA | SDL_RLEACCELOK);
+	premul = SDL_getenv("SDL_PREMULTIPLIED_ALPHA");
+	if ( premul && SDL_atoi(premul) ) {
+		flags |= SDL_SRCALPHA_PREMUL;
+	}
 	converted = SDL_ConvertSurface(surface, format, flags);
 	SDL_FreeFormat(format);
 	return(converted);
 }
 
+/*
+ * Damage tracking: when SDL_VIDEO_TRACK_DAMAGE is set, blits, fills and
+ * stretches onto the screen surface mark the tiles they touch, and
+ * SDL_Flip() on a single buffered screen only updates those tiles.
+ */
+#define DAMAGE_TILE_SHIFT	5	/* 32x32 pixel tiles */
+#define DAMAGE_TILE_SIZE	(1 << DAMAGE_TILE_SHIFT)
+
+static void SDL_FreeDamage(SDL_VideoDevice *video)
+{
+	if ( video->damage ) {
+		SDL_free(video->damage);
+		video->damage = NULL;
+	}
+	if ( video->damage_rects ) {
+		SDL_free(video->damage_rects);
+		video->damage_rects = NULL;
+	}
+	video->damage_cols = 0;
+	video->damage_rows = 0;
+}
+
+static void SDL_AllocDamage(SDL_VideoDevice *video, SDL_Surface *screen)
+{
+	const char *env;
+	int cols, rows;
+
+	SDL_FreeDamage(video);
+	env = SDL_getenv("SDL_VIDEO_TRACK_DAMAGE");
+	if ( !env || !SDL_atoi(env) ||
+	     (screen->flags & (SDL_OPENGL|SDL_OPENGLBLIT)) ) {
+		return;
+	}
+	cols = (screen->w + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+	rows = (screen->h + DAMAGE_TILE_SIZE - 1) >> DAMAGE_TILE_SHIFT;
+	video->damage = (Uint8 *)SDL_malloc(cols * rows);
+	video->damage_rects = (SDL_Rect *)SDL_malloc(
+		((cols + 1) / 2) * rows * sizeof(SDL_Rect));
+	if ( !video->damage || !video->damage_rects ) {
+		/* Not fatal, SDL_Flip() just updates the whole screen */
+		SDL_FreeDamage(video);
+		return;
+	}
+	video->damage_cols = cols;
+	video->damage_rows = rows;
+
+	/* The first flip shows the whole screen */
+	SDL_memset(video->damage, 1, cols * rows);
+}
+
+void SDL_AddDamage(SDL_Surface *surface, const SDL_Rect *rect)
+{
+	SDL_VideoDevice *video = current_video;
+	int x1, y1, x2, y2, y;
+
+	if ( !video || !video->damage || surface != SDL_PublicSurface ) {
+		return;
+	}
+	x1 = SDL_max(rect->x, 0);
+	y1 = SDL_max(rect->y, 0);
+	x2 = SDL_min(rect->x + rect->w, surface->w);
+	y2 = SDL_min(rect->y + rect->h, surface->h);
+	if ( x1 >= x2 || y1 >= y2 ) {
+		return;
+	}
+	x1 >>= DAMAGE_TILE_SHIFT;
+	y1 >>= DAMAGE_TILE_SHIFT;
+	x2 = (x2 - 1) >> DAMAGE_TILE_SHIFT;
+	y2 = (y2 - 1) >> DAMAGE_TILE_SHIFT;
+	for ( y = y1; y <= y2; ++y ) {
+		SDL_memset(&video->damage[y * video->damage_cols + x1],
+		           1, x2 - x1 + 1);
+	}
+}
+
+/* Update the tiles drawn on since the last flip, a row of tiles at a time */
+static void SDL_UpdateDamage(SDL_VideoDevice *video, SDL_Surface *screen)
+{
+	SDL_Rect *rects = video->damage_rects;
+	Uint8 *tiles = video->damage;
+	int x, y, start;
+	int numrects = 0;
+
+	for ( y = 0; y < video->damage_rows; ++y ) {
+		for ( x = 0; x < video->damage_cols; ++x ) {
+			if ( !tiles[x] ) {
+				continue;
+			}
+			start = x;
+			while ( x < video->damage_cols && tiles[x] ) {
+				++x;
+			}
+			rects[numrects].x = start << DAMAGE_TILE_SHIFT;
+			rects[numrects].y = y << DAMAGE_TILE_SHIFT;
+			rects[numrects].w = SDL_min(x << DAMAGE_TILE_SHIFT, screen->w)
+			                    - rects[numrects].x;
+			rects[numrects].h = SDL_min((y + 1) << DAMAGE_TILE_SHIFT, screen->h)
+			                    - rects[numrects].y;
+			++numrects;
+		}
+		tiles += video->damage_cols;
+	}
+	SDL_memset(video->damage, 0, video->damage_cols * video->damage_rows);
+	if ( numrects ) {
+		SDL_UpdateRects(screen, numrects, rects);
+	}
+}
+
 /*
  * Update a specific portion of the physical screen
  */
@@ -1051,6 +1175,115 @@ void SDL_UpdateRect(SDL_Surface *screen, Sint32 x, Sint32 y, Uint32 w, Uint32 h)
 		SDL_UpdateRects(screen, 1, &rect);
 	}
 }
+
+/*
+ * Merge a list of update rectangles into as few as are worth sending.
+ * Rectangles are clipped to the screen and widened to whole cache lines,
+ * then any two are joined when their union costs no more to update than
+ * both of them separately.  Once most of the screen is covered a single
+ * full screen update is made instead.
+ */
+#define UPDATE_RECT_COST	1024	/* per rectangle overhead, in pixels */
+#define UPDATE_FULL_COVERAGE	75	/* percent of the screen */
+
+/* Returns whether updating the union of two rectangles is cheaper */
+static int SDL_JoinRects(const SDL_Rect *a, const SDL_Rect *b, SDL_Rect *u)
+{
+	int x1 = SDL_min(a->x, b->x);
+	int y1 = SDL_min(a->y, b->y);
+	int x2 = SDL_max(a->x + a->w, b->x + b->w);
+	int y2 = SDL_max(a->y + a->h, b->y + b->h);
+
+	if ( (Uint32)(x2 - x1) * (y2 - y1) >
+	     (Uint32)a->w * a->h + (Uint32)b->w * b->h + UPDATE_RECT_COST ) {
+		return(0);
+	}
+	u->x = x1;
+	u->y = y1;
+	u->w = x2 - x1;
+	u->h = y2 - y1;
+	return(1);
+}
+
+static int SDL_CoalesceRects(SDL_VideoDevice *video, SDL_Surface *screen,
+                             int numrects, SDL_Rect **rects)
+{
+	SDL_Rect *merged;
+	SDL_Rect u;
+	int align;
+	int i, j, n;
+	int joined;
+	Uint32 area;
+
+	if ( numrects > video->max_update_rects ) {
+		merged = (SDL_Rect *)SDL_realloc(video->update_rects,
+		                                 numrects*sizeof(*merged));
+		if ( merged == NULL ) {
+			return(numrects);
+		}
+		video->update_rects = merged;
+		video->max_update_rects = numrects;
+	}
+	merged = video->update_rects;
+
+	/* Pixels per cache line, or a multiple of it for 24-bit */
+	align = 64 / screen->format->BytesPerPixel;
+	if ( screen->format->BytesPerPixel == 3 ) {
+		align = 64;
+	}
+
+	n = 0;
+	for ( i = 0; i < numrects; ++i ) {
+		int x1 = (*rects)[i].x;
+		int y1 = (*rects)[i].y;
+		int x2 = x1 + (*rects)[i].w;
+		int y2 = y1 + (*rects)[i].h;
+
+		if ( x1 < 0 ) x1 = 0;
+		if ( y1 < 0 ) y1 = 0;
+		if ( x2 > screen->w ) x2 = screen->w;
+		if ( y2 > screen->h ) y2 = screen->h;
+		if ( x1 >= x2 || y1 >= y2 ) {
+			continue;
+		}
+		x1 &= ~(align - 1);
+		x2 = SDL_min((x2 + align - 1) & ~(align - 1), screen->w);
+		merged[n].x = x1;
+		merged[n].y = y1;
+		merged[n].w = x2 - x1;
+		merged[n].h = y2 - y1;
+		++n;
+	}
+
+	do {
+		joined = 0;
+		for ( i = 0; i < n; ++i ) {
+			for ( j = i + 1; j < n; ++j ) {
+				if ( SDL_JoinRects(&merged[i], &merged[j], &u) ) {
+					merged[i] = u;
+					merged[j] = merged[--n];
+					joined = 1;
+					j = i;
+				}
+			}
+		}
+	} while ( joined );
+
+	area = 0;
+	for ( i = 0; i < n; ++i ) {
+		area += (Uint32)merged[i].w * merged[i].h;
+	}
+	if ( area * 100 >= (Uint32)screen->w * screen->h * UPDATE_FULL_COVERAGE ) {
+		merged[0].x = 0;
+		merged[0].y = 0;
+		merged[0].w = screen->w;
+		merged[0].h = screen->h;
+		n = 1;
+	}
+	*rects = merged;
+	return(n);
+}
+
 void SDL_UpdateRects (SDL_Surface *screen, int numrects, SDL_Rect *rects)
 {
 	int i;
@@ -1061,6 +1294,12 @@ void SDL_UpdateRects (SDL_Surface *screen, int numrects, SDL_Rect *rects)
 		SDL_SetError("OpenGL active, use SDL_GL_SwapBuffers()");
 		return;
 	}
+	if ( numrects > 1 ) {
+		numrects = SDL_CoalesceRects(video, screen, numrects, &rects);
+		if ( numrects == 0 ) {
+			return;
+		}
+	}
 	if ( screen == SDL_ShadowSurface ) {
 		/* Blit the shadow surface using saved mapping */
 		SDL_Palette *pal = screen->format->palette;
@@ -1122,6 +1361,13 @@ void SDL_UpdateRects (SDL_Surface *screen, int numrects, SDL_Rect *rects)
 int SDL_Flip(SDL_Surface *screen)
 {
 	SDL_VideoDevice *video = current_video;
+
+	/* Only update what was drawn on, if we're keeping track */
+	if ( video->damage && screen == SDL_PublicSurface &&
+	     !(SDL_VideoSurface->flags & SDL_DOUBLEBUF) ) {
+		SDL_UpdateDamage(video, screen);
+		return(0);
+	}
 	/* Copy the shadow surface to the video surface */
 	if ( screen == SDL_ShadowSurface ) {
 		SDL_Rect rect;
@@ -1194,7 +1440,7 @@ static void SetPalette_logical(SDL_Surface *screen, SDL_Color *colors,
 			       ncolors * sizeof(*colors));
 		}
 	}
-	SDL_FormatChanged(screen);
+	SDL_PaletteChanged(screen, firstcolor, ncolors);
 }
 
 static int SetPalette_physical(SDL_Surface *screen,
@@ -1222,11 +1468,9 @@ static int SetPalette_physical(SDL_Surface *screen,
 		} else {
 			/*
 			 * The video surface is not indexed - invalidate any
-			 * active shadow-to-video blit mappings.
+			 * active or cached shadow-to-video blit mappings.
 			 */
-			if ( screen->map->dst == SDL_VideoSurface ) {
-				SDL_InvalidateMap(screen->map);
-			}
+			SDL_InvalidateMap(screen->map);
 			if ( video->gamma ) {
 				if( ! video->gammacols ) {
 					SDL_Palette *pp = video->physpal;
@@ -1369,6 +1613,12 @@ void SDL_VideoQuit (void)
 		/* Halt event processing before doing anything else */
 		SDL_StopEventLoop();
 
+		/* Stop the software blit workers */
+		SDL_QuitBlitThreads();
+
+		/* Drop the cached inverse colormaps */
+		SDL_FreeInverseMaps(NULL);
+
 		/* Clean up allocated window manager items */
 		if ( SDL_PublicSurface ) {
 			SDL_PublicSurface = NULL;
@@ -1414,6 +1664,12 @@ void SDL_VideoQuit (void)
 			SDL_free(video->wm_icon);
 			video->wm_icon = NULL;
 		}
+		SDL_FreeDamage(video);
+		if ( video->update_rects != NULL ) {
+			SDL_free(video->update_rects);
+			video->update_rects = NULL;
+			video->max_update_rects = 0;
+		}
 
 		/* Finish cleaning up video subsystem */
 		video->free(this);
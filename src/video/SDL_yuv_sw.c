@@ -85,10 +85,14 @@
 
 #include "SDL_video.h"
 #include "SDL_cpuinfo.h"
-#include "SDL_stretch_c.h"
+#include "SDL_blit.h"
 #include "SDL_yuvfuncs.h"
 #include "SDL_yuv_sw_c.h"
 
+#if SDL_SSE2_INTRINSICS
+#include <immintrin.h>
+#endif
+
 /* The functions used to manipulate software video overlays */
 static struct private_yuvhwfuncs sw_yuvfuncs = {
 	SDL_LockYUV_SW,
@@ -99,7 +103,6 @@ static struct private_yuvhwfuncs sw_yuvfuncs = {
 
 /* RGB conversion lookup tables */
 struct private_yuvhwdata {
-	SDL_Surface *stretch;
 	SDL_Surface *display;
 	Uint8 *pixels;
 	int *colortab;
@@ -113,6 +116,13 @@ struct private_yuvhwdata {
                           unsigned char *cb, unsigned char *out,
                           int rows, int cols, int mod );
 
+	/* Scratch rows and column map for scaled display */
+	int bilinear;
+	Uint8 *rowbuf;
+	int rowbuf_size;
+	int *colmap;
+	int colmap_size;
+
 	/* These are just so we don't have to allocate them separately */
 	Uint16 pitches[3];
 	Uint8 *planes[3];
@@ -791,7 +801,7 @@ static void Color16DitherYUY2Mod2X( int *colortab, Uint32 *rgb_2_pix,
             row++;
 
         }
-        row += next_row;
+        row += next_row + (mod/2);
     }
 }
 
@@ -847,7 +857,7 @@ static void Color24DitherYUY2Mod2X( int *colortab, Uint32 *rgb_2_pix,
             row += 2*3;
 
         }
-        row += next_row;
+        row += next_row + mod*3;
     }
 }
 
@@ -863,7 +873,6 @@ static void Color32DitherYUY2Mod2X( int *colortab, Uint32 *rgb_2_pix,
     int crb_g;
     int cb_b;
     int cols_2 = cols / 2;
-    mod+=mod;
     y = rows;
     while( y-- )
     {
@@ -895,7 +904,7 @@ static void Color32DitherYUY2Mod2X( int *colortab, Uint32 *rgb_2_pix,
 
         }
 
-        row += next_row;
+        row += next_row + mod;
     }
 }
 
@@ -923,6 +932,1208 @@ static int free_bits_at_bottom( Uint32 a )
 }
 
 
+static __inline__ void YUVStorePixel(Uint8 *dst, int bpp, Uint32 value)
+{
+	switch (bpp) {
+	    case 2:
+		*(Uint16 *)dst = (Uint16)value;
+		break;
+	    case 3:
+		dst[0] = (value      ) & 0xFF;
+		dst[1] = (value >>  8) & 0xFF;
+		dst[2] = (value >> 16) & 0xFF;
+		break;
+	    default:
+		*(Uint32 *)dst = value;
+		break;
+	}
+}
+
+/* Convert pixel pairs through the lookup tables, with arbitrary sample steps */
+static void YUVRowTail(int *colortab, Uint32 *rgb_2_pix,
+                       const Uint8 *lum, int lstep,
+                       const Uint8 *cr, const Uint8 *cb, int cstep,
+                       Uint8 *out, int pairs, int bpp, int scale, int pitch)
+{
+	while ( pairs-- ) {
+		int cr_r  = 0*768+256 + colortab[ *cr + 0*256 ];
+		int crb_g = 1*768+256 + colortab[ *cr + 1*256 ]
+		                      + colortab[ *cb + 2*256 ];
+		int cb_b  = 2*768+256 + colortab[ *cb + 3*256 ];
+		int i, j;
+
+		cr += cstep;
+		cb += cstep;
+		for ( i = 0; i < 2; ++i ) {
+			int L = *lum;
+			Uint32 value = (rgb_2_pix[ L + cr_r ] |
+			                rgb_2_pix[ L + crb_g ] |
+			                rgb_2_pix[ L + cb_b ]);
+			lum += lstep;
+			for ( j = 0; j < scale; ++j ) {
+				YUVStorePixel(out, bpp, value);
+				if ( scale == 2 ) {
+					YUVStorePixel(out + pitch, bpp, value);
+				}
+				out += bpp;
+			}
+		}
+	}
+}
+
+/* Semi-planar NV12 and NV21, chroma pairs interleaved in a single plane */
+static void ColorNV12(int *colortab, Uint32 *rgb_2_pix,
+                      unsigned char *lum, unsigned char *cr,
+                      unsigned char *cb, unsigned char *out,
+                      int rows, int cols, int mod, int bpp, int scale)
+{
+	const int pitch = (cols*scale + mod) * bpp;
+	const int cols_2 = cols / 2;
+	int row;
+
+	for ( row = rows / 2; row--; ) {
+		YUVRowTail(colortab, rgb_2_pix, lum, 1, cr, cb, 2,
+		           out, cols_2, bpp, scale, pitch);
+		YUVRowTail(colortab, rgb_2_pix, lum + cols, 1, cr, cb, 2,
+		           out + scale*pitch, cols_2, bpp, scale, pitch);
+
+		lum += 2*cols;
+		cr += 2*cols_2;
+		cb += 2*cols_2;
+		out += 2*scale*pitch;
+	}
+}
+
+#define YUV_CONVERT_FUNC(name, func, bpp, scale) \
+static void name( int *colortab, Uint32 *rgb_2_pix, \
+                  unsigned char *lum, unsigned char *cr, \
+                  unsigned char *cb, unsigned char *out, \
+                  int rows, int cols, int mod ) \
+{ \
+	func(colortab, rgb_2_pix, lum, cr, cb, out, rows, cols, mod, bpp, scale); \
+}
+YUV_CONVERT_FUNC(Color16NV12_1X, ColorNV12, 2, 1)
+YUV_CONVERT_FUNC(Color16NV12_2X, ColorNV12, 2, 2)
+YUV_CONVERT_FUNC(Color24NV12_1X, ColorNV12, 3, 1)
+YUV_CONVERT_FUNC(Color24NV12_2X, ColorNV12, 3, 2)
+YUV_CONVERT_FUNC(Color32NV12_1X, ColorNV12, 4, 1)
+YUV_CONVERT_FUNC(Color32NV12_2X, ColorNV12, 4, 2)
+
+#if SDL_SSE2_INTRINSICS
+/* SSE2 and AVX2 colorspace conversion.
+ *
+ * The chroma offsets are computed with fixed point multipliers which
+ * truncate exactly like the (int) casts used to build the lookup tables
+ * below, and the channels are clamped with saturating packs, so these
+ * produce the same pixels as the C converters.  The channel layout of the
+ * display is recovered from the last entry of each rgb_2_pix table, which
+ * holds the channel mask.  Pixel pairs left over at the end of a row go
+ * through the lookup tables.
+ */
+#define YUV_CR_R	717	/* (0.419/0.299) << 9,  applied to |Cr| << 7 */
+#define YUV_CR_G	731	/* (0.299/0.419) << 10, applied to |Cr| << 6 */
+#define YUV_CB_G	2821	/* (0.114/0.331) << 13, applied to |Cb| << 3 */
+#define YUV_CB_B	29055	/* (0.587/0.331) << 14, applied to |Cb| << 2 */
+
+typedef struct {
+	__m128i loss[3];
+	__m128i shift[3];
+	int bytewise;	/* 8-bit channels on byte boundaries, 24/32 bpp */
+	int byte[3];
+} YUVLayout;
+
+SDL_TARGETING("sse2")
+static void GetYUVLayout(Uint32 *rgb_2_pix, int bpp, YUVLayout *layout)
+{
+	int i;
+
+	layout->bytewise = (bpp >= 3);
+	for ( i = 0; i < 3; ++i ) {
+		Uint32 mask = rgb_2_pix[i*768+511];
+		int loss, shift;
+		if ( bpp == 2 ) {
+			mask &= 0xFFFF;
+		}
+		loss = 8 - number_of_bits_set(mask);
+		shift = free_bits_at_bottom(mask);
+		layout->loss[i] = _mm_cvtsi32_si128(loss);
+		layout->shift[i] = _mm_cvtsi32_si128(shift);
+		layout->byte[i] = shift / 8;
+		if ( loss != 0 || (shift % 8) != 0 || shift >= bpp*8 ) {
+			layout->bytewise = 0;
+		}
+	}
+}
+
+/* Eight chroma pairs, as 16-bit values, to the R, G and B offsets */
+SDL_TARGETING("sse2")
+static __inline__ void YUVChromaSSE2(__m128i cr, __m128i cb, __m128i terms[3])
+{
+	__m128i bias = _mm_set1_epi16(128);
+	__m128i crs, cbs, r, g1, g2, b;
+
+	cr = _mm_sub_epi16(cr, bias);
+	cb = _mm_sub_epi16(cb, bias);
+	crs = _mm_srai_epi16(cr, 15);
+	cbs = _mm_srai_epi16(cb, 15);
+	cr = _mm_sub_epi16(_mm_xor_si128(cr, crs), crs);
+	cb = _mm_sub_epi16(_mm_xor_si128(cb, cbs), cbs);
+
+	r  = _mm_mulhi_epu16(_mm_slli_epi16(cr, 7), _mm_set1_epi16(YUV_CR_R));
+	g1 = _mm_mulhi_epu16(_mm_slli_epi16(cr, 6), _mm_set1_epi16(YUV_CR_G));
+	g2 = _mm_mulhi_epu16(_mm_slli_epi16(cb, 3), _mm_set1_epi16(YUV_CB_G));
+	b  = _mm_mulhi_epu16(_mm_slli_epi16(cb, 2), _mm_set1_epi16((short)YUV_CB_B));
+
+	/* Restore the signs, the green offsets are negated */
+	terms[0] = _mm_sub_epi16(_mm_xor_si128(r, crs), crs);
+	terms[1] = _mm_add_epi16(_mm_sub_epi16(_mm_xor_si128(g1, crs), crs),
+	                         _mm_sub_epi16(_mm_xor_si128(g2, cbs), cbs));
+	terms[1] = _mm_sub_epi16(_mm_setzero_si128(), terms[1]);
+	terms[2] = _mm_sub_epi16(_mm_xor_si128(b, cbs), cbs);
+}
+
+/* Add the chroma offsets to sixteen 16-bit luma values */
+SDL_TARGETING("sse2")
+static __inline__ void YUVLumaSSE2(__m128i ylo, __m128i yhi,
+                                   const __m128i terms[3], __m128i rgb[3])
+{
+	int i;
+
+	for ( i = 0; i < 3; ++i ) {
+		__m128i lo = _mm_unpacklo_epi16(terms[i], terms[i]);
+		__m128i hi = _mm_unpackhi_epi16(terms[i], terms[i]);
+		rgb[i] = _mm_packus_epi16(_mm_add_epi16(ylo, lo),
+		                          _mm_add_epi16(yhi, hi));
+	}
+}
+
+/* Shift and combine widened channels into display pixels */
+SDL_TARGETING("sse2")
+static __inline__ __m128i YUVPack16SSE2(__m128i r, __m128i g, __m128i b,
+                                        const YUVLayout *layout)
+{
+	r = _mm_sll_epi16(_mm_srl_epi16(r, layout->loss[0]),
+	                  layout->shift[0]);
+	g = _mm_sll_epi16(_mm_srl_epi16(g, layout->loss[1]),
+	                  layout->shift[1]);
+	b = _mm_sll_epi16(_mm_srl_epi16(b, layout->loss[2]),
+	                  layout->shift[2]);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+SDL_TARGETING("sse2")
+static __inline__ __m128i YUVPack32SSE2(__m128i r, __m128i g, __m128i b,
+                                        const YUVLayout *layout)
+{
+	r = _mm_sll_epi32(_mm_srl_epi32(r, layout->loss[0]),
+	                  layout->shift[0]);
+	g = _mm_sll_epi32(_mm_srl_epi32(g, layout->loss[1]),
+	                  layout->shift[1]);
+	b = _mm_sll_epi32(_mm_srl_epi32(b, layout->loss[2]),
+	                  layout->shift[2]);
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+/* Write sixteen pixels held as R, G and B bytes */
+SDL_TARGETING("sse2")
+static __inline__ void YUVStoreSSE2(Uint8 *dst, const __m128i rgb[3], int bpp,
+                                    const YUVLayout *layout)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i c16[2][3];
+	__m128i pixels[4];
+	int i, j;
+
+	if ( layout->bytewise ) {
+		/* Interleave the channel bytes directly */
+		__m128i c[4], lo, hi;
+
+		c[0] = c[1] = c[2] = c[3] = zero;
+		for ( i = 0; i < 3; ++i ) {
+			c[layout->byte[i]] = rgb[i];
+		}
+		lo = _mm_unpacklo_epi8(c[0], c[1]);
+		hi = _mm_unpacklo_epi8(c[2], c[3]);
+		pixels[0] = _mm_unpacklo_epi16(lo, hi);
+		pixels[1] = _mm_unpackhi_epi16(lo, hi);
+		lo = _mm_unpackhi_epi8(c[0], c[1]);
+		hi = _mm_unpackhi_epi8(c[2], c[3]);
+		pixels[2] = _mm_unpacklo_epi16(lo, hi);
+		pixels[3] = _mm_unpackhi_epi16(lo, hi);
+	} else {
+		for ( i = 0; i < 3; ++i ) {
+			c16[0][i] = _mm_unpacklo_epi8(rgb[i], zero);
+			c16[1][i] = _mm_unpackhi_epi8(rgb[i], zero);
+		}
+		if ( bpp == 2 ) {
+			for ( j = 0; j < 2; ++j ) {
+				_mm_storeu_si128((__m128i *)(dst + j*16),
+					YUVPack16SSE2(c16[j][0], c16[j][1],
+					              c16[j][2], layout));
+			}
+			return;
+		}
+		for ( j = 0; j < 2; ++j ) {
+			pixels[j*2] = YUVPack32SSE2(
+				_mm_unpacklo_epi16(c16[j][0], zero),
+				_mm_unpacklo_epi16(c16[j][1], zero),
+				_mm_unpacklo_epi16(c16[j][2], zero), layout);
+			pixels[j*2+1] = YUVPack32SSE2(
+				_mm_unpackhi_epi16(c16[j][0], zero),
+				_mm_unpackhi_epi16(c16[j][1], zero),
+				_mm_unpackhi_epi16(c16[j][2], zero), layout);
+		}
+	}
+	if ( bpp == 4 ) {
+		for ( j = 0; j < 4; ++j ) {
+			_mm_storeu_si128((__m128i *)(dst + j*16), pixels[j]);
+		}
+	} else {
+		/* Overlapping dword stores, the last pixel is written exactly */
+		Uint32 values[16];
+
+		for ( j = 0; j < 4; ++j ) {
+			_mm_storeu_si128((__m128i *)&values[j*4], pixels[j]);
+		}
+		for ( i = 0; i < 15; ++i ) {
+			*(Uint32 *)dst = values[i];
+			dst += 3;
+		}
+		YUVStorePixel(dst, 3, values[15]);
+	}
+}
+
+/* Write sixteen converted pixels, doubled in both directions for 2X */
+SDL_TARGETING("sse2")
+static __inline__ void YUVEmitSSE2(Uint8 *dst, const __m128i rgb[3], int bpp,
+                        int scale, int pitch, const YUVLayout *layout)
+{
+	__m128i lo[3], hi[3];
+	int i;
+
+	if ( scale == 1 ) {
+		YUVStoreSSE2(dst, rgb, bpp, layout);
+		return;
+	}
+	for ( i = 0; i < 3; ++i ) {
+		lo[i] = _mm_unpacklo_epi8(rgb[i], rgb[i]);
+		hi[i] = _mm_unpackhi_epi8(rgb[i], rgb[i]);
+	}
+	YUVStoreSSE2(dst, lo, bpp, layout);
+	YUVStoreSSE2(dst + 16*bpp, hi, bpp, layout);
+	YUVStoreSSE2(dst + pitch, lo, bpp, layout);
+	YUVStoreSSE2(dst + pitch + 16*bpp, hi, bpp, layout);
+}
+
+/* Planar and semi-planar formats, cstep is the distance between chroma
+   samples: 1 for separate planes, 2 for interleaved NV12/NV21 pairs.
+ */
+SDL_TARGETING("sse2")
+static __inline__ void ColorPlanarSSE2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale,
+                          int cstep)
+{
+	const int pitch = (cols*scale + mod) * bpp;
+	const int cols_2 = cols / 2;
+	const int crcount = (cr > cb) ? 8 : 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i low8 = _mm_set1_epi16(0xFF);
+	__m128i rcount = _mm_cvtsi32_si128(crcount);
+	__m128i bcount = _mm_cvtsi32_si128(8 - crcount);
+	__m128i terms[3], rgb[3], y;
+	YUVLayout layout;
+	int row;
+
+	GetYUVLayout(rgb_2_pix, bpp, &layout);
+	for ( row = rows / 2; row--; ) {
+		Uint8 *lum1 = lum;
+		Uint8 *lum2 = lum + cols;
+		Uint8 *u = cr, *v = cb;
+		Uint8 *dst1 = out;
+		Uint8 *dst2 = out + scale*pitch;
+		int x = cols_2;
+
+		while ( x >= 8 ) {
+			if ( cstep == 1 ) {
+				YUVChromaSSE2(
+					_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)u), zero),
+					_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)v), zero),
+					terms);
+			} else {
+				__m128i uv = _mm_loadu_si128((__m128i *)SDL_min(u, v));
+				YUVChromaSSE2(
+					_mm_and_si128(_mm_srl_epi16(uv, rcount), low8),
+					_mm_and_si128(_mm_srl_epi16(uv, bcount), low8),
+					terms);
+			}
+
+			y = _mm_loadu_si128((__m128i *)lum1);
+			YUVLumaSSE2(_mm_unpacklo_epi8(y, zero),
+			            _mm_unpackhi_epi8(y, zero), terms, rgb);
+			YUVEmitSSE2(dst1, rgb, bpp, scale, pitch, &layout);
+
+			y = _mm_loadu_si128((__m128i *)lum2);
+			YUVLumaSSE2(_mm_unpacklo_epi8(y, zero),
+			            _mm_unpackhi_epi8(y, zero), terms, rgb);
+			YUVEmitSSE2(dst2, rgb, bpp, scale, pitch, &layout);
+
+			lum1 += 16; lum2 += 16;
+			u += 8*cstep; v += 8*cstep;
+			dst1 += 16*scale*bpp;
+			dst2 += 16*scale*bpp;
+			x -= 8;
+		}
+		YUVRowTail(colortab, rgb_2_pix, lum1, 1, u, v, cstep,
+		           dst1, x, bpp, scale, pitch);
+		YUVRowTail(colortab, rgb_2_pix, lum2, 1, u, v, cstep,
+		           dst2, x, bpp, scale, pitch);
+
+		lum += 2*cols;
+		cr += cols_2*cstep;
+		cb += cols_2*cstep;
+		out += 2*scale*pitch;
+	}
+}
+
+SDL_TARGETING("sse2")
+static void ColorYV12SSE2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	ColorPlanarSSE2(colortab, rgb_2_pix, lum, cr, cb, out,
+	                rows, cols, mod, bpp, scale, 1);
+}
+
+SDL_TARGETING("sse2")
+static void ColorNV12SSE2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	ColorPlanarSSE2(colortab, rgb_2_pix, lum, cr, cb, out,
+	                rows, cols, mod, bpp, scale, 2);
+}
+
+SDL_TARGETING("sse2")
+static void ColorYUY2SSE2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	const int pitch = (cols*scale + mod) * bpp;
+	const int cols_2 = cols / 2;
+	/* Each four byte group starts at the lowest of the three pointers */
+	Uint8 *src = SDL_min(lum, SDL_min(cr, cb));
+	const int yoff = (int)(lum - src);
+	const int croff = (int)(cr - src);
+	const int cboff = (int)(cb - src);
+	__m128i ycount = _mm_cvtsi32_si128(yoff * 8);
+	__m128i rcount = _mm_cvtsi32_si128(croff * 8);
+	__m128i bcount = _mm_cvtsi32_si128(cboff * 8);
+	__m128i low8 = _mm_set1_epi16(0xFF);
+	__m128i low32 = _mm_set1_epi32(0xFF);
+	__m128i terms[3], rgb[3];
+	YUVLayout layout;
+	int row;
+
+	GetYUVLayout(rgb_2_pix, bpp, &layout);
+	for ( row = rows; row--; ) {
+		Uint8 *s = src;
+		Uint8 *dst = out;
+		int x = cols_2;
+
+		while ( x >= 8 ) {
+			__m128i p0 = _mm_loadu_si128((__m128i *)s);
+			__m128i p1 = _mm_loadu_si128((__m128i *)(s + 16));
+
+			YUVChromaSSE2(
+				_mm_packs_epi32(
+					_mm_and_si128(_mm_srl_epi32(p0, rcount), low32),
+					_mm_and_si128(_mm_srl_epi32(p1, rcount), low32)),
+				_mm_packs_epi32(
+					_mm_and_si128(_mm_srl_epi32(p0, bcount), low32),
+					_mm_and_si128(_mm_srl_epi32(p1, bcount), low32)),
+				terms);
+			YUVLumaSSE2(_mm_and_si128(_mm_srl_epi16(p0, ycount), low8),
+			            _mm_and_si128(_mm_srl_epi16(p1, ycount), low8),
+			            terms, rgb);
+			YUVEmitSSE2(dst, rgb, bpp, scale, pitch, &layout);
+
+			s += 32;
+			dst += 16*scale*bpp;
+			x -= 8;
+		}
+		YUVRowTail(colortab, rgb_2_pix, s + yoff, 2,
+		           s + croff, s + cboff, 4,
+		           dst, x, bpp, scale, pitch);
+
+		src += cols*2;
+		out += scale*pitch;
+	}
+}
+
+/* The AVX2 versions work on 32 pixels at a time.  The 256-bit unpacks and
+   packs work within each 128-bit lane, so the results are permuted back
+   into order before they are stored.
+ */
+SDL_TARGETING("avx2")
+static __inline__ void YUVChromaAVX2(__m256i cr, __m256i cb, __m256i terms[3])
+{
+	__m256i bias = _mm256_set1_epi16(128);
+	__m256i crs, cbs, r, g1, g2, b;
+
+	cr = _mm256_sub_epi16(cr, bias);
+	cb = _mm256_sub_epi16(cb, bias);
+	crs = _mm256_srai_epi16(cr, 15);
+	cbs = _mm256_srai_epi16(cb, 15);
+	cr = _mm256_abs_epi16(cr);
+	cb = _mm256_abs_epi16(cb);
+
+	r  = _mm256_mulhi_epu16(_mm256_slli_epi16(cr, 7), _mm256_set1_epi16(YUV_CR_R));
+	g1 = _mm256_mulhi_epu16(_mm256_slli_epi16(cr, 6), _mm256_set1_epi16(YUV_CR_G));
+	g2 = _mm256_mulhi_epu16(_mm256_slli_epi16(cb, 3), _mm256_set1_epi16(YUV_CB_G));
+	b  = _mm256_mulhi_epu16(_mm256_slli_epi16(cb, 2), _mm256_set1_epi16((short)YUV_CB_B));
+
+	terms[0] = _mm256_sub_epi16(_mm256_xor_si256(r, crs), crs);
+	terms[1] = _mm256_add_epi16(_mm256_sub_epi16(_mm256_xor_si256(g1, crs), crs),
+	                            _mm256_sub_epi16(_mm256_xor_si256(g2, cbs), cbs));
+	terms[1] = _mm256_sub_epi16(_mm256_setzero_si256(), terms[1]);
+	terms[2] = _mm256_sub_epi16(_mm256_xor_si256(b, cbs), cbs);
+}
+
+SDL_TARGETING("avx2")
+static __inline__ void YUVLumaAVX2(__m256i ylo, __m256i yhi,
+                                   const __m256i terms[3], __m256i rgb[3])
+{
+	int i;
+
+	for ( i = 0; i < 3; ++i ) {
+		__m256i lo = _mm256_unpacklo_epi16(terms[i], terms[i]);
+		__m256i hi = _mm256_unpackhi_epi16(terms[i], terms[i]);
+		__m256i c = _mm256_packus_epi16(
+			_mm256_add_epi16(ylo, _mm256_permute2x128_si256(lo, hi, 0x20)),
+			_mm256_add_epi16(yhi, _mm256_permute2x128_si256(lo, hi, 0x31)));
+		rgb[i] = _mm256_permute4x64_epi64(c, 0xD8);
+	}
+}
+
+SDL_TARGETING("avx2")
+static __inline__ __m256i YUVPack16AVX2(__m256i r, __m256i g, __m256i b,
+                                        const YUVLayout *layout)
+{
+	r = _mm256_sll_epi16(_mm256_srl_epi16(r, layout->loss[0]),
+	                     layout->shift[0]);
+	g = _mm256_sll_epi16(_mm256_srl_epi16(g, layout->loss[1]),
+	                     layout->shift[1]);
+	b = _mm256_sll_epi16(_mm256_srl_epi16(b, layout->loss[2]),
+	                     layout->shift[2]);
+	return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+SDL_TARGETING("avx2")
+static __inline__ __m256i YUVPack32AVX2(__m128i r, __m128i g, __m128i b,
+                                        const YUVLayout *layout)
+{
+	__m256i r32 = _mm256_cvtepu8_epi32(r);
+	__m256i g32 = _mm256_cvtepu8_epi32(g);
+	__m256i b32 = _mm256_cvtepu8_epi32(b);
+
+	r32 = _mm256_sll_epi32(_mm256_srl_epi32(r32, layout->loss[0]),
+	                       layout->shift[0]);
+	g32 = _mm256_sll_epi32(_mm256_srl_epi32(g32, layout->loss[1]),
+	                       layout->shift[1]);
+	b32 = _mm256_sll_epi32(_mm256_srl_epi32(b32, layout->loss[2]),
+	                       layout->shift[2]);
+	return _mm256_or_si256(_mm256_or_si256(r32, g32), b32);
+}
+
+/* Write thirty-two pixels held as R, G and B bytes */
+SDL_TARGETING("avx2")
+static __inline__ void YUVStoreAVX2(Uint8 *dst, const __m256i rgb[3], int bpp,
+                                    const YUVLayout *layout)
+{
+	/* Pack the first three bytes of each dword in both lanes */
+	__m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m128i half[2][3];
+	__m256i pixels[4];
+	int i, j;
+
+	if ( layout->bytewise ) {
+		__m256i zero = _mm256_setzero_si256();
+		__m256i c[4], lo, hi, p0, p1, p2, p3;
+
+		c[0] = c[1] = c[2] = c[3] = zero;
+		for ( i = 0; i < 3; ++i ) {
+			c[layout->byte[i]] = rgb[i];
+		}
+		lo = _mm256_unpacklo_epi8(c[0], c[1]);
+		hi = _mm256_unpacklo_epi8(c[2], c[3]);
+		p0 = _mm256_unpacklo_epi16(lo, hi);
+		p1 = _mm256_unpackhi_epi16(lo, hi);
+		lo = _mm256_unpackhi_epi8(c[0], c[1]);
+		hi = _mm256_unpackhi_epi8(c[2], c[3]);
+		p2 = _mm256_unpacklo_epi16(lo, hi);
+		p3 = _mm256_unpackhi_epi16(lo, hi);
+		pixels[0] = _mm256_permute2x128_si256(p0, p1, 0x20);
+		pixels[1] = _mm256_permute2x128_si256(p2, p3, 0x20);
+		pixels[2] = _mm256_permute2x128_si256(p0, p1, 0x31);
+		pixels[3] = _mm256_permute2x128_si256(p2, p3, 0x31);
+	} else {
+		for ( i = 0; i < 3; ++i ) {
+			half[0][i] = _mm256_castsi256_si128(rgb[i]);
+			half[1][i] = _mm256_extracti128_si256(rgb[i], 1);
+		}
+		if ( bpp == 2 ) {
+			for ( j = 0; j < 2; ++j ) {
+				_mm256_storeu_si256((__m256i *)(dst + j*32),
+					YUVPack16AVX2(_mm256_cvtepu8_epi16(half[j][0]),
+					              _mm256_cvtepu8_epi16(half[j][1]),
+					              _mm256_cvtepu8_epi16(half[j][2]),
+					              layout));
+			}
+			return;
+		}
+		for ( j = 0; j < 2; ++j ) {
+			pixels[j*2] = YUVPack32AVX2(half[j][0], half[j][1],
+			                            half[j][2], layout);
+			pixels[j*2+1] = YUVPack32AVX2(_mm_srli_si128(half[j][0], 8),
+			                              _mm_srli_si128(half[j][1], 8),
+			                              _mm_srli_si128(half[j][2], 8),
+			                              layout);
+		}
+	}
+	for ( j = 0; j < 4; ++j ) {
+		if ( bpp == 4 ) {
+			_mm256_storeu_si256((__m256i *)dst, pixels[j]);
+			dst += 32;
+		} else {
+			__m256i c = _mm256_shuffle_epi8(pixels[j], pack);
+			__m128i hi = _mm256_extracti128_si256(c, 1);
+			_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(c));
+			_mm_storel_epi64((__m128i *)(dst + 12), hi);
+			*(Uint32 *)(dst + 20) = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+			dst += 24;
+		}
+	}
+}
+
+SDL_TARGETING("avx2")
+static __inline__ void YUVEmitAVX2(Uint8 *dst, const __m256i rgb[3], int bpp,
+                        int scale, int pitch, const YUVLayout *layout)
+{
+	__m256i lo[3], hi[3];
+	int i;
+
+	if ( scale == 1 ) {
+		YUVStoreAVX2(dst, rgb, bpp, layout);
+		return;
+	}
+	for ( i = 0; i < 3; ++i ) {
+		__m256i l = _mm256_unpacklo_epi8(rgb[i], rgb[i]);
+		__m256i h = _mm256_unpackhi_epi8(rgb[i], rgb[i]);
+		lo[i] = _mm256_permute2x128_si256(l, h, 0x20);
+		hi[i] = _mm256_permute2x128_si256(l, h, 0x31);
+	}
+	YUVStoreAVX2(dst, lo, bpp, layout);
+	YUVStoreAVX2(dst + 32*bpp, hi, bpp, layout);
+	YUVStoreAVX2(dst + pitch, lo, bpp, layout);
+	YUVStoreAVX2(dst + pitch + 32*bpp, hi, bpp, layout);
+}
+
+SDL_TARGETING("avx2")
+static __inline__ void ColorPlanarAVX2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale,
+                          int cstep)
+{
+	const int pitch = (cols*scale + mod) * bpp;
+	const int cols_2 = cols / 2;
+	const int crcount = (cr > cb) ? 8 : 0;
+	__m256i low8 = _mm256_set1_epi16(0xFF);
+	__m128i rcount = _mm_cvtsi32_si128(crcount);
+	__m128i bcount = _mm_cvtsi32_si128(8 - crcount);
+	__m256i terms[3], rgb[3], y;
+	YUVLayout layout;
+	int row;
+
+	GetYUVLayout(rgb_2_pix, bpp, &layout);
+	for ( row = rows / 2; row--; ) {
+		Uint8 *lum1 = lum;
+		Uint8 *lum2 = lum + cols;
+		Uint8 *u = cr, *v = cb;
+		Uint8 *dst1 = out;
+		Uint8 *dst2 = out + scale*pitch;
+		int x = cols_2;
+
+		while ( x >= 16 ) {
+			if ( cstep == 1 ) {
+				YUVChromaAVX2(
+					_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)u)),
+					_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)v)),
+					terms);
+			} else {
+				__m256i uv = _mm256_loadu_si256((__m256i *)SDL_min(u, v));
+				YUVChromaAVX2(
+					_mm256_and_si256(_mm256_srl_epi16(uv, rcount), low8),
+					_mm256_and_si256(_mm256_srl_epi16(uv, bcount), low8),
+					terms);
+			}
+
+			y = _mm256_loadu_si256((__m256i *)lum1);
+			YUVLumaAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y)),
+			            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1)),
+			            terms, rgb);
+			YUVEmitAVX2(dst1, rgb, bpp, scale, pitch, &layout);
+
+			y = _mm256_loadu_si256((__m256i *)lum2);
+			YUVLumaAVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y)),
+			            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1)),
+			            terms, rgb);
+			YUVEmitAVX2(dst2, rgb, bpp, scale, pitch, &layout);
+
+			lum1 += 32; lum2 += 32;
+			u += 16*cstep; v += 16*cstep;
+			dst1 += 32*scale*bpp;
+			dst2 += 32*scale*bpp;
+			x -= 16;
+		}
+		YUVRowTail(colortab, rgb_2_pix, lum1, 1, u, v, cstep,
+		           dst1, x, bpp, scale, pitch);
+		YUVRowTail(colortab, rgb_2_pix, lum2, 1, u, v, cstep,
+		           dst2, x, bpp, scale, pitch);
+
+		lum += 2*cols;
+		cr += cols_2*cstep;
+		cb += cols_2*cstep;
+		out += 2*scale*pitch;
+	}
+	_mm256_zeroupper();
+}
+
+SDL_TARGETING("avx2")
+static void ColorYV12AVX2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	ColorPlanarAVX2(colortab, rgb_2_pix, lum, cr, cb, out,
+	                rows, cols, mod, bpp, scale, 1);
+}
+
+SDL_TARGETING("avx2")
+static void ColorNV12AVX2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	ColorPlanarAVX2(colortab, rgb_2_pix, lum, cr, cb, out,
+	                rows, cols, mod, bpp, scale, 2);
+}
+
+SDL_TARGETING("avx2")
+static void ColorYUY2AVX2(int *colortab, Uint32 *rgb_2_pix,
+                          unsigned char *lum, unsigned char *cr,
+                          unsigned char *cb, unsigned char *out,
+                          int rows, int cols, int mod, int bpp, int scale)
+{
+	const int pitch = (cols*scale + mod) * bpp;
+	const int cols_2 = cols / 2;
+	Uint8 *src = SDL_min(lum, SDL_min(cr, cb));
+	const int yoff = (int)(lum - src);
+	const int croff = (int)(cr - src);
+	const int cboff = (int)(cb - src);
+	__m128i ycount = _mm_cvtsi32_si128(yoff * 8);
+	__m128i rcount = _mm_cvtsi32_si128(croff * 8);
+	__m128i bcount = _mm_cvtsi32_si128(cboff * 8);
+	__m256i low8 = _mm256_set1_epi16(0xFF);
+	__m256i low32 = _mm256_set1_epi32(0xFF);
+	__m256i terms[3], rgb[3];
+	YUVLayout layout;
+	int row;
+
+	GetYUVLayout(rgb_2_pix, bpp, &layout);
+	for ( row = rows; row--; ) {
+		Uint8 *s = src;
+		Uint8 *dst = out;
+		int x = cols_2;
+
+		while ( x >= 16 ) {
+			__m256i p0 = _mm256_loadu_si256((__m256i *)s);
+			__m256i p1 = _mm256_loadu_si256((__m256i *)(s + 32));
+			__m256i u = _mm256_packs_epi32(
+				_mm256_and_si256(_mm256_srl_epi32(p0, rcount), low32),
+				_mm256_and_si256(_mm256_srl_epi32(p1, rcount), low32));
+			__m256i v = _mm256_packs_epi32(
+				_mm256_and_si256(_mm256_srl_epi32(p0, bcount), low32),
+				_mm256_and_si256(_mm256_srl_epi32(p1, bcount), low32));
+
+			YUVChromaAVX2(_mm256_permute4x64_epi64(u, 0xD8),
+			              _mm256_permute4x64_epi64(v, 0xD8), terms);
+			YUVLumaAVX2(_mm256_and_si256(_mm256_srl_epi16(p0, ycount), low8),
+			            _mm256_and_si256(_mm256_srl_epi16(p1, ycount), low8),
+			            terms, rgb);
+			YUVEmitAVX2(dst, rgb, bpp, scale, pitch, &layout);
+
+			s += 64;
+			dst += 32*scale*bpp;
+			x -= 16;
+		}
+		YUVRowTail(colortab, rgb_2_pix, s + yoff, 2,
+		           s + croff, s + cboff, 4,
+		           dst, x, bpp, scale, pitch);
+
+		src += cols*2;
+		out += scale*pitch;
+	}
+	_mm256_zeroupper();
+}
+
+YUV_CONVERT_FUNC(Color16YV12SSE2_1X, ColorYV12SSE2, 2, 1)
+YUV_CONVERT_FUNC(Color16YV12SSE2_2X, ColorYV12SSE2, 2, 2)
+YUV_CONVERT_FUNC(Color24YV12SSE2_1X, ColorYV12SSE2, 3, 1)
+YUV_CONVERT_FUNC(Color24YV12SSE2_2X, ColorYV12SSE2, 3, 2)
+YUV_CONVERT_FUNC(Color32YV12SSE2_1X, ColorYV12SSE2, 4, 1)
+YUV_CONVERT_FUNC(Color32YV12SSE2_2X, ColorYV12SSE2, 4, 2)
+YUV_CONVERT_FUNC(Color16YUY2SSE2_1X, ColorYUY2SSE2, 2, 1)
+YUV_CONVERT_FUNC(Color16YUY2SSE2_2X, ColorYUY2SSE2, 2, 2)
+YUV_CONVERT_FUNC(Color24YUY2SSE2_1X, ColorYUY2SSE2, 3, 1)
+YUV_CONVERT_FUNC(Color24YUY2SSE2_2X, ColorYUY2SSE2, 3, 2)
+YUV_CONVERT_FUNC(Color32YUY2SSE2_1X, ColorYUY2SSE2, 4, 1)
+YUV_CONVERT_FUNC(Color32YUY2SSE2_2X, ColorYUY2SSE2, 4, 2)
+YUV_CONVERT_FUNC(Color16YV12AVX2_1X, ColorYV12AVX2, 2, 1)
+YUV_CONVERT_FUNC(Color16YV12AVX2_2X, ColorYV12AVX2, 2, 2)
+YUV_CONVERT_FUNC(Color24YV12AVX2_1X, ColorYV12AVX2, 3, 1)
+YUV_CONVERT_FUNC(Color24YV12AVX2_2X, ColorYV12AVX2, 3, 2)
+YUV_CONVERT_FUNC(Color32YV12AVX2_1X, ColorYV12AVX2, 4, 1)
+YUV_CONVERT_FUNC(Color32YV12AVX2_2X, ColorYV12AVX2, 4, 2)
+YUV_CONVERT_FUNC(Color16YUY2AVX2_1X, ColorYUY2AVX2, 2, 1)
+YUV_CONVERT_FUNC(Color16YUY2AVX2_2X, ColorYUY2AVX2, 2, 2)
+YUV_CONVERT_FUNC(Color24YUY2AVX2_1X, ColorYUY2AVX2, 3, 1)
+YUV_CONVERT_FUNC(Color24YUY2AVX2_2X, ColorYUY2AVX2, 3, 2)
+YUV_CONVERT_FUNC(Color32YUY2AVX2_1X, ColorYUY2AVX2, 4, 1)
+YUV_CONVERT_FUNC(Color32YUY2AVX2_2X, ColorYUY2AVX2, 4, 2)
+YUV_CONVERT_FUNC(Color16NV12SSE2_1X, ColorNV12SSE2, 2, 1)
+YUV_CONVERT_FUNC(Color16NV12SSE2_2X, ColorNV12SSE2, 2, 2)
+YUV_CONVERT_FUNC(Color24NV12SSE2_1X, ColorNV12SSE2, 3, 1)
+YUV_CONVERT_FUNC(Color24NV12SSE2_2X, ColorNV12SSE2, 3, 2)
+YUV_CONVERT_FUNC(Color32NV12SSE2_1X, ColorNV12SSE2, 4, 1)
+YUV_CONVERT_FUNC(Color32NV12SSE2_2X, ColorNV12SSE2, 4, 2)
+YUV_CONVERT_FUNC(Color16NV12AVX2_1X, ColorNV12AVX2, 2, 1)
+YUV_CONVERT_FUNC(Color16NV12AVX2_2X, ColorNV12AVX2, 2, 2)
+YUV_CONVERT_FUNC(Color24NV12AVX2_1X, ColorNV12AVX2, 3, 1)
+YUV_CONVERT_FUNC(Color24NV12AVX2_2X, ColorNV12AVX2, 3, 2)
+YUV_CONVERT_FUNC(Color32NV12AVX2_1X, ColorNV12AVX2, 4, 1)
+YUV_CONVERT_FUNC(Color32NV12AVX2_2X, ColorNV12AVX2, 4, 2)
+
+typedef void (*YUVConvertFunc)( int *colortab, Uint32 *rgb_2_pix,
+                                 unsigned char *lum, unsigned char *cr,
+                                 unsigned char *cb, unsigned char *out,
+                                 int rows, int cols, int mod );
+
+/* Indexed by [AVX2][planar, packed, semi-planar][bytes per pixel - 2][2X] */
+static const YUVConvertFunc yuv_simd_funcs[2][3][3][2] = {
+	{
+		{ { Color16YV12SSE2_1X, Color16YV12SSE2_2X },
+		  { Color24YV12SSE2_1X, Color24YV12SSE2_2X },
+		  { Color32YV12SSE2_1X, Color32YV12SSE2_2X } },
+		{ { Color16YUY2SSE2_1X, Color16YUY2SSE2_2X },
+		  { Color24YUY2SSE2_1X, Color24YUY2SSE2_2X },
+		  { Color32YUY2SSE2_1X, Color32YUY2SSE2_2X } },
+		{ { Color16NV12SSE2_1X, Color16NV12SSE2_2X },
+		  { Color24NV12SSE2_1X, Color24NV12SSE2_2X },
+		  { Color32NV12SSE2_1X, Color32NV12SSE2_2X } }
+	},
+	{
+		{ { Color16YV12AVX2_1X, Color16YV12AVX2_2X },
+		  { Color24YV12AVX2_1X, Color24YV12AVX2_2X },
+		  { Color32YV12AVX2_1X, Color32YV12AVX2_2X } },
+		{ { Color16YUY2AVX2_1X, Color16YUY2AVX2_2X },
+		  { Color24YUY2AVX2_1X, Color24YUY2AVX2_2X },
+		  { Color32YUY2AVX2_1X, Color32YUY2AVX2_2X } },
+		{ { Color16NV12AVX2_1X, Color16NV12AVX2_2X },
+		  { Color24NV12AVX2_1X, Color24NV12AVX2_2X },
+		  { Color32NV12AVX2_1X, Color32NV12AVX2_2X } }
+	}
+};
+#endif /* SDL_SSE2_INTRINSICS */
+#undef YUV_CONVERT_FUNC
+
+/* Scaled and clipped display.
+ *
+ * Destination pixels are mapped to source pixels with 16.16 fixed point
+ * steps, sampling at pixel centers.  Each source row (or row pair, for the
+ * planar formats) is converted into a small scratch buffer by the 1X
+ * converter and then scaled horizontally straight into the display, so
+ * the frame is only written once.  Destination rows which come from the
+ * same source row as the row above are copied from it.
+ *
+ * With bilinear chroma the chroma planes are interpolated at each
+ * destination pixel while luma is still point sampled.  This is slower,
+ * but avoids the blocky color edges of upscaled 4:2:0 video.
+ *
+ * Large frames are split into horizontal bands which are converted by
+ * the software blit thread pool.  Bands of unscaled frames start on even
+ * rows so that planar chroma rows are never shared between bands, and
+ * every band of a scaled frame has its own scratch rows.
+ */
+typedef struct {
+	struct private_yuvhwdata *swdata;
+	SDL_Overlay *overlay;
+	int planar;		/* Chroma subsampled vertically too */
+	int cstep;		/* Bytes between horizontal chroma samples */
+	int scale;		/* 1 or 2 when unscaled, 0 otherwise */
+	Uint8 *lum, *Cr, *Cb;
+	SDL_Rect *src, *dst;
+	Uint8 *dstp;
+	int pitch;
+	int mod;
+	Uint32 xstep, ystep;
+	int bandsize;		/* Scratch bytes for each band */
+} YUVBandData;
+
+/* Chroma sample position and weight, for a luma position in 16.16 */
+#define CHROMA_POS(pos, size, c0, c1, frac) \
+{ \
+	Sint32 cpos = (Sint32)((pos) >> 1) - 0x8000; \
+	if ( cpos < 0 ) { \
+		cpos = 0; \
+	} \
+	c0 = cpos >> 16; \
+	if ( c0 >= (size) - 1 ) { \
+		c0 = c1 = (size) - 1; \
+		frac = 0; \
+	} else { \
+		c1 = c0 + 1; \
+		frac = (cpos >> 8) & 0xFF; \
+	} \
+}
+
+static int GrowYUVScaleBuffers(struct private_yuvhwdata *swdata,
+                               int rowsize, int mapsize)
+{
+	if ( rowsize > swdata->rowbuf_size ) {
+		Uint8 *rowbuf = (Uint8 *)SDL_realloc(swdata->rowbuf, rowsize);
+		if ( ! rowbuf ) {
+			SDL_OutOfMemory();
+			return(-1);
+		}
+		swdata->rowbuf = rowbuf;
+		swdata->rowbuf_size = rowsize;
+	}
+	if ( mapsize > swdata->colmap_size ) {
+		int *colmap = (int *)SDL_realloc(swdata->colmap,
+		                                 mapsize*sizeof(int));
+		if ( ! colmap ) {
+			SDL_OutOfMemory();
+			return(-1);
+		}
+		swdata->colmap = colmap;
+		swdata->colmap_size = mapsize;
+	}
+	return(0);
+}
+
+/* Allocate the scratch rows for every band and fill in the column map */
+static int PrepareYUVScale(YUVBandData *data, int nbands)
+{
+	struct private_yuvhwdata *swdata = data->swdata;
+	SDL_Overlay *overlay = data->overlay;
+	const int bpp = swdata->display->format->BytesPerPixel;
+	int *colmap;
+	Uint32 pos;
+	int i;
+
+	data->xstep = ((Uint32)data->src->w << 16) / data->dst->w;
+	data->ystep = ((Uint32)data->src->h << 16) / data->dst->h;
+	if ( swdata->bilinear ) {
+		/* Two rows of vertically blended chroma */
+		const int cwidth = overlay->w / 2;
+		data->bandsize = 2*cwidth*sizeof(Uint16);
+		if ( GrowYUVScaleBuffers(swdata, nbands*data->bandsize,
+		                         data->dst->w * 3) < 0 ) {
+			return(-1);
+		}
+
+		/* Luma offset, first chroma sample and the chroma weight */
+		colmap = swdata->colmap;
+		pos = ((Uint32)data->src->x << 16) + data->xstep / 2;
+		for ( i = 0; i < data->dst->w; ++i ) {
+			int c0, c1, frac;
+			CHROMA_POS(pos, cwidth, c0, c1, frac);
+			colmap[0] = (int)(pos >> 16) * (data->planar ? 1 : 2);
+			colmap[1] = c0;
+			colmap[2] = frac;
+			colmap += 3;
+			pos += data->xstep;
+		}
+	} else {
+		/* One converted row, or a row pair for planar formats */
+		const int rows = (data->planar && overlay->h > 1) ? 2 : 1;
+		/* The converters work on pixel pairs, so an odd last
+		   column is never written and we reuse its neighbour.
+		 */
+		const int lastcol = (overlay->w > 1) ? (overlay->w & ~1) - 1 : 0;
+
+		data->bandsize = rows * overlay->w * bpp;
+		if ( GrowYUVScaleBuffers(swdata, nbands*data->bandsize,
+		                         data->dst->w) < 0 ) {
+			return(-1);
+		}
+
+		/* Byte offset of the source pixel in the converted row */
+		colmap = swdata->colmap;
+		pos = ((Uint32)data->src->x << 16) + data->xstep / 2;
+		for ( i = 0; i < data->dst->w; ++i ) {
+			int x = (int)(pos >> 16);
+			if ( x > lastcol ) {
+				x = lastcol;
+			}
+			colmap[i] = x * bpp;
+			pos += data->xstep;
+		}
+	}
+	return(0);
+}
+
+/* Scale one converted row, using source byte offsets from the column map */
+static void ScaleYUVRow(const Uint8 *src, Uint8 *dst, const int *colmap,
+                        int width, int bpp)
+{
+	int i;
+
+	switch (bpp) {
+	    case 2:
+		for ( i = 0; i < width; ++i ) {
+			((Uint16 *)dst)[i] = *(const Uint16 *)(src + colmap[i]);
+		}
+		break;
+	    case 3:
+		for ( i = 0; i < width; ++i ) {
+			const Uint8 *s = src + colmap[i];
+			dst[0] = s[0];
+			dst[1] = s[1];
+			dst[2] = s[2];
+			dst += 3;
+		}
+		break;
+	    default:
+		for ( i = 0; i < width; ++i ) {
+			((Uint32 *)dst)[i] = *(const Uint32 *)(src + colmap[i]);
+		}
+		break;
+	}
+}
+
+static void ScaleYUVBand(YUVBandData *data, int first, int count,
+                         Uint8 *rowbuf)
+{
+	struct private_yuvhwdata *swdata = data->swdata;
+	SDL_Overlay *overlay = data->overlay;
+	const int bpp = swdata->display->format->BytesPerPixel;
+	const int rowlen = overlay->w * bpp;
+	const int rows = (data->planar && overlay->h > 1) ? 2 : 1;
+	const int width = data->dst->w;
+	Uint8 *dstp = data->dstp + first * data->pitch;
+	Uint32 pos;
+	int lastrow, cached;
+
+	pos = ((Uint32)data->src->y << 16) + data->ystep / 2
+	      + first * data->ystep;
+	lastrow = -1;
+	cached = -1;
+	while ( count-- ) {
+		int y = (int)(pos >> 16);
+		pos += data->ystep;
+
+		if ( y == lastrow ) {
+			SDL_memcpy(dstp, dstp - data->pitch, width * bpp);
+			dstp += data->pitch;
+			continue;
+		}
+		lastrow = y;
+
+		if ( data->planar ) {
+			int pair = y & ~1;
+			if ( pair > overlay->h - rows ) {
+				pair = overlay->h - rows;
+			}
+			if ( pair != cached ) {
+				swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
+				    data->lum + pair * overlay->pitches[0],
+				    data->Cr + (pair / 2) * overlay->pitches[1],
+				    data->Cb + (pair / 2) * overlay->pitches[1],
+				    rowbuf, rows, overlay->w, 0);
+				cached = pair;
+			}
+			ScaleYUVRow(rowbuf + (y - pair) * rowlen, dstp,
+			            swdata->colmap, width, bpp);
+		} else {
+			int offset = y * overlay->pitches[0];
+			swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
+			                  data->lum + offset, data->Cr + offset,
+			                  data->Cb + offset, rowbuf, 1, overlay->w, 0);
+			ScaleYUVRow(rowbuf, dstp, swdata->colmap, width, bpp);
+		}
+		dstp += data->pitch;
+	}
+}
+
+/* Interpolate chroma across a row and convert, storing with "store" */
+#define BILINEAR_LOOP(store) \
+	for ( i = 0; i < width; ++i ) { \
+		const int c0 = colmap[1]; \
+		const int c1 = (c0 + 1 < cwidth) ? c0 + 1 : c0; \
+		const int fx = colmap[2]; \
+		int cr, cb, L; \
+		Uint32 value; \
+ \
+		cr = (crrow[c0] * (256-fx) + crrow[c1] * fx + 0x8000) >> 16; \
+		cb = (cbrow[c0] * (256-fx) + cbrow[c1] * fx + 0x8000) >> 16; \
+		L = lrow[colmap[0]]; \
+		value = (rgb_2_pix[ L + 0*768+256 + colortab[ cr + 0*256 ] ] | \
+		         rgb_2_pix[ L + 1*768+256 + colortab[ cr + 1*256 ] \
+		                                  + colortab[ cb + 2*256 ] ] | \
+		         rgb_2_pix[ L + 2*768+256 + colortab[ cb + 3*256 ] ]); \
+		store; \
+		out += bpp; \
+		colmap += 3; \
+	}
+
+static void ScaleYUVBandBilinear(YUVBandData *data, int first, int count,
+                                 Uint8 *rowbuf)
+{
+	struct private_yuvhwdata *swdata = data->swdata;
+	SDL_Overlay *overlay = data->overlay;
+	int *colortab = swdata->colortab;
+	Uint32 *rgb_2_pix = swdata->rgb_2_pix;
+	const int bpp = swdata->display->format->BytesPerPixel;
+	const int cstep = data->cstep;
+	const int cpitch = overlay->pitches[data->planar ? 1 : 0];
+	const int cwidth = overlay->w / 2;
+	const int cheight = data->planar ? overlay->h / 2 : overlay->h;
+	const int width = data->dst->w;
+	Uint16 *crrow = (Uint16 *)rowbuf;
+	Uint16 *cbrow = crrow + cwidth;
+	Uint8 *dstp = data->dstp + first * data->pitch;
+	Uint32 pos;
+	int lastr0, lastfy;
+	int i;
+
+	if ( cwidth == 0 || cheight == 0 ) {
+		return;
+	}
+	pos = ((Uint32)data->src->y << 16) + data->ystep / 2
+	      + first * data->ystep;
+	lastr0 = lastfy = -1;
+	while ( count-- ) {
+		const Uint8 *lrow = data->lum + (pos >> 16) * overlay->pitches[0];
+		const int *colmap = swdata->colmap;
+		Uint8 *out = dstp;
+		int r0, r1, fy;
+
+		if ( data->planar ) {
+			CHROMA_POS(pos, cheight, r0, r1, fy);
+		} else {
+			r0 = r1 = (int)(pos >> 16);
+			fy = 0;
+		}
+
+		/* Blend the two chroma rows, keeping 8 bits of fraction */
+		if ( r0 != lastr0 || fy != lastfy ) {
+			const Uint8 *cr0 = data->Cr + r0 * cpitch;
+			const Uint8 *cr1 = data->Cr + r1 * cpitch;
+			const Uint8 *cb0 = data->Cb + r0 * cpitch;
+			const Uint8 *cb1 = data->Cb + r1 * cpitch;
+			int c;
+
+			for ( c = 0; c < cwidth; ++c ) {
+				int o = c * cstep;
+				crrow[c] = (Uint16)(cr0[o] * (256-fy) + cr1[o] * fy);
+				cbrow[c] = (Uint16)(cb0[o] * (256-fy) + cb1[o] * fy);
+			}
+			lastr0 = r0;
+			lastfy = fy;
+		}
+
+		switch (bpp) {
+		    case 2:
+			BILINEAR_LOOP(*(Uint16 *)out = (Uint16)value);
+			break;
+		    case 3:
+			BILINEAR_LOOP(YUVStorePixel(out, 3, value));
+			break;
+		    default:
+			BILINEAR_LOOP(*(Uint32 *)out = value);
+			break;
+		}
+		dstp += data->pitch;
+		pos += data->ystep;
+	}
+}
+#undef BILINEAR_LOOP
+#undef CHROMA_POS
+
+/* Convert one band of rows, running in any of the blit threads */
+static void DisplayYUVBand(void *arg, int band, int nbands)
+{
+	YUVBandData *data = (YUVBandData *)arg;
+	struct private_yuvhwdata *swdata = data->swdata;
+	SDL_Overlay *overlay = data->overlay;
+	int first, last;
+
+	if ( data->scale == 0 ) {
+		Uint8 *rowbuf = swdata->rowbuf + band * data->bandsize;
+
+		first = (data->dst->h * band) / nbands;
+		last = (data->dst->h * (band+1)) / nbands;
+		if ( swdata->bilinear ) {
+			ScaleYUVBandBilinear(data, first, last - first, rowbuf);
+		} else {
+			ScaleYUVBand(data, first, last - first, rowbuf);
+		}
+	} else {
+		/* The converters step rows by whole pixels */
+		const int stride = (overlay->w * data->scale + data->mod) *
+		                   swdata->display->format->BytesPerPixel;
+		Uint8 *lum, *Cr, *Cb;
+
+		if ( data->planar ) {
+			first = ((overlay->h / 2) * band / nbands) * 2;
+			last = ((overlay->h / 2) * (band+1) / nbands) * 2;
+			Cr = data->Cr + (first / 2) * overlay->pitches[1];
+			Cb = data->Cb + (first / 2) * overlay->pitches[1];
+		} else {
+			first = (overlay->h * band) / nbands;
+			last = (overlay->h * (band+1)) / nbands;
+			Cr = data->Cr + first * overlay->pitches[0];
+			Cb = data->Cb + first * overlay->pitches[0];
+		}
+		if ( band == nbands - 1 ) {
+			last = overlay->h;
+		}
+		lum = data->lum + first * overlay->pitches[0];
+		if ( data->scale == 2 ) {
+			swdata->Display2X(swdata->colortab, swdata->rgb_2_pix,
+			                  lum, Cr, Cb,
+			                  data->dstp + first * 2 * stride,
+			                  last - first, overlay->w, data->mod);
+		} else {
+			swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
+			                  lum, Cr, Cb,
+			                  data->dstp + first * stride,
+			                  last - first, overlay->w, data->mod);
+		}
+	}
+}
+
+
+
 SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_Surface *display)
 {
 	SDL_Overlay *overlay;
@@ -953,6 +2164,8 @@ SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_S
 	    case SDL_YUY2_OVERLAY:
 	    case SDL_UYVY_OVERLAY:
 	    case SDL_YVYU_OVERLAY:
+	    case SDL_NV12_OVERLAY:
+	    case SDL_NV21_OVERLAY:
 		break;
 	    default:
 		SDL_SetError("Unsupported YUV format");
@@ -983,8 +2196,15 @@ SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_S
 		SDL_FreeYUVOverlay(overlay);
 		return(NULL);
 	}
-	swdata->stretch = NULL;
 	swdata->display = display;
+	swdata->rowbuf = NULL;
+	swdata->rowbuf_size = 0;
+	swdata->colmap = NULL;
+	swdata->colmap_size = 0;
+	{
+		const char *env = SDL_getenv("SDL_VIDEO_YUV_BILINEAR_CHROMA");
+		swdata->bilinear = (env && SDL_atoi(env));
+	}
 	swdata->pixels = (Uint8 *) SDL_malloc(width*height*2);
 	swdata->colortab = (int *)SDL_malloc(4*256*sizeof(int));
 	Cr_r_tab = &swdata->colortab[0*256];
@@ -1117,10 +2337,48 @@ SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_S
 			swdata->Display2X = Color32DitherYUY2Mod2X;
 		}
 		break;
+	    case SDL_NV12_OVERLAY:
+	    case SDL_NV21_OVERLAY:
+		if ( display->format->BytesPerPixel == 2 ) {
+			swdata->Display1X = Color16NV12_1X;
+			swdata->Display2X = Color16NV12_2X;
+		}
+		if ( display->format->BytesPerPixel == 3 ) {
+			swdata->Display1X = Color24NV12_1X;
+			swdata->Display2X = Color24NV12_2X;
+		}
+		if ( display->format->BytesPerPixel == 4 ) {
+			swdata->Display1X = Color32NV12_1X;
+			swdata->Display2X = Color32NV12_2X;
+		}
+		break;
 	    default:
 		/* We should never get here (caught above) */
 		break;
 	}
+#if SDL_SSE2_INTRINSICS
+	if ( SDL_HasSSE2() ) {
+		int avx2 = SDL_HasAVX2() ? 1 : 0;
+		int layout;
+		int bpp = display->format->BytesPerPixel;
+
+		switch (format) {
+		    case SDL_YV12_OVERLAY:
+		    case SDL_IYUV_OVERLAY:
+			layout = 0;
+			break;
+		    case SDL_NV12_OVERLAY:
+		    case SDL_NV21_OVERLAY:
+			layout = 2;
+			break;
+		    default:
+			layout = 1;
+			break;
+		}
+		swdata->Display1X = yuv_simd_funcs[avx2][layout][bpp-2][0];
+		swdata->Display2X = yuv_simd_funcs[avx2][layout][bpp-2][1];
+	}
+#endif
 
 	/* Find the pitch and offset values for the overlay */
 	overlay->pitches = swdata->pitches;
@@ -1145,6 +2403,15 @@ SDL_Overlay *SDL_CreateYUV_SW(_THIS, int width, int height, Uint32 format, SDL_S
 	        overlay->pixels[0] = swdata->pixels;
 		overlay->planes = 1;
 		break;
+	    case SDL_NV12_OVERLAY:
+	    case SDL_NV21_OVERLAY:
+		overlay->pitches[0] = overlay->w;
+		overlay->pitches[1] = (overlay->w / 2) * 2;
+	        overlay->pixels[0] = swdata->pixels;
+	        overlay->pixels[1] = overlay->pixels[0] +
+		                     overlay->pitches[0] * overlay->h;
+		overlay->planes = 2;
+		break;
 	    default:
 		/* We should never get here (caught above) */
 		break;
@@ -1167,59 +2434,52 @@ void SDL_UnlockYUV_SW(_THIS, SDL_Overlay *overlay)
 int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 {
 	struct private_yuvhwdata *swdata;
-	int stretch;
+	int scaled;
 	int scale_2x;
+	int planar;
+	int cstep;
+	int nbands;
+	int retval;
+	YUVBandData data;
 	SDL_Surface *display;
 	Uint8 *lum, *Cr, *Cb;
 	Uint8 *dstp;
 	int mod;
 
 	swdata = overlay->hwdata;
-	stretch = 0;
+	scaled = 0;
 	scale_2x = 0;
 	if ( src->x || src->y || src->w < overlay->w || src->h < overlay->h ) {
 		/* The source rectangle has been clipped.
-		   Using a scratch surface is easier than adding clipped
-		   source support to all the blitters, plus that would
-		   slow them down in the general unclipped case.
+		   The scaling path handles clipped sources, which keeps
+		   the clipping out of the unscaled converters.
 		*/
-		stretch = 1;
+		scaled = 1;
 	} else if ( (src->w != dst->w) || (src->h != dst->h) ) {
 		if ( (dst->w == 2*src->w) &&
 		     (dst->h == 2*src->h) ) {
 			scale_2x = 1;
 		} else {
-			stretch = 1;
+			scaled = 1;
 		}
 	}
-	if ( stretch ) {
-		if ( ! swdata->stretch ) {
-			display = swdata->display;
-			swdata->stretch = SDL_CreateRGBSurface(
-				SDL_SWSURFACE,
-				overlay->w, overlay->h,
-				display->format->BitsPerPixel,
-				display->format->Rmask,
-				display->format->Gmask,
-				display->format->Bmask, 0);
-			if ( ! swdata->stretch ) {
-				return(-1);
-			}
-		}
-		display = swdata->stretch;
-	} else {
-		display = swdata->display;
-	}
+	display = swdata->display;
+	planar = 0;
+	cstep = 4;
 	switch (overlay->format) {
 	    case SDL_YV12_OVERLAY:
 		lum = overlay->pixels[0];
 		Cr =  overlay->pixels[1];
 		Cb =  overlay->pixels[2];
+		planar = 1;
+		cstep = 1;
 		break;
 	    case SDL_IYUV_OVERLAY:
 		lum = overlay->pixels[0];
 		Cr =  overlay->pixels[2];
 		Cb =  overlay->pixels[1];
+		planar = 1;
+		cstep = 1;
 		break;
 	    case SDL_YUY2_OVERLAY:
 		lum = overlay->pixels[0];
@@ -1236,6 +2496,20 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 		Cr = lum + 1;
 		Cb = lum + 3;
 		break;
+	    case SDL_NV12_OVERLAY:
+		lum = overlay->pixels[0];
+		Cr = overlay->pixels[1] + 1;
+		Cb = overlay->pixels[1];
+		planar = 1;
+		cstep = 2;
+		break;
+	    case SDL_NV21_OVERLAY:
+		lum = overlay->pixels[0];
+		Cr = overlay->pixels[1];
+		Cb = overlay->pixels[1] + 1;
+		planar = 1;
+		cstep = 2;
+		break;
 	    default:
 		SDL_SetError("Unsupported YUV format in blit");
 		return(-1);
@@ -1245,34 +2519,50 @@ int SDL_DisplayYUV_SW(_THIS, SDL_Overlay *overlay, SDL_Rect *src, SDL_Rect *dst)
 			return(-1);
 		}
 	}
-	if ( stretch ) {
-		dstp = (Uint8 *)swdata->stretch->pixels;
+	dstp = (Uint8 *)display->pixels
+		+ dst->x * display->format->BytesPerPixel
+		+ dst->y * display->pitch;
+	mod = (display->pitch / display->format->BytesPerPixel);
+
+	data.swdata = swdata;
+	data.overlay = overlay;
+	data.planar = planar;
+	data.cstep = cstep;
+	data.lum = lum;
+	data.Cr = Cr;
+	data.Cb = Cb;
+	data.src = src;
+	data.dst = dst;
+	data.dstp = dstp;
+	data.pitch = display->pitch;
+	if ( scaled ) {
+		data.scale = 0;
+		data.mod = 0;
+	} else if ( scale_2x ) {
+		data.scale = 2;
+		data.mod = mod - (overlay->w * 2);
 	} else {
-		dstp = (Uint8 *)display->pixels
-			+ dst->x * display->format->BytesPerPixel
-			+ dst->y * display->pitch;
+		data.scale = 1;
+		data.mod = mod - overlay->w;
 	}
-	mod = (display->pitch / display->format->BytesPerPixel);
 
-	if ( scale_2x ) {
-		mod -= (overlay->w * 2);
-		swdata->Display2X(swdata->colortab, swdata->rgb_2_pix,
-		                  lum, Cr, Cb, dstp, overlay->h, overlay->w, mod);
+	retval = 0;
+	nbands = SDL_GetBlitBands(dst->w, dst->h);
+	if ( !scaled && planar && nbands > overlay->h / 2 ) {
+		nbands = 1;
+	}
+	if ( scaled && PrepareYUVScale(&data, nbands) < 0 ) {
+		retval = -1;
 	} else {
-		mod -= overlay->w;
-		swdata->Display1X(swdata->colortab, swdata->rgb_2_pix,
-		                  lum, Cr, Cb, dstp, overlay->h, overlay->w, mod);
+		SDL_RunBlitBands(DisplayYUVBand, &data, nbands);
 	}
 	if ( SDL_MUSTLOCK(display) ) {
 		SDL_UnlockSurface(display);
 	}
-	if ( stretch ) {
-		display = swdata->display;
-		SDL_SoftStretch(swdata->stretch, src, display, dst);
+	if ( retval == 0 ) {
+		SDL_UpdateRects(display, 1, dst);
 	}
-	SDL_UpdateRects(display, 1, dst);
-
-	return(0);
+	return(retval);
 }
 
 void SDL_FreeYUV_SW(_THIS, SDL_Overlay *overlay)
@@ -1281,8 +2571,11 @@ void SDL_FreeYUV_SW(_THIS, SDL_Overlay *overlay)
 
 	swdata = overlay->hwdata;
 	if ( swdata ) {
-		if ( swdata->stretch ) {
-			SDL_FreeSurface(swdata->stretch);
+		if ( swdata->rowbuf ) {
+			SDL_free(swdata->rowbuf);
+		}
+		if ( swdata->colmap ) {
+			SDL_free(swdata->colmap);
 		}
 		if ( swdata->pixels ) {
 			SDL_free(swdata->pixels);
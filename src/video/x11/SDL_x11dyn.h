@@ -48,6 +48,9 @@
 #if SDL_VIDEO_DRIVER_X11_XRANDR
 #include <X11/extensions/Xrandr.h>
 #endif
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
 
 /*
  * When using the "dynamic X11" functionality, we duplicate all the Xlib
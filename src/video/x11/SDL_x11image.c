@@ -27,6 +27,7 @@
 #include "SDL_endian.h"
 #include "../../events/SDL_events_c.h"
 #include "SDL_x11image_c.h"
+#include "SDL_x11render_c.h"
 
 #ifndef NO_SHARED_MEMORY
 
@@ -42,64 +43,204 @@ static int shm_errhandler(Display *d, XErrorEvent *e)
 		return(X_handler(d,e));
 }
 
-static void try_mitshm(_THIS, SDL_Surface *screen)
+/* Create a shared memory segment and attach it to the X server */
+static int attach_mitshm(_THIS, XShmSegmentInfo *info, int size)
 {
-	/* Dynamic X11 may not have SHM entry points on this box. */
-	if ((use_mitshm) && (!SDL_X11_HAVE_SHM))
-		use_mitshm = 0;
-
-	if(!use_mitshm)
-		return;
-	shminfo.shmid = shmget(IPC_PRIVATE, screen->h*screen->pitch,
-			       IPC_CREAT | 0777);
-	if ( shminfo.shmid >= 0 ) {
-		shminfo.shmaddr = (char *)shmat(shminfo.shmid, 0, 0);
-		shminfo.readOnly = False;
-		if ( shminfo.shmaddr != (char *)-1 ) {
-			shm_error = False;
-			X_handler = XSetErrorHandler(shm_errhandler);
-			XShmAttach(SDL_Display, &shminfo);
-			XSync(SDL_Display, False);
-			XSetErrorHandler(X_handler);
-			if ( shm_error )
-				shmdt(shminfo.shmaddr);
-		} else {
-			shm_error = True;
-		}
-		shmctl(shminfo.shmid, IPC_RMID, NULL);
+	info->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0777);
+	if ( info->shmid < 0 ) {
+		return(-1);
+	}
+	info->shmaddr = (char *)shmat(info->shmid, 0, 0);
+	info->readOnly = False;
+	if ( info->shmaddr != (char *)-1 ) {
+		shm_error = False;
+		X_handler = XSetErrorHandler(shm_errhandler);
+		XShmAttach(SDL_Display, info);
+		XSync(SDL_Display, False);
+		XSetErrorHandler(X_handler);
+		if ( shm_error )
+			shmdt(info->shmaddr);
 	} else {
 		shm_error = True;
 	}
-	if ( shm_error )
+	shmctl(info->shmid, IPC_RMID, NULL);
+	return(shm_error ? -1 : 0);
+}
+
+/* Detach and free a segment allocated by reserve_mitshm() */
+static void release_mitshm(_THIS, XShmSegmentInfo *info, int *size)
+{
+	if ( *size > 0 ) {
+		XShmDetach(SDL_Display, info);
+		XSync(SDL_Display, False);
+		shmdt(info->shmaddr);
+		*size = 0;
+	}
+}
+
+/* Make sure a segment of at least 'needed' bytes is attached.
+   The current segment is kept if it's big enough, otherwise it's
+   replaced with one at least half again as large, so that growing a
+   window a few pixels at a time doesn't allocate on every step.
+ */
+static int reserve_mitshm(_THIS, XShmSegmentInfo *info, int *size, int needed)
+{
+	int capacity;
+
+	if ( *size >= needed ) {
+		return(0);
+	}
+	capacity = *size + *size / 2;
+	if ( capacity < needed ) {
+		capacity = needed;
+	}
+	release_mitshm(this, info, size);
+	if ( attach_mitshm(this, info, capacity) < 0 ) {
+		return(-1);
+	}
+	*size = capacity;
+	return(0);
+}
+
+static void try_mitshm(_THIS, SDL_Surface *screen)
+{
+	if(!use_mitshm)
+		return;
+	if ( reserve_mitshm(this, &shminfo, &shm_size,
+			    screen->h*screen->pitch) < 0 )
 		use_mitshm = 0;
 	if ( use_mitshm )
 		screen->pixels = shminfo.shmaddr;
 }
+
+/* Number of segments to rotate through when presenting, 1 disables it */
+static int get_shm_nbuffers(_THIS)
+{
+	const char *env = SDL_getenv("SDL_VIDEO_X11_SHM_BUFFERS");
+	int n = 1;
+
+	if ( env ) {
+		n = SDL_atoi(env);
+	}
+	if ( n < 1 ) {
+		n = 1;
+	}
+	if ( n > (int)SDL_arraysize(shm_buffers) ) {
+		n = (int)SDL_arraysize(shm_buffers);
+	}
+	return(n);
+}
+
+/* Free the images used by X11_MITSHMBufferedUpdate().  The segments
+   behind them stay attached for the next mode unless 'all' is set.
+ */
+static void destroy_shm_buffers(_THIS, int all)
+{
+	XEvent event;
+	int i;
+
+	if ( shm_nbuffers > 0 ) {
+		/* Wait for outstanding puts, and drop their completions */
+		XSync(GFX_Display, False);
+		while ( XCheckTypedEvent(GFX_Display, shm_completion, &event) )
+			;
+	}
+	for ( i=0; i<shm_nbuffers; ++i ) {
+		shm_buffers[i].image->data = NULL;
+		XDestroyImage(shm_buffers[i].image);
+		shm_buffers[i].image = NULL;
+		shm_buffers[i].busy = 0;
+	}
+	shm_nbuffers = 0;
+	if ( all ) {
+		for ( i=0; i<(int)SDL_arraysize(shm_buffers); ++i ) {
+			release_mitshm(this, &shm_buffers[i].info,
+				       &shm_buffers[i].size);
+		}
+	}
+}
+
+/* Set up the segments used by X11_MITSHMBufferedUpdate().
+   The application keeps drawing into private memory, and updated
+   rectangles are copied into a segment the server isn't reading from,
+   so presenting never has to wait for the previous frame to finish.
+ */
+static int create_shm_buffers(_THIS, SDL_Surface *screen, int n)
+{
+	XImage *image;
+	int i;
+
+	shm_nbuffers = 0;
+	shm_next = 0;
+	shm_completion = XShmGetEventBase(GFX_Display) + ShmCompletion;
+	for ( i=0; i<n; ++i ) {
+		image = XShmCreateImage(SDL_Display, SDL_Visual,
+					this->hidden->depth, ZPixmap,
+					NULL, &shm_buffers[i].info,
+					screen->w, screen->h);
+		if ( image == NULL ) {
+			break;
+		}
+		if ( reserve_mitshm(this, &shm_buffers[i].info,
+				    &shm_buffers[i].size,
+				    image->bytes_per_line*image->height) < 0 ) {
+			XDestroyImage(image);
+			break;
+		}
+		image->data = shm_buffers[i].info.shmaddr;
+		shm_buffers[i].image = image;
+		shm_buffers[i].busy = 0;
+		++shm_nbuffers;
+	}
+	if ( shm_nbuffers < n ) {
+		destroy_shm_buffers(this, 1);
+		return(-1);
+	}
+	/* Drop segments left over from a mode that used more of them */
+	for ( ; i<(int)SDL_arraysize(shm_buffers); ++i ) {
+		release_mitshm(this, &shm_buffers[i].info,
+			       &shm_buffers[i].size);
+	}
+	return(0);
+}
 #endif /* ! NO_SHARED_MEMORY */
 
 /* Various screen update functions available */
 static void X11_NormalUpdate(_THIS, int numrects, SDL_Rect *rects);
 static void X11_MITSHMUpdate(_THIS, int numrects, SDL_Rect *rects);
+static void X11_MITSHMBufferedUpdate(_THIS, int numrects, SDL_Rect *rects);
 
 int X11_SetupImage(_THIS, SDL_Surface *screen)
 {
 #ifndef NO_SHARED_MEMORY
-	try_mitshm(this, screen);
-	if(use_mitshm) {
+	int nbuffers;
+
+	/* Dynamic X11 may not have SHM entry points on this box. */
+	if ((use_mitshm) && (!SDL_X11_HAVE_SHM))
+		use_mitshm = 0;
+	nbuffers = use_mitshm ? get_shm_nbuffers(this) : 1;
+	if ( (nbuffers > 1) && (create_shm_buffers(this, screen, nbuffers) < 0) ) {
+		nbuffers = 1;
+	}
+	if ( nbuffers == 1 ) {
+		try_mitshm(this, screen);
+	} else {
+		release_mitshm(this, &shminfo, &shm_size);
+	}
+	if(use_mitshm && (nbuffers == 1)) {
 		SDL_Ximage = XShmCreateImage(SDL_Display, SDL_Visual,
 					     this->hidden->depth, ZPixmap,
 					     shminfo.shmaddr, &shminfo, 
 					     screen->w, screen->h);
 		if(!SDL_Ximage) {
-			XShmDetach(SDL_Display, &shminfo);
-			XSync(SDL_Display, False);
-			shmdt(shminfo.shmaddr);
+			release_mitshm(this, &shminfo, &shm_size);
 			screen->pixels = NULL;
 			goto error;
 		}
+		shm_image = 1;
 		this->UpdateRects = X11_MITSHMUpdate;
 	}
-	if(!use_mitshm)
+	if(!use_mitshm || (nbuffers > 1))
 #endif /* not NO_SHARED_MEMORY */
 	{
 		screen->pixels = SDL_malloc(screen->h*screen->pitch);
@@ -118,6 +259,11 @@ int X11_SetupImage(_THIS, SDL_Surface *screen)
 		SDL_Ximage->byte_order = (SDL_BYTEORDER == SDL_BIG_ENDIAN)
 			                 ? MSBFirst : LSBFirst;
 		this->UpdateRects = X11_NormalUpdate;
+#ifndef NO_SHARED_MEMORY
+		if ( shm_nbuffers > 0 ) {
+			this->UpdateRects = X11_MITSHMBufferedUpdate;
+		}
+#endif
 	}
 	screen->pitch = SDL_Ximage->bytes_per_line;
 	return(0);
@@ -127,24 +273,41 @@ error:
 	return 1;
 }
 
-void X11_DestroyImage(_THIS, SDL_Surface *screen)
+/* Free the screen image, optionally keeping shared memory for reuse */
+static void destroy_image(_THIS, SDL_Surface *screen, int keep_segments)
 {
+#ifndef NO_SHARED_MEMORY
+	destroy_shm_buffers(this, !keep_segments);
+#endif
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	X11_DestroyXRenderScreen(this, screen);
+#endif
 	if ( SDL_Ximage ) {
-		XDestroyImage(SDL_Ximage);
 #ifndef NO_SHARED_MEMORY
-		if ( use_mitshm ) {
-			XShmDetach(SDL_Display, &shminfo);
-			XSync(SDL_Display, False);
-			shmdt(shminfo.shmaddr);
+		if ( shm_image ) {
+			/* Make sure the server is done reading it */
+			XSync(GFX_Display, False);
 		}
-#endif /* ! NO_SHARED_MEMORY */
+		shm_image = 0;
+#endif
+		XDestroyImage(SDL_Ximage);
 		SDL_Ximage = NULL;
 	}
+#ifndef NO_SHARED_MEMORY
+	if ( !keep_segments ) {
+		release_mitshm(this, &shminfo, &shm_size);
+	}
+#endif
 	if ( screen ) {
 		screen->pixels = NULL;
 	}
 }
 
+void X11_DestroyImage(_THIS, SDL_Surface *screen)
+{
+	destroy_image(this, screen, 0);
+}
+
 /* Determine the number of CPUs in the system */
 static int num_CPU(void)
 {
@@ -182,11 +345,17 @@ int X11_ResizeImage(_THIS, SDL_Surface *screen, Uint32 flags)
 {
 	int retval;
 
-	X11_DestroyImage(this, screen);
+	/* Keep any shared memory segments, they are resized if needed */
+	destroy_image(this, screen, !(flags & SDL_OPENGL));
         if ( flags & SDL_OPENGL ) {  /* No image when using GL */
         	retval = 0;
         } else {
 		retval = X11_SetupImage(this, screen);
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+		if ( retval == 0 ) {
+			X11_SetupXRenderScreen(this, screen, flags);
+		}
+#endif
 		/* We support asynchronous blitting on the display */
 		if ( flags & SDL_ASYNCBLIT ) {
 			/* This is actually slower on single-CPU systems,
@@ -202,13 +371,20 @@ int X11_ResizeImage(_THIS, SDL_Surface *screen, Uint32 flags)
 	return(retval);
 }
 
-/* We don't actually allow hardware surfaces other than the main one */
+/* Hardware surfaces other than the main one need the XRender extension */
 int X11_AllocHWSurface(_THIS, SDL_Surface *surface)
 {
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	return(X11_AllocXRenderSurface(this, surface));
+#else
 	return(-1);
+#endif
 }
 void X11_FreeHWSurface(_THIS, SDL_Surface *surface)
 {
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	X11_FreeXRenderSurface(this, surface);
+#endif
 	return;
 }
 
@@ -218,10 +394,20 @@ int X11_LockHWSurface(_THIS, SDL_Surface *surface)
 		XSync(GFX_Display, False);
 		blit_queued = 0;
 	}
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	if ( surface->hwdata ) {
+		return(X11_LockXRenderSurface(this, surface));
+	}
+#endif
 	return(0);
 }
 void X11_UnlockHWSurface(_THIS, SDL_Surface *surface)
 {
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	if ( surface->hwdata ) {
+		X11_UnlockXRenderSurface(this, surface);
+	}
+#endif
 	return;
 }
 
@@ -273,6 +459,83 @@ static void X11_MITSHMUpdate(_THIS, int numrects, SDL_Rect *rects)
 #endif /* ! NO_SHARED_MEMORY */
 }
 
+#ifndef NO_SHARED_MEMORY
+static Bool shm_completed(Display *display, XEvent *event, XPointer arg)
+{
+	return(event->type == *(int *)arg);
+}
+
+/* Mark the segment whose XShmPutImage the server has finished */
+static void shm_buffer_done(_THIS, XEvent *event)
+{
+	ShmSeg shmseg = ((XShmCompletionEvent *)event)->shmseg;
+	int i;
+
+	for ( i=0; i<shm_nbuffers; ++i ) {
+		if ( shm_buffers[i].info.shmseg == shmseg ) {
+			shm_buffers[i].busy = 0;
+		}
+	}
+}
+#endif /* ! NO_SHARED_MEMORY */
+
+static void X11_MITSHMBufferedUpdate(_THIS, int numrects, SDL_Rect *rects)
+{
+#ifndef NO_SHARED_MEMORY
+	SDL_Surface *screen = SDL_VideoSurface;
+	XImage *image;
+	XEvent event;
+	Uint8 *src, *dst;
+	int i, y, bpp, len, last;
+
+	/* Collect completions, then wait for the next segment if needed */
+	while ( XCheckTypedEvent(GFX_Display, shm_completion, &event) ) {
+		shm_buffer_done(this, &event);
+	}
+	while ( shm_buffers[shm_next].busy ) {
+		XIfEvent(GFX_Display, &event, shm_completed,
+			 (XPointer)&shm_completion);
+		shm_buffer_done(this, &event);
+	}
+	image = shm_buffers[shm_next].image;
+	bpp = image->bits_per_pixel / 8;
+
+	last = -1;
+	for ( i=0; i<numrects; ++i ) {
+		if ( rects[i].w == 0 || rects[i].h == 0 ) { /* Clipped? */
+			continue;
+		}
+		src = (Uint8 *)screen->pixels +
+		      rects[i].y*screen->pitch + rects[i].x*bpp;
+		dst = (Uint8 *)image->data +
+		      rects[i].y*image->bytes_per_line + rects[i].x*bpp;
+		len = rects[i].w*bpp;
+		for ( y=rects[i].h; y; --y ) {
+			SDL_memcpy(dst, src, len);
+			src += screen->pitch;
+			dst += image->bytes_per_line;
+		}
+		last = i;
+	}
+	if ( last < 0 ) {
+		return;
+	}
+	/* Only the last put asks for a completion event */
+	for ( i=0; i<=last; ++i ) {
+		if ( rects[i].w == 0 || rects[i].h == 0 ) {
+			continue;
+		}
+		XShmPutImage(GFX_Display, SDL_Window, SDL_GC, image,
+				rects[i].x, rects[i].y,
+				rects[i].x, rects[i].y, rects[i].w, rects[i].h,
+				(i == last));
+	}
+	shm_buffers[shm_next].busy = 1;
+	shm_next = (shm_next + 1) % shm_nbuffers;
+	XFlush(GFX_Display);
+#endif /* ! NO_SHARED_MEMORY */
+}
+
 /* There's a problem with the automatic refreshing of the display.
    Even though the XVideo code uses the GFX_Display to update the
    video memory, it appears that updating the window asynchronously
@@ -300,8 +563,13 @@ void X11_RefreshDisplay(_THIS)
 		SDL_PrivateExpose();
 		return;
 	}
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	if ( X11_RefreshXRenderScreen(this) ) {
+		return;
+	}
+#endif
 #ifndef NO_SHARED_MEMORY
-	if ( this->UpdateRects == X11_MITSHMUpdate ) {
+	if ( shm_image ) {
 		XShmPutImage(SDL_Display, SDL_Window, SDL_GC, SDL_Ximage,
 				0, 0, 0, 0, this->screen->w, this->screen->h,
 				False);
@@ -0,0 +1,650 @@
+/*
+    SDL - Simple DirectMedia Layer
+    Copyright (C) 1997-2012 Sam Lantinga
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+    Sam Lantinga
+    slouken@libsdl.org
+*/
+#include "SDL_config.h"
+
+/* This is the XRender extension implementation of hardware surfaces.
+
+   Every hardware surface keeps its pixels in client memory, where it can
+   be locked, and a copy in a server side Picture, which blits and fills
+   render into.  Whichever copy was written last is transferred to the
+   other one when it's needed, so a sprite that is only ever blitted is
+   uploaded once, and a frame drawn entirely with fills and blits never
+   crosses the wire until it's copied to the window.
+*/
+
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+
+#include "SDL_endian.h"
+#include "SDL_x11render_c.h"
+#include "../SDL_pixels_c.h"
+#include "../SDL_blit.h"
+
+/* Which copy of a surface holds its current contents */
+#define XRENDER_SYNCED		0	/* the pixmap matches the pixels */
+#define XRENDER_CLIENT_NEWER	1	/* the pixels were written to */
+#define XRENDER_SERVER_NEWER	2	/* the pixmap was rendered to */
+
+struct private_hwdata {
+	Pixmap pixmap;
+	Picture picture;
+	GC gc;
+	XImage *image;		/* wraps the surface pixels */
+	int state;
+
+	/* Mask used for colorkey and per-surface alpha blits */
+	Pixmap mask_pixmap;
+	Picture mask;
+	int mask_valid;
+	Uint32 mask_flags;
+	Uint32 mask_key;
+	Uint8 mask_alpha;
+};
+
+static int X11_XRenderCheckBlit(_THIS, SDL_Surface *src, SDL_Surface *dst);
+static int X11_XRenderFillRect(_THIS, SDL_Surface *dst, SDL_Rect *rect, Uint32 color);
+static int X11_XRenderSetColorKey(_THIS, SDL_Surface *surface, Uint32 key);
+static int X11_XRenderSetAlpha(_THIS, SDL_Surface *surface, Uint8 value);
+
+/* Alpha surfaces are always ARGB8888, matching PictStandardARGB32 */
+static int is_argb(SDL_PixelFormat *format)
+{
+	return( format->BitsPerPixel == 32 &&
+	        format->Rmask == 0x00FF0000 && format->Gmask == 0x0000FF00 &&
+	        format->Bmask == 0x000000FF && format->Amask == 0xFF000000 );
+}
+
+static int covers(SDL_Surface *surface, SDL_Rect *rect)
+{
+	return( rect->x == 0 && rect->y == 0 &&
+	        rect->w == surface->w && rect->h == surface->h );
+}
+
+void X11_InitXRender(_THIS)
+{
+	const char *env;
+	int event_base, error_base;
+
+	use_xrender = 0;
+	env = SDL_getenv("SDL_VIDEO_X11_XRENDER");
+	if ( !env || !SDL_atoi(env) || !SDL_X11_HAVE_XRENDER ) {
+		return;
+	}
+	if ( !XRenderQueryExtension(GFX_Display, &event_base, &error_base) ) {
+		return;
+	}
+	xrender_argb = XRenderFindStandardFormat(GFX_Display,
+	                                         PictStandardARGB32);
+	if ( xrender_argb == NULL ) {
+		return;
+	}
+	this->displayformatalphapixel = SDL_AllocFormat(32, 0x00FF0000,
+	                                    0x0000FF00, 0x000000FF, 0xFF000000);
+	if ( this->displayformatalphapixel == NULL ) {
+		return;
+	}
+	use_xrender = 1;
+
+	this->CheckHWBlit = X11_XRenderCheckBlit;
+	this->FillHWRect = X11_XRenderFillRect;
+	this->SetHWColorKey = X11_XRenderSetColorKey;
+	this->SetHWAlpha = X11_XRenderSetAlpha;
+	this->info.hw_available = 1;
+	this->info.blit_hw = 1;
+	this->info.blit_hw_CC = 1;
+	this->info.blit_hw_A = 1;
+	this->info.blit_fill = 1;
+}
+
+void X11_QuitXRender(_THIS)
+{
+	if ( this->displayformatalphapixel ) {
+		SDL_FreeFormat(this->displayformatalphapixel);
+		this->displayformatalphapixel = NULL;
+	}
+	use_xrender = 0;
+}
+
+static void free_mask(_THIS, struct private_hwdata *hw)
+{
+	if ( hw->mask ) {
+		XRenderFreePicture(GFX_Display, hw->mask);
+		hw->mask = None;
+	}
+	if ( hw->mask_pixmap ) {
+		XFreePixmap(GFX_Display, hw->mask_pixmap);
+		hw->mask_pixmap = None;
+	}
+	hw->mask_valid = 0;
+}
+
+static void free_hwdata(_THIS, struct private_hwdata *hw)
+{
+	free_mask(this, hw);
+	if ( hw->picture ) {
+		XRenderFreePicture(GFX_Display, hw->picture);
+	}
+	if ( hw->gc ) {
+		XFreeGC(GFX_Display, hw->gc);
+	}
+	if ( hw->pixmap ) {
+		XFreePixmap(GFX_Display, hw->pixmap);
+	}
+	if ( hw->image ) {
+		/* The pixels belong to the surface */
+		hw->image->data = NULL;
+		XDestroyImage(hw->image);
+	}
+	SDL_free(hw);
+}
+
+static struct private_hwdata *create_hwdata(_THIS, int w, int h, int depth,
+                                             XRenderPictFormat *format)
+{
+	struct private_hwdata *hw;
+
+	hw = (struct private_hwdata *)SDL_malloc(sizeof(*hw));
+	if ( hw == NULL ) {
+		SDL_OutOfMemory();
+		return(NULL);
+	}
+	SDL_memset(hw, 0, sizeof(*hw));
+	hw->pixmap = XCreatePixmap(GFX_Display, SDL_Root, w, h, depth);
+	if ( hw->pixmap ) {
+		hw->picture = XRenderCreatePicture(GFX_Display, hw->pixmap,
+		                                   format, 0, NULL);
+		hw->gc = XCreateGC(GFX_Display, hw->pixmap, 0, NULL);
+	}
+	if ( !hw->picture || !hw->gc ) {
+		free_hwdata(this, hw);
+		SDL_SetError("Couldn't create XRender picture");
+		return(NULL);
+	}
+	hw->state = XRENDER_CLIENT_NEWER;
+	return(hw);
+}
+
+/* Copy the pixels of a surface to its pixmap */
+static int upload(_THIS, SDL_Surface *surface)
+{
+	struct private_hwdata *hw = surface->hwdata;
+	XImage *image = hw->image;
+	char *pixels = image->data;
+	Uint8 *temp = NULL;
+
+	if ( surface->format->Amask ) {
+		/* Render expects premultiplied alpha */
+		Uint32 *src, *dst;
+		Uint32 pixel, a;
+		int x, y;
+
+		temp = (Uint8 *)SDL_malloc(surface->h*surface->pitch);
+		if ( temp == NULL ) {
+			SDL_OutOfMemory();
+			return(-1);
+		}
+		for ( y = 0; y < surface->h; ++y ) {
+			src = (Uint32 *)((Uint8 *)surface->pixels + y*surface->pitch);
+			dst = (Uint32 *)(temp + y*surface->pitch);
+			for ( x = 0; x < surface->w; ++x ) {
+				pixel = src[x];
+				a = pixel >> 24;
+				dst[x] = (pixel & 0xFF000000) |
+				  ((((pixel >> 16) & 0xFF) * a + 127) / 255) << 16 |
+				  ((((pixel >> 8) & 0xFF) * a + 127) / 255) << 8 |
+				  (((pixel & 0xFF) * a + 127) / 255);
+			}
+		}
+		image->data = (char *)temp;
+	}
+#ifndef NO_SHARED_MEMORY
+	if ( image->obdata ) {
+		/* The screen image, the server reads it asynchronously */
+		XShmPutImage(GFX_Display, hw->pixmap, hw->gc, image,
+		             0, 0, 0, 0, surface->w, surface->h, False);
+		blit_queued = 1;
+	} else
+#endif
+	{
+		XPutImage(GFX_Display, hw->pixmap, hw->gc, image,
+		          0, 0, 0, 0, surface->w, surface->h);
+	}
+	image->data = pixels;
+	if ( temp ) {
+		SDL_free(temp);
+	}
+	hw->state = XRENDER_SYNCED;
+	hw->mask_valid = 0;
+	return(0);
+}
+
+/* Read the pixmap of a surface back into its pixels */
+static int download(_THIS, SDL_Surface *surface)
+{
+	struct private_hwdata *hw = surface->hwdata;
+	int bpp = surface->format->BytesPerPixel;
+	int swap;
+	XImage *image;
+	Uint8 *src, *dst;
+	int x, y, len;
+
+	image = XGetImage(GFX_Display, hw->pixmap, 0, 0,
+	                  surface->w, surface->h, AllPlanes, ZPixmap);
+	if ( image == NULL ) {
+		SDL_SetError("Couldn't read hardware surface");
+		return(-1);
+	}
+	swap = (image->byte_order !=
+	        ((SDL_BYTEORDER == SDL_BIG_ENDIAN) ? MSBFirst : LSBFirst));
+	len = surface->w * bpp;
+	if ( len > image->bytes_per_line ) {
+		len = image->bytes_per_line;
+	}
+	for ( y = 0; y < surface->h; ++y ) {
+		src = (Uint8 *)image->data + y*image->bytes_per_line;
+		dst = (Uint8 *)surface->pixels + y*surface->pitch;
+		SDL_memcpy(dst, src, len);
+		if ( swap && bpp == 2 ) {
+			Uint16 *p = (Uint16 *)dst;
+			for ( x = 0; x < surface->w; ++x ) {
+				p[x] = SDL_Swap16(p[x]);
+			}
+		} else if ( swap && bpp == 4 ) {
+			Uint32 *p = (Uint32 *)dst;
+			for ( x = 0; x < surface->w; ++x ) {
+				p[x] = SDL_Swap32(p[x]);
+			}
+		}
+		if ( surface->format->Amask ) {
+			Uint32 *p = (Uint32 *)dst;
+			Uint32 pixel, a, r, g, b;
+			for ( x = 0; x < surface->w; ++x ) {
+				pixel = p[x];
+				a = pixel >> 24;
+				if ( a == 0 || a == 255 ) {
+					continue;
+				}
+				r = (((pixel >> 16) & 0xFF) * 255 + a/2) / a;
+				g = (((pixel >> 8) & 0xFF) * 255 + a/2) / a;
+				b = ((pixel & 0xFF) * 255 + a/2) / a;
+				p[x] = (a << 24) | (SDL_min(r, 255) << 16) |
+				       (SDL_min(g, 255) << 8) | SDL_min(b, 255);
+			}
+		}
+	}
+	XDestroyImage(image);
+	hw->state = XRENDER_SYNCED;
+	return(0);
+}
+
+/* Build the mask picture for the current colorkey and alpha of a surface.
+   Colorkeyed surfaces get a full size mask which is zero on the key and
+   the surface alpha elsewhere, otherwise a repeating 1x1 mask is enough.
+ */
+static int update_mask(_THIS, SDL_Surface *surface)
+{
+	struct private_hwdata *hw = surface->hwdata;
+	SDL_PixelFormat *format = surface->format;
+	Uint32 flags = surface->flags & (SDL_SRCCOLORKEY|SDL_SRCALPHA);
+	Uint8 alpha = SDL_ALPHA_OPAQUE;
+	XRenderPictureAttributes attr;
+
+	if ( format->Amask && (flags & SDL_SRCALPHA) ) {
+		/* Per-pixel alpha replaces the colorkey and surface alpha */
+		flags = 0;
+	}
+	if ( (flags & SDL_SRCALPHA) && !format->Amask ) {
+		alpha = format->alpha;
+	}
+	if ( alpha == SDL_ALPHA_OPAQUE ) {
+		flags &= ~SDL_SRCALPHA;
+	}
+	if ( hw->mask_valid && hw->mask_flags == flags &&
+	     hw->mask_key == format->colorkey && hw->mask_alpha == alpha ) {
+		return(0);
+	}
+	free_mask(this, hw);
+	hw->mask_flags = flags;
+	hw->mask_key = format->colorkey;
+	hw->mask_alpha = alpha;
+
+	if ( flags & SDL_SRCCOLORKEY ) {
+		Uint32 rgbmask = ~format->Amask;
+		Uint32 ckey = format->colorkey & rgbmask;
+		int bpp = format->BytesPerPixel;
+		int pitch = (surface->w + 3) & ~3;
+		Uint8 *bits, *src;
+		Uint32 pixel;
+		XImage *image;
+		GC gc;
+		int x, y;
+
+		if ( hw->state == XRENDER_SERVER_NEWER &&
+		     download(this, surface) < 0 ) {
+			return(-1);
+		}
+		bits = (Uint8 *)SDL_malloc(pitch * surface->h);
+		if ( bits == NULL ) {
+			SDL_OutOfMemory();
+			return(-1);
+		}
+		for ( y = 0; y < surface->h; ++y ) {
+			src = (Uint8 *)surface->pixels + y*surface->pitch;
+			for ( x = 0; x < surface->w; ++x ) {
+				RETRIEVE_RGB_PIXEL(src, bpp, pixel);
+				bits[y*pitch + x] =
+					((pixel & rgbmask) == ckey) ? 0 : alpha;
+				src += bpp;
+			}
+		}
+		image = XCreateImage(GFX_Display, SDL_Visual, 8, ZPixmap, 0,
+		                     (char *)bits, surface->w, surface->h,
+		                     32, pitch);
+		if ( image == NULL ) {
+			SDL_free(bits);
+			SDL_SetError("Couldn't create XImage");
+			return(-1);
+		}
+		hw->mask_pixmap = XCreatePixmap(GFX_Display, SDL_Root,
+		                                surface->w, surface->h, 8);
+		gc = XCreateGC(GFX_Display, hw->mask_pixmap, 0, NULL);
+		XPutImage(GFX_Display, hw->mask_pixmap, gc, image,
+		          0, 0, 0, 0, surface->w, surface->h);
+		XFreeGC(GFX_Display, gc);
+		XDestroyImage(image);	/* frees bits */
+		hw->mask = XRenderCreatePicture(GFX_Display, hw->mask_pixmap,
+		           XRenderFindStandardFormat(GFX_Display, PictStandardA8),
+		           0, NULL);
+	} else if ( flags & SDL_SRCALPHA ) {
+		XRenderColor color;
+
+		hw->mask_pixmap = XCreatePixmap(GFX_Display, SDL_Root, 1, 1, 8);
+		attr.repeat = True;
+		hw->mask = XRenderCreatePicture(GFX_Display, hw->mask_pixmap,
+		           XRenderFindStandardFormat(GFX_Display, PictStandardA8),
+		           CPRepeat, &attr);
+		color.red = color.green = color.blue = 0;
+		color.alpha = alpha * 257;
+		XRenderFillRectangle(GFX_Display, PictOpSrc, hw->mask,
+		                     &color, 0, 0, 1, 1);
+	}
+	hw->mask_valid = 1;
+	return(0);
+}
+
+static int X11_XRenderBlit(SDL_Surface *src, SDL_Rect *srcrect,
+                           SDL_Surface *dst, SDL_Rect *dstrect)
+{
+	SDL_VideoDevice *this = current_video;
+	struct private_hwdata *srchw = src->hwdata;
+	struct private_hwdata *dsthw = dst->hwdata;
+	int op;
+
+	if ( srchw->state == XRENDER_CLIENT_NEWER && upload(this, src) < 0 ) {
+		return(-1);
+	}
+	if ( update_mask(this, src) < 0 ) {
+		return(-1);
+	}
+	if ( srchw->mask || (src->format->Amask && (src->flags & SDL_SRCALPHA)) ) {
+		op = PictOpOver;
+	} else {
+		op = PictOpSrc;
+	}
+	/* An opaque copy over the whole destination doesn't need its pixels */
+	if ( dsthw->state == XRENDER_CLIENT_NEWER &&
+	     (op != PictOpSrc || !covers(dst, dstrect)) &&
+	     upload(this, dst) < 0 ) {
+		return(-1);
+	}
+	XRenderComposite(GFX_Display, op, srchw->picture, srchw->mask,
+	                 dsthw->picture, srcrect->x, srcrect->y,
+	                 srcrect->x, srcrect->y, dstrect->x, dstrect->y,
+	                 srcrect->w, srcrect->h);
+	dsthw->state = XRENDER_SERVER_NEWER;
+	dsthw->mask_valid = 0;	/* the colorkey mask depends on the pixels */
+	return(0);
+}
+
+static int X11_XRenderCheckBlit(_THIS, SDL_Surface *src, SDL_Surface *dst)
+{
+	int alpha_blit = (src->format->Amask && (src->flags & SDL_SRCALPHA));
+
+	src->flags &= ~SDL_HWACCEL;
+	if ( !src->hwdata || !dst->hwdata || src == dst ) {
+		return(0);
+	}
+	/* Render blends would also change the destination alpha channel */
+	if ( dst->format->Amask &&
+	     (src->flags & (SDL_SRCCOLORKEY|SDL_SRCALPHA)) ) {
+		return(0);
+	}
+	/* Only alpha blits may convert between formats */
+	if ( !alpha_blit && !src->map->identity ) {
+		return(0);
+	}
+	src->flags |= SDL_HWACCEL;
+	src->map->hw_blit = X11_XRenderBlit;
+	return(1);
+}
+
+static int X11_XRenderFillRect(_THIS, SDL_Surface *dst, SDL_Rect *rect, Uint32 color)
+{
+	struct private_hwdata *hw = dst->hwdata;
+	XRenderColor xcolor;
+	Uint8 r, g, b, a;
+
+	if ( hw->state == XRENDER_CLIENT_NEWER && !covers(dst, rect) &&
+	     upload(this, dst) < 0 ) {
+		return(-1);
+	}
+	SDL_GetRGBA(color, dst->format, &r, &g, &b, &a);
+	xcolor.red = ((r * a + 127) / 255) * 257;
+	xcolor.green = ((g * a + 127) / 255) * 257;
+	xcolor.blue = ((b * a + 127) / 255) * 257;
+	xcolor.alpha = a * 257;
+	XRenderFillRectangle(GFX_Display, PictOpSrc, hw->picture, &xcolor,
+	                     rect->x, rect->y, rect->w, rect->h);
+	hw->state = XRENDER_SERVER_NEWER;
+	hw->mask_valid = 0;	/* the colorkey mask depends on the pixels */
+	return(0);
+}
+
+/* The mask is rebuilt at the next blit if the key, alpha or pixels changed */
+static int X11_XRenderSetColorKey(_THIS, SDL_Surface *surface, Uint32 key)
+{
+	return(0);
+}
+
+static int X11_XRenderSetAlpha(_THIS, SDL_Surface *surface, Uint8 value)
+{
+	return(0);
+}
+
+int X11_AllocXRenderSurface(_THIS, SDL_Surface *surface)
+{
+	SDL_PixelFormat *format = surface->format;
+	SDL_Surface *screen = SDL_VideoSurface;
+	struct private_hwdata *hw;
+	XRenderPictFormat *pictformat;
+	Uint8 *pixels;
+	int depth;
+
+	if ( !use_xrender || !screen || !screen->hwdata ||
+	     surface->w <= 0 || surface->h <= 0 ) {
+		return(-1);
+	}
+	if ( format->Amask ) {
+		if ( !is_argb(format) ) {
+			return(-1);
+		}
+		pictformat = xrender_argb;
+		depth = 32;
+	} else {
+		if ( format->BitsPerPixel != screen->format->BitsPerPixel ||
+		     format->Rmask != screen->format->Rmask ||
+		     format->Gmask != screen->format->Gmask ||
+		     format->Bmask != screen->format->Bmask ) {
+			return(-1);
+		}
+		pictformat = xrender_format;
+		depth = this->hidden->depth;
+	}
+
+	pixels = (Uint8 *)SDL_malloc(surface->h*surface->pitch);
+	if ( pixels == NULL ) {
+		SDL_OutOfMemory();
+		return(-1);
+	}
+	SDL_memset(pixels, 0, surface->h*surface->pitch);
+	hw = create_hwdata(this, surface->w, surface->h, depth, pictformat);
+	if ( hw == NULL ) {
+		SDL_free(pixels);
+		return(-1);
+	}
+	hw->image = XCreateImage(GFX_Display, SDL_Visual, depth, ZPixmap, 0,
+	                         (char *)pixels, surface->w, surface->h,
+	                         32, surface->pitch);
+	if ( hw->image == NULL ) {
+		free_hwdata(this, hw);
+		SDL_free(pixels);
+		SDL_SetError("Couldn't create XImage");
+		return(-1);
+	}
+	/* XPutImage will convert byte sex automatically */
+	hw->image->byte_order = (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+	                        ? MSBFirst : LSBFirst;
+
+	surface->pixels = pixels;
+	surface->hwdata = hw;
+	surface->flags |= SDL_HWSURFACE;
+	return(0);
+}
+
+void X11_FreeXRenderSurface(_THIS, SDL_Surface *surface)
+{
+	if ( surface->hwdata ) {
+		free_hwdata(this, surface->hwdata);
+		surface->hwdata = NULL;
+	}
+}
+
+int X11_LockXRenderSurface(_THIS, SDL_Surface *surface)
+{
+	if ( surface->hwdata->state == XRENDER_SERVER_NEWER ) {
+		return(download(this, surface));
+	}
+	return(0);
+}
+
+void X11_UnlockXRenderSurface(_THIS, SDL_Surface *surface)
+{
+	surface->hwdata->state = XRENDER_CLIENT_NEWER;
+}
+
+/* Show the screen pixmap if it was rendered to, the image otherwise */
+static void X11_XRenderUpdate(_THIS, int numrects, SDL_Rect *rects)
+{
+	struct private_hwdata *hw = SDL_VideoSurface->hwdata;
+	int i;
+
+	if ( hw->state != XRENDER_SERVER_NEWER ) {
+		xrender_update(this, numrects, rects);
+		return;
+	}
+	for ( i = 0; i < numrects; ++i ) {
+		if ( rects[i].w == 0 || rects[i].h == 0 ) { /* Clipped? */
+			continue;
+		}
+		XCopyArea(GFX_Display, hw->pixmap, SDL_Window, SDL_GC,
+		          rects[i].x, rects[i].y, rects[i].w, rects[i].h,
+		          rects[i].x, rects[i].y);
+	}
+	if ( SDL_VideoSurface->flags & SDL_ASYNCBLIT ) {
+		XFlush(GFX_Display);
+		blit_queued = 1;
+	} else {
+		XSync(GFX_Display, False);
+	}
+}
+
+void X11_SetupXRenderScreen(_THIS, SDL_Surface *screen, Uint32 flags)
+{
+	struct private_hwdata *hw;
+
+	screen->flags &= ~SDL_HWSURFACE;
+	if ( !use_xrender || !(flags & SDL_HWSURFACE) ||
+	     (flags & SDL_OPENGL) || !SDL_Ximage ||
+	     screen->format->BytesPerPixel == 1 ) {
+		return;
+	}
+	xrender_format = XRenderFindVisualFormat(GFX_Display, SDL_Visual);
+	if ( xrender_format == NULL ) {
+		return;
+	}
+	hw = create_hwdata(this, screen->w, screen->h,
+	                   this->hidden->depth, xrender_format);
+	if ( hw == NULL ) {
+		return;
+	}
+	hw->image = SDL_Ximage;
+	screen->hwdata = hw;
+	screen->flags |= SDL_HWSURFACE;
+
+	xrender_update = this->UpdateRects;
+	this->UpdateRects = X11_XRenderUpdate;
+}
+
+void X11_DestroyXRenderScreen(_THIS, SDL_Surface *screen)
+{
+	if ( screen && screen->hwdata ) {
+		/* The image is owned by SDL_x11image.c */
+		screen->hwdata->image = NULL;
+		free_hwdata(this, screen->hwdata);
+		screen->hwdata = NULL;
+		screen->flags &= ~SDL_HWSURFACE;
+	}
+	if ( xrender_update ) {
+		this->UpdateRects = xrender_update;
+		xrender_update = NULL;
+	}
+}
+
+/* Repaint the window from the screen pixmap if that's more recent */
+int X11_RefreshXRenderScreen(_THIS)
+{
+	struct private_hwdata *hw;
+
+	if ( !this->screen || !this->screen->hwdata ) {
+		return(0);
+	}
+	hw = this->screen->hwdata;
+	if ( hw->state != XRENDER_SERVER_NEWER ) {
+		return(0);
+	}
+	XSync(GFX_Display, False);
+	XCopyArea(SDL_Display, hw->pixmap, SDL_Window, SDL_GC, 0, 0,
+	          this->screen->w, this->screen->h, 0, 0);
+	XSync(SDL_Display, False);
+	return(1);
+}
+
+#endif /* SDL_VIDEO_DRIVER_X11_XRENDER */
@@ -0,0 +1,43 @@
+/*
+    SDL - Simple DirectMedia Layer
+    Copyright (C) 1997-2012 Sam Lantinga
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+    Sam Lantinga
+    slouken@libsdl.org
+*/
+#include "SDL_config.h"
+
+/* This is the XRender extension implementation of hardware surfaces */
+
+#include "SDL_video.h"
+#include "SDL_x11video.h"
+
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+
+extern void X11_InitXRender(_THIS);
+extern void X11_QuitXRender(_THIS);
+
+extern void X11_SetupXRenderScreen(_THIS, SDL_Surface *screen, Uint32 flags);
+extern void X11_DestroyXRenderScreen(_THIS, SDL_Surface *screen);
+extern int X11_RefreshXRenderScreen(_THIS);
+
+extern int X11_AllocXRenderSurface(_THIS, SDL_Surface *surface);
+extern void X11_FreeXRenderSurface(_THIS, SDL_Surface *surface);
+extern int X11_LockXRenderSurface(_THIS, SDL_Surface *surface);
+extern void X11_UnlockXRenderSurface(_THIS, SDL_Surface *surface);
+
+#endif /* SDL_VIDEO_DRIVER_X11_XRENDER */
@@ -52,6 +52,7 @@
 #include "SDL_x11yuv_c.h"
 #include "SDL_x11gl_c.h"
 #include "SDL_x11gamma_c.h"
+#include "SDL_x11render_c.h"
 #include "../blank_cursor.h"
 
 #ifdef X_HAVE_UTF8_STRING
@@ -693,6 +694,11 @@ static int X11_VideoInit(_THIS, SDL_PixelFormat *vformat)
 	}
 	X11_SaveVidModeGamma(this);
 
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+	/* Check for the XRender extension, for hardware surfaces */
+	X11_InitXRender(this);
+#endif
+
 	/* Allow environment override of screensaver disable. */
 	env = SDL_getenv("SDL_VIDEO_ALLOW_SCREENSAVER");
 	if ( env ) {
@@ -1224,7 +1230,12 @@ SDL_Surface *X11_SetVideoMode(_THIS, SDL_Surface *current,
 
 	/* Set up the new mode framebuffer */
 	if ( ((current->w != width) || (current->h != height)) ||
-             ((saved_flags&SDL_OPENGL) != (flags&SDL_OPENGL)) ) {
+             ((saved_flags&SDL_OPENGL) != (flags&SDL_OPENGL))
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+          || (use_xrender &&
+             ((saved_flags&SDL_HWSURFACE) != (flags&SDL_HWSURFACE)))
+#endif
+	   ) {
 		current->w = width;
 		current->h = height;
 		current->pitch = SDL_CalculatePitch(current);
@@ -1523,6 +1534,9 @@ void X11_VideoQuit(_THIS)
 
 		/* Start shutting down the windows */
 		X11_DestroyImage(this, this->screen);
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+		X11_QuitXRender(this);
+#endif
 		X11_DestroyWindow(this, this->screen);
 		X11_FreeVideoModes(this);
 		if ( SDL_XColorMap != SDL_DisplayColormap ) {
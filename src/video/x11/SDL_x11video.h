@@ -40,6 +40,9 @@
 #if SDL_VIDEO_DRIVER_X11_XRANDR
 #include <X11/extensions/Xrandr.h>
 #endif
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
 #if SDL_VIDEO_DRIVER_X11_VIDMODE
 #include "../Xext/extensions/xf86vmode.h"
 #endif
@@ -75,12 +78,33 @@ struct SDL_PrivateVideoData {
     /* MIT shared memory extension information */
     int use_mitshm;
     XShmSegmentInfo shminfo;
+    int shm_size;		/* bytes in shminfo, 0 if not attached */
+    int shm_image;		/* Flag: the X image lives in shminfo */
+
+    /* Segments the screen is copied into for asynchronous updates */
+    struct {
+        XShmSegmentInfo info;
+        int size;
+        XImage *image;
+        int busy;		/* waiting for the server to finish */
+    } shm_buffers[3];
+    int shm_nbuffers;
+    int shm_next;
+    int shm_completion;		/* XShmCompletionEvent type */
 #endif
 
     /* The variables used for displaying graphics */
     XImage *Ximage;		/* The X image for our window */
     GC	gc;			/* The graphic context for drawing */
 
+#if SDL_VIDEO_DRIVER_X11_XRENDER
+    /* XRender extension information, for hardware surfaces */
+    int use_xrender;
+    XRenderPictFormat *xrender_format;	/* format of the visual */
+    XRenderPictFormat *xrender_argb;	/* format of alpha surfaces */
+    void (*xrender_update)(_THIS, int numrects, SDL_Rect *rects);
+#endif
+
     /* The current width and height of the fullscreen mode */
     int window_w;
     int window_h;
@@ -174,6 +198,16 @@ struct SDL_PrivateVideoData {
 #define using_dga		(this->hidden->using_dga)
 #define use_mitshm		(this->hidden->use_mitshm)
 #define shminfo			(this->hidden->shminfo)
+#define shm_size		(this->hidden->shm_size)
+#define shm_image		(this->hidden->shm_image)
+#define shm_buffers		(this->hidden->shm_buffers)
+#define shm_nbuffers		(this->hidden->shm_nbuffers)
+#define shm_next		(this->hidden->shm_next)
+#define shm_completion		(this->hidden->shm_completion)
+#define use_xrender		(this->hidden->use_xrender)
+#define xrender_format		(this->hidden->xrender_format)
+#define xrender_argb		(this->hidden->xrender_argb)
+#define xrender_update		(this->hidden->xrender_update)
 #define SDL_Ximage		(this->hidden->Ximage)
 #define SDL_GC			(this->hidden->gc)
 #define window_w		(this->hidden->window_w)
@@ -124,6 +124,16 @@ static void X11_ClearYUVOverlay(SDL_Overlay *overlay)
 				-128, overlay->w / 2);
 		}
 		break;
+	case SDL_NV12_OVERLAY:
+	case SDL_NV21_OVERLAY:
+		for (y = 0; y < overlay->h; y++)
+			memset(overlay->pixels[0] + y * overlay->pitches[0],
+				0, overlay->w);
+
+		for (y = 0; y < (overlay->h / 2); y++)
+			memset(overlay->pixels[1] + y * overlay->pitches[1],
+				-128, (overlay->w / 2) * 2);
+		break;
 	case SDL_YUY2_OVERLAY:
 	case SDL_YVYU_OVERLAY:
 		for (y = 0; y < overlay->h; y++)